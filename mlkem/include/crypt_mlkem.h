@@ -21,10 +21,73 @@
 
 typedef struct CryptMlKemCtx CRYPT_ML_KEM_Ctx;
 
+/* ML-KEM specific CRYPT_ML_KEM_Ctrl options, numbered after the generic CRYPT_CTRL_* commands. */
+typedef enum {
+    /*
+     * val: uint32_t, non-zero to not store the matrix A of the key. Every encapsulation, decapsulation and key
+     * generation regenerates A row by row instead, which saves k * k * 512 bytes per key for one-shot peers.
+     * Unlike with a stored matrix, encapsulation and decapsulation then allocate one SHAKE128 context per call for
+     * the rows, through the provider of the libCtx if there is one. Only on AVX2 hosts without a libCtx does the
+     * XOF state stay on the stack. Must be set before the key is generated, set or used.
+     */
+    CRYPT_CTRL_ML_KEM_SET_NO_MATRIX = 0x10000,
+    /*
+     * val: uint32_t, non-zero to precompute the zeta products of the odd coefficients of the stored key polynomials
+     * when the key is expanded. Encapsulation and decapsulation then need fewer multiplications and reductions, for
+     * (k * k + 2 * k) * 256 bytes more per key, or 2 * k * 256 bytes with CRYPT_CTRL_ML_KEM_SET_NO_MATRIX.
+     * Meant for long-lived, heavily used keys. Must be set before the key is generated, set or used.
+     */
+    CRYPT_CTRL_ML_KEM_SET_MULCACHE = 0x10001,
+    /*
+     * val: uint32_t, CRYPT_ML_KEM_DK_FORMAT_*, the format in which CRYPT_ML_KEM_GetDecapsKey returns the key and
+     * whose length CRYPT_CTRL_GET_PRVKEY_LEN reports. CRYPT_ML_KEM_DK_FORMAT_EXPANDED by default.
+     */
+    CRYPT_CTRL_ML_KEM_SET_DK_FORMAT = 0x10002,
+} CRYPT_ML_KEM_CtrlOpt;
+
+#define CRYPT_ML_KEM_DK_FORMAT_EXPANDED 0  // The FIPS 203 decapsulation key, decapsKeyLen bytes
+#define CRYPT_ML_KEM_DK_FORMAT_SEED 1  // The 64-byte seed d || z, only for a key generated or set from its seed
+
 CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_NewCtx(void);
 
 CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_NewCtxEx(void *libCtx);
 
+/**
+ * @ingroup mlkem
+ * @brief Create a context of one parameter set in a single 64-byte aligned allocation that also holds the encoded
+ *        and the expanded keys. CRYPT_CTRL_SET_PARA_BY_ID is not needed and not accepted.
+ *
+ * @param libCtx [IN] library context
+ * @param keyType [IN] CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768 or CRYPT_KEM_TYPE_MLKEM_1024
+ *
+ * @retval The context, or NULL on failure.
+ */
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_NewCtxBlock(void *libCtx, int32_t keyType);
+
+/**
+ * @ingroup mlkem
+ * @brief Get the memory size needed by CRYPT_ML_KEM_InitCtxBlock.
+ *
+ * @param keyType [IN] parameter set
+ *
+ * @retval The size in bytes, 0 if keyType is not supported.
+ */
+uint32_t CRYPT_ML_KEM_GetCtxBlockSize(int32_t keyType);
+
+/**
+ * @ingroup mlkem
+ * @brief Create the context of CRYPT_ML_KEM_NewCtxBlock in memory provided by the caller. CRYPT_ML_KEM_FreeCtx
+ *        cleanses the keys, the memory is released by the caller afterwards.
+ *
+ * @param mem [IN] 64-byte aligned memory
+ * @param memLen [IN] length of mem, at least CRYPT_ML_KEM_GetCtxBlockSize(keyType)
+ * @param libCtx [IN] library context
+ * @param keyType [IN] parameter set
+ *
+ * @retval The context, located at mem, or NULL on failure.
+ */
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_InitCtxBlock(void *mem, uint32_t memLen, void *libCtx, int32_t keyType);
+
 void CRYPT_ML_KEM_FreeCtx(CRYPT_ML_KEM_Ctx *ctx);
 
 CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_DupCtx(CRYPT_ML_KEM_Ctx *ctx);
@@ -37,10 +100,46 @@ int32_t CRYPT_ML_KEM_SetEncapsKey(CRYPT_ML_KEM_Ctx *ctx, const CRYPT_KemEncapsKe
 
 int32_t CRYPT_ML_KEM_GetEncapsKey(const CRYPT_ML_KEM_Ctx *ctx, CRYPT_KemEncapsKey *ek);
 
+/**
+ * @ingroup mlkem
+ * @brief Set the decapsulation key, either the expanded dk or the 64-byte seed form d || z of FIPS 203.
+ *        A seed is expanded with ML-KEM.KeyGen_internal, which also sets the encapsulation key.
+ *
+ * @param ctx [IN] mlkem key context structure
+ * @param dk [IN] decapsulation key, of the decapsulation key length or of 64 bytes
+ *
+ * @retval CRYPT_SUCCESS    set success.
+ * Others. For details, see error code in errno.
+ */
 int32_t CRYPT_ML_KEM_SetDecapsKey(CRYPT_ML_KEM_Ctx *ctx, const CRYPT_KemDecapsKey *dk);
 
+/**
+ * @ingroup mlkem
+ * @brief Get the decapsulation key in the format chosen by CRYPT_CTRL_ML_KEM_SET_DK_FORMAT. The expanded dk of a
+ *        key kept as its seed only (CRYPT_ML_KEM_KeepSeedOnly) is rebuilt from the seed.
+ *
+ * @param ctx [IN] mlkem key context structure
+ * @param dk [IN/OUT] decapsulation key buffer, the used length is returned
+ *
+ * @retval CRYPT_SUCCESS    get success.
+ * Others. For details, see error code in errno.
+ */
 int32_t CRYPT_ML_KEM_GetDecapsKey(const CRYPT_ML_KEM_Ctx *ctx, CRYPT_KemDecapsKey *dk);
 
+/**
+ * @ingroup mlkem
+ * @brief Release the expanded decapsulation key and keep only its seed and the encapsulation key resident.
+ *        The next decapsulation or encapsulation rebuilds the key. CRYPT_ML_KEM_GetDecapsKey, CRYPT_ML_KEM_Cmp and
+ *        CRYPT_ML_KEM_Check derive dk from the seed without keeping it. Must not run concurrently with other calls
+ *        on ctx.
+ *
+ * @param ctx [IN] mlkem key context structure, the key was generated or set from its seed
+ *
+ * @retval CRYPT_SUCCESS    success.
+ * Others. For details, see error code in errno.
+ */
+int32_t CRYPT_ML_KEM_KeepSeedOnly(CRYPT_ML_KEM_Ctx *ctx);
+
 #ifdef HITLS_BSL_PARAMS
 int32_t CRYPT_ML_KEM_SetEncapsKeyEx(CRYPT_ML_KEM_Ctx *ctx, const BSL_Param *para);
 
@@ -59,12 +158,345 @@ int32_t CRYPT_ML_KEM_Cmp(const CRYPT_ML_KEM_Ctx *a, const CRYPT_ML_KEM_Ctx *b);
 
 int32_t CRYPT_ML_KEM_GetSecBits(const CRYPT_ML_KEM_Ctx *ctx);
 
+/**
+ * @ingroup mlkem
+ * @brief Encapsulate to the encapsulation key of ctx.
+ *
+ * Thread safety: once the key is set or generated, any number of threads may call CRYPT_ML_KEM_Encaps,
+ * CRYPT_ML_KEM_Decaps and their batch versions on the same context at the same time. The first call expands the
+ * key, the others wait for it and then only read the context. Setting, generating or reducing the key
+ * (CRYPT_ML_KEM_KeepSeedOnly) must not overlap with any other use of the context.
+ *
+ * @param ctx [IN] context holding the encapsulation key
+ * @param cipher [OUT] ciphertext
+ * @param cipherLen [IN/OUT] size of cipher, length of the ciphertext
+ * @param share [OUT] shared secret
+ * @param shareLen [IN/OUT] size of share, length of the shared secret
+ *
+ * @retval CRYPT_SUCCESS, or an error code.
+ */
 int32_t CRYPT_ML_KEM_Encaps(CRYPT_ML_KEM_Ctx *ctx, uint8_t *cipher, uint32_t *cipherLen,
     uint8_t *share, uint32_t *shareLen);
 
+/**
+ * @ingroup mlkem
+ * @brief Decapsulate a ciphertext with the decapsulation key of ctx. Concurrent calls on one context are safe,
+ *        see CRYPT_ML_KEM_Encaps.
+ *
+ * @param ctx [IN] context holding the decapsulation key
+ * @param cipher [IN] ciphertext
+ * @param cipherLen [IN] length of the ciphertext
+ * @param share [OUT] shared secret
+ * @param shareLen [IN/OUT] size of share, length of the shared secret
+ *
+ * @retval CRYPT_SUCCESS, or an error code.
+ */
 int32_t CRYPT_ML_KEM_Decaps(CRYPT_ML_KEM_Ctx *ctx, uint8_t *cipher, uint32_t cipherLen,
     uint8_t *share, uint32_t *shareLen);
 
+/**
+ * @ingroup mlkem
+ * @brief Encapsulate num times to the encapsulation key of ctx. The output is the same as num calls of
+ *        CRYPT_ML_KEM_Encaps, but the matrix and the hashing are shared by the batch.
+ *
+ * @param ctx [IN] mlkem key context structure with an encapsulation key
+ * @param num [IN] number of encapsulations, greater than 0
+ * @param cipher [OUT] num ciphertexts back to back, the i-th one starts at cipher + i * ciphertext length
+ * @param cipherLen [IN/OUT] length of cipher, at least num * ciphertext length, the used length is returned
+ * @param share [OUT] num shared keys back to back, the i-th one starts at share + i * shared key length
+ * @param shareLen [IN/OUT] length of share, at least num * shared key length, the used length is returned
+ *
+ * @retval CRYPT_SUCCESS    encapsulation success.
+ * Others. For details, see error code in errno.
+ */
+int32_t CRYPT_ML_KEM_EncapsBatch(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint8_t *cipher, uint32_t *cipherLen,
+    uint8_t *share, uint32_t *shareLen);
+
+/**
+ * @ingroup mlkem
+ * @brief Decapsulate num ciphertexts with the decapsulation key of ctx. The output is bit-identical to num calls
+ *        of CRYPT_ML_KEM_Decaps, including the implicit rejection of invalid ciphertexts.
+ *
+ * @param ctx [IN] mlkem key context structure with a decapsulation key
+ * @param num [IN] number of ciphertexts, greater than 0
+ * @param cipher [IN] num ciphertexts back to back, the i-th one starts at cipher + i * ciphertext length
+ * @param cipherLen [IN] length of cipher, must be num * ciphertext length
+ * @param share [OUT] num shared keys back to back, the i-th one starts at share + i * shared key length
+ * @param shareLen [IN/OUT] length of share, at least num * shared key length, the used length is returned
+ *
+ * @retval CRYPT_SUCCESS    decapsulation success.
+ * Others. For details, see error code in errno.
+ */
+int32_t CRYPT_ML_KEM_DecapsBatch(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint8_t *cipher, uint32_t cipherLen,
+    uint8_t *share, uint32_t *shareLen);
+
+#ifdef HITLS_CRYPTO_MLKEM_POOL
+
+typedef struct CryptMlKemPool CRYPT_ML_KEM_Pool;
+
+typedef struct {
+    uint32_t lowWater;   // The workers start refilling when fewer keypairs are queued.
+    uint32_t highWater;  // The workers stop refilling when this many keypairs are queued, at most 65536.
+    uint32_t workers;    // Number of refill threads, 1 to 64.
+} CRYPT_ML_KEM_PoolPara;
+
+typedef struct {
+    uint64_t generated;  // Keypairs generated by the workers.
+    uint64_t popped;     // Keypairs handed out from the queue.
+    uint64_t empty;      // Pops that found the queue empty and generated the keypair in the caller.
+    uint64_t genFail;    // Failed generations in the workers.
+    uint64_t discarded;  // Keypairs never handed out and cleansed by CRYPT_ML_KEM_PoolFree.
+    uint32_t available;  // Keypairs queued or being generated.
+} CRYPT_ML_KEM_PoolStat;
+
+/**
+ * @ingroup mlkem
+ * @brief Create a pool of pre-generated keypairs of one parameter set, refilled by background threads.
+ *
+ * @param libCtx [IN] library context used by the generated keys
+ * @param keyType [IN] CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768 or CRYPT_KEM_TYPE_MLKEM_1024
+ * @param para [IN] watermarks and number of worker threads
+ *
+ * @retval The pool, or NULL on failure.
+ */
+CRYPT_ML_KEM_Pool *CRYPT_ML_KEM_PoolNew(void *libCtx, int32_t keyType, const CRYPT_ML_KEM_PoolPara *para);
+
+/**
+ * @ingroup mlkem
+ * @brief Take a context holding a fresh keypair. If the pool is empty the keypair is generated by the caller.
+ *        The context belongs to the caller and is released with CRYPT_ML_KEM_FreeCtx.
+ *
+ * @param pool [IN] keypair pool
+ *
+ * @retval The context, or NULL on failure.
+ */
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_PoolPop(CRYPT_ML_KEM_Pool *pool);
+
+int32_t CRYPT_ML_KEM_PoolGetStat(const CRYPT_ML_KEM_Pool *pool, CRYPT_ML_KEM_PoolStat *stat);
+
+/**
+ * @ingroup mlkem
+ * @brief Stop the worker threads and free the pool, the keypairs still queued are cleansed.
+ *
+ * @param pool [IN] keypair pool
+ */
+void CRYPT_ML_KEM_PoolFree(CRYPT_ML_KEM_Pool *pool);
+
+typedef struct CryptMlKemCtxPool CRYPT_ML_KEM_CtxPool;
+
+/**
+ * @ingroup mlkem
+ * @brief Create a pool of reusable contexts of one parameter set. The pool is lock-free and may be shared by
+ *        any number of threads.
+ *
+ * @param libCtx [IN] library context of the contexts
+ * @param keyType [IN] CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768 or CRYPT_KEM_TYPE_MLKEM_1024
+ * @param maxCached [IN] maximum number of released contexts kept for reuse, 1 to 65536
+ *
+ * @retval The pool, or NULL on failure.
+ */
+CRYPT_ML_KEM_CtxPool *CRYPT_ML_KEM_CtxPoolNew(void *libCtx, int32_t keyType, uint32_t maxCached);
+
+/**
+ * @ingroup mlkem
+ * @brief Take an empty context from the pool, as created by CRYPT_ML_KEM_NewCtxBlock. A new context is allocated
+ *        if no released one is cached.
+ *
+ * @param pool [IN] context pool
+ *
+ * @retval The context, or NULL on failure.
+ */
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_CtxPoolAcquire(CRYPT_ML_KEM_CtxPool *pool);
+
+/**
+ * @ingroup mlkem
+ * @brief Give a context back instead of CRYPT_ML_KEM_FreeCtx. When its last reference is dropped the key is
+ *        cleansed and the memory is kept for the next CRYPT_ML_KEM_CtxPoolAcquire, or freed if the pool is full.
+ *
+ * @param pool [IN] context pool
+ * @param ctx [IN] context from CRYPT_ML_KEM_CtxPoolAcquire or CRYPT_ML_KEM_NewCtxBlock with the same
+ *            library context and parameter set
+ *
+ * @retval CRYPT_SUCCESS, or CRYPT_INVALID_ARG if ctx cannot be kept by this pool.
+ */
+int32_t CRYPT_ML_KEM_CtxPoolRelease(CRYPT_ML_KEM_CtxPool *pool, CRYPT_ML_KEM_Ctx *ctx);
+
+/**
+ * @ingroup mlkem
+ * @brief Free the pool and the cached contexts. Contexts still acquired stay valid and are freed with
+ *        CRYPT_ML_KEM_FreeCtx.
+ *
+ * @param pool [IN] context pool
+ */
+void CRYPT_ML_KEM_CtxPoolFree(CRYPT_ML_KEM_CtxPool *pool);
+
+#endif // HITLS_CRYPTO_MLKEM_POOL
+
+#ifdef HITLS_CRYPTO_MLKEM_KEYRING
+
+#define CRYPT_ML_KEM_KEY_ID_MAX_LEN 32  // Also the length of H(ek)
+
+typedef struct CryptMlKemKeyring CRYPT_ML_KEM_Keyring;
+
+/**
+ * @ingroup mlkem
+ * @brief Create a keyring of decapsulation keys of one parameter set, indexed by a key ID.
+ *        The expanded keys are stored in one allocation made through BSL_SAL_Malloc; register a huge-page aware
+ *        allocator with BSL_SAL to back large keyrings with huge pages.
+ *        Lookups, insertions and removals may run concurrently from any number of threads.
+ *
+ * @param libCtx [IN] library context of the keys
+ * @param keyType [IN] CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768 or CRYPT_KEM_TYPE_MLKEM_1024
+ * @param maxKeys [IN] capacity, 1 to 2^20 keys
+ *
+ * @retval The keyring, or NULL on failure.
+ */
+CRYPT_ML_KEM_Keyring *CRYPT_ML_KEM_KeyringNew(void *libCtx, int32_t keyType, uint32_t maxKeys);
+
+/**
+ * @ingroup mlkem
+ * @brief Import and expand a decapsulation key, then make it visible to lookups under its ID. Of concurrent
+ *        insertions of one ID, at most one succeeds.
+ *
+ * @param ring [IN] keyring
+ * @param id [IN] key ID of 1 to CRYPT_ML_KEM_KEY_ID_MAX_LEN bytes, or NULL to use H(ek) of the key
+ * @param idLen [IN] length of id
+ * @param dk [IN] decapsulation key, encoded or in seed form
+ *
+ * @retval CRYPT_SUCCESS
+ * @retval CRYPT_MLKEM_KEY_REPEATED_SET if a key with this ID is present
+ * @retval CRYPT_MLKEM_LEN_NOT_ENOUGH if the keyring is full
+ */
+int32_t CRYPT_ML_KEM_KeyringInsert(CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen,
+    const CRYPT_KemDecapsKey *dk);
+
+/**
+ * @ingroup mlkem
+ * @brief Remove a key. Waits for the decapsulations already using it, then cleanses it.
+ *
+ * @retval CRYPT_SUCCESS, or CRYPT_MLKEM_KEY_NOT_SET if no key has this ID.
+ */
+int32_t CRYPT_ML_KEM_KeyringRemove(CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen);
+
+/**
+ * @ingroup mlkem
+ * @brief Decapsulate with the key of the given ID, as CRYPT_ML_KEM_Decaps.
+ *
+ * @retval CRYPT_SUCCESS, CRYPT_MLKEM_KEY_NOT_SET if no key has this ID, or an error of CRYPT_ML_KEM_Decaps.
+ */
+int32_t CRYPT_ML_KEM_KeyringDecaps(CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen,
+    uint8_t *cipher, uint32_t cipherLen, uint8_t *share, uint32_t *shareLen);
+
+/**
+ * @ingroup mlkem
+ * @brief Cleanse the keys and free the keyring. No other call on the keyring may be running.
+ */
+void CRYPT_ML_KEM_KeyringFree(CRYPT_ML_KEM_Keyring *ring);
+
+#endif // HITLS_CRYPTO_MLKEM_KEYRING
+
+#ifdef HITLS_CRYPTO_MLKEM_EKCACHE
+
+typedef struct CryptMlKemEkCache CRYPT_ML_KEM_EkCache;
+
+typedef struct {
+    uint64_t hits;       // Gets answered from the cache.
+    uint64_t misses;     // Gets that expanded the key.
+    uint64_t evictions;  // Keys dropped to stay under the memory cap.
+    uint32_t entries;    // Keys in the cache.
+    uint64_t bytes;      // Memory of the cached keys, counted against the cap.
+} CRYPT_ML_KEM_EkCacheStat;
+
+/**
+ * @ingroup mlkem
+ * @brief Create a thread-safe LRU cache of expanded encapsulation keys of one parameter set. The cache looks the
+ *        keys up with a hash keyed by random bytes of libCtx, so peers cannot choose keys that collide.
+ *
+ * @param libCtx [IN] library context of the keys and of the random hash key
+ * @param keyType [IN] CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768 or CRYPT_KEM_TYPE_MLKEM_1024
+ * @param maxBytes [IN] memory cap of the cached keys, at least one key
+ *
+ * @retval The cache, or NULL on failure.
+ */
+CRYPT_ML_KEM_EkCache *CRYPT_ML_KEM_EkCacheNew(void *libCtx, int32_t keyType, uint64_t maxBytes);
+
+/**
+ * @ingroup mlkem
+ * @brief Get a context holding the expanded encapsulation key ek, from the cache or newly expanded and cached.
+ *        The context is shared with the cache and other callers: it may only be used for encapsulation, which is
+ *        safe from any number of threads, and is released with CRYPT_ML_KEM_FreeCtx. It stays valid when the key
+ *        is evicted.
+ *
+ * @param cache [IN] encapsulation key cache
+ * @param ek [IN] encoded encapsulation key
+ *
+ * @retval The context, or NULL on failure.
+ */
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_EkCacheGet(CRYPT_ML_KEM_EkCache *cache, const CRYPT_KemEncapsKey *ek);
+
+int32_t CRYPT_ML_KEM_EkCacheGetStat(const CRYPT_ML_KEM_EkCache *cache, CRYPT_ML_KEM_EkCacheStat *stat);
+
+/**
+ * @ingroup mlkem
+ * @brief Free the cache. Contexts still held by callers stay valid.
+ *
+ * @param cache [IN] encapsulation key cache
+ */
+void CRYPT_ML_KEM_EkCacheFree(CRYPT_ML_KEM_EkCache *cache);
+
+#endif // HITLS_CRYPTO_MLKEM_EKCACHE
+
+#ifdef HITLS_CRYPTO_MLKEM_EXPANDED_KEY
+
+/**
+ * @ingroup mlkem
+ * @brief Get the length of the expanded key image of ctx.
+ *
+ * @param ctx [IN] mlkem key context structure
+ * @param len [OUT] length of the image
+ *
+ * @retval CRYPT_SUCCESS    succeeded.
+ * Others. For details, see error code in errno.
+ */
+int32_t CRYPT_ML_KEM_GetExpandedKeyLen(const CRYPT_ML_KEM_Ctx *ctx, uint32_t *len);
+
+/**
+ * @ingroup mlkem
+ * @brief Export the key of ctx as an expanded key image: a versioned, checksummed header, the NTT-domain
+ *        polynomials of the key and the encoded ek or dk, each region 64-byte aligned. The polynomials are stored
+ *        in host byte order, an image is only loaded on hosts of the same byte order.
+ *
+ * @param ctx [IN] mlkem key context structure, the key is expanded first if needed
+ * @param out [OUT] image, 64-byte aligned if it is to be loaded in place
+ * @param outLen [IN/OUT] length of out, set to the length of the image
+ *
+ * @retval CRYPT_SUCCESS    succeeded.
+ * Others. For details, see error code in errno.
+ */
+int32_t CRYPT_ML_KEM_ExportExpandedKey(CRYPT_ML_KEM_Ctx *ctx, uint8_t *out, uint32_t *outLen);
+
+/**
+ * @ingroup mlkem
+ * @brief Create a context that uses an expanded key image in place, e.g. a read-only file mapping, without
+ *        expanding or copying the key. The header and checksum are verified once, and H(ek) is recomputed and
+ *        checked against the header and, for a private key, against dk. Every coefficient of the expanded
+ *        polynomials is checked to be in (-q, q), so that a forged image cannot overflow the products. Beyond that
+ *        they are only covered by the checksum, which detects corruption, not tampering: the image must come from a
+ *        trusted source.
+ *        The image must stay valid and unchanged until the context is freed, and is never written by the context.
+ *        CRYPT_CTRL_CLEAN_PUB_KEY and CRYPT_ML_KEM_GenKey detach the context from the image: it goes on as an
+ *        ordinary context, with a copy of dk after CRYPT_CTRL_CLEAN_PUB_KEY, and a new key can be set.
+ *
+ * @param libCtx [IN] library context
+ * @param image [IN] image written by CRYPT_ML_KEM_ExportExpandedKey, 64-byte aligned
+ * @param imageLen [IN] length of image
+ *
+ * @retval The context, or NULL on failure.
+ */
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_NewCtxFromExpandedKey(void *libCtx, const uint8_t *image, uint32_t imageLen);
+
+#endif // HITLS_CRYPTO_MLKEM_EXPANDED_KEY
+
 #ifdef HITLS_CRYPTO_MLKEM_CHECK
 
 /**
@@ -32,7 +32,7 @@ static const CRYPT_MlKemInfo ML_KEM_INFO[] = {
     {4, 2, 2, 11, 5, 256, 1568, 3168, 1568, 32, 1024}
 };
 
-static const CRYPT_MlKemInfo *MlKemGetInfo(uint32_t bits)
+const CRYPT_MlKemInfo *MLKEM_GetInfoByBits(uint32_t bits)
 {
     for (uint32_t i = 0; i < sizeof(ML_KEM_INFO) / sizeof(ML_KEM_INFO[0]); i++) {
         if (ML_KEM_INFO[i].bits == bits) {
@@ -41,17 +41,92 @@ static const CRYPT_MlKemInfo *MlKemGetInfo(uint32_t bits)
     }
     return NULL;
 }
+
+const CRYPT_MlKemInfo *MLKEM_GetInfoByType(int32_t keyType)
+{
+    uint32_t bits = 0;
+    if (keyType == CRYPT_KEM_TYPE_MLKEM_512) {
+        bits = 512;  // MLKEM512
+    } else if (keyType == CRYPT_KEM_TYPE_MLKEM_768) {
+        bits = 768;  // MLKEM768
+    } else if (keyType == CRYPT_KEM_TYPE_MLKEM_1024) {
+        bits = 1024;  // MLKEM1024
+    }
+    return MLKEM_GetInfoByBits(bits);
+}
+
+// ek and dk of a single-allocation context are stored in its block, otherwise they are allocated.
+static uint8_t *MlKemKeyBufNew(CRYPT_ML_KEM_Ctx *ctx, bool isDk, const uint8_t *src, uint32_t len)
+{
+    uint8_t *buf = isDk ? ctx->blockDk : ctx->blockEk;
+    if (buf == NULL) {
+        return (src == NULL) ? BSL_SAL_Malloc(len) : BSL_SAL_Dump(src, len);
+    }
+    if (src != NULL) {
+        (void)memcpy_s(buf, len, src, len);
+    }
+    return buf;
+}
+
+static void MlKemKeyBufFree(CRYPT_ML_KEM_Ctx *ctx, uint8_t **buf)
+{
+    if (*buf != ctx->blockEk && *buf != ctx->blockDk) {
+        BSL_SAL_Free(*buf);
+    }
+    *buf = NULL;
+}
+
+// Drops the expanded key, the next operation expands the key that is set now.
+static void MlKemDropExpandedKey(CRYPT_ML_KEM_Ctx *ctx)
+{
+    MLKEM_FreeMatrixBuf(ctx->info->k, &ctx->keyData);
+    (void)memset_s(ctx->ekHash, sizeof(ctx->ekHash), 0, sizeof(ctx->ekHash));
+    ctx->dkVerified = false;
+    ctx->expandState = MLKEM_KEY_NOT_EXPANDED;
+}
+
+/*
+ * A mapped context goes on as a heap context. Its key and expanded key are in the read-only image of the caller and
+ * are dropped without being written to, keepDk copies dk out of the image first. The next operation expands dk again.
+ */
+static int32_t MlKemDetachMapped(CRYPT_ML_KEM_Ctx *ctx, bool keepDk)
+{
+    uint8_t *dk = NULL;
+    if (keepDk && ctx->dk != NULL) {
+        dk = BSL_SAL_Dump(ctx->dk, ctx->dkLen);
+        if (dk == NULL) {
+            BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+            return CRYPT_MEM_ALLOC_FAIL;
+        }
+    }
+    ctx->dk = dk;
+    ctx->dkLen = (dk != NULL) ? ctx->dkLen : 0;
+    ctx->ek = NULL;
+    ctx->ekLen = 0;
+    ctx->blockEk = NULL;
+    ctx->blockDk = NULL;
+    bool noMatrix = ctx->keyData.noMatrix;
+    (void)memset_s(&ctx->keyData, sizeof(ctx->keyData), 0, sizeof(ctx->keyData));
+    ctx->keyData.noMatrix = noMatrix;
+    ctx->layout = MLKEM_LAYOUT_HEAP;
+    MlKemDropExpandedKey(ctx);
+    return CRYPT_SUCCESS;
+}
+
 static void MLKEM_KeyReset(CRYPT_ML_KEM_Ctx *ctx)
 {
     if (ctx->info == NULL) {
         return;
     }
-    uint8_t k = ctx->info->k;
+    if (ctx->layout == MLKEM_LAYOUT_MAPPED) {
+        (void)MlKemDetachMapped(ctx, false);
+    }
     BSL_SAL_CleanseData(ctx->dk, ctx->dkLen);
-    BSL_SAL_CleanseData(ctx->keyData.bufAddr, (k * k + 3 * k) * MLKEM_N * sizeof(int16_t));
-    BSL_SAL_FREE(ctx->dk);
-    BSL_SAL_FREE(ctx->ek);
-    BSL_SAL_FREE(ctx->keyData.bufAddr);
+    MlKemKeyBufFree(ctx, &ctx->dk);
+    MlKemKeyBufFree(ctx, &ctx->ek);
+    MlKemDropExpandedKey(ctx);
+    BSL_SAL_CleanseData(ctx->seed, sizeof(ctx->seed));
+    ctx->hasSeed = false;
 }
 
 CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_NewCtx(void)
@@ -86,12 +161,102 @@ void CRYPT_ML_KEM_FreeCtx(CRYPT_ML_KEM_Ctx *ctx)
     if (ret > 0) {
         return;
     }
-    BSL_SAL_CleanseData(ctx->dk, ctx->dkLen);
-    BSL_SAL_FREE(ctx->dk);
-    BSL_SAL_FREE(ctx->ek);
-    BSL_SAL_FREE(ctx->keyData.bufAddr);
+    MLKEM_KeyReset(ctx);
+    BSL_SAL_ReferencesFree(&(ctx->references));
+    if (ctx->layout == MLKEM_LAYOUT_HEAP) {
+        BSL_SAL_FREE(ctx);
+    } else if (ctx->layout == MLKEM_LAYOUT_BLOCK) {
+        BSL_SAL_Free(ctx->blockAddr);
+    }
+    // The memory of an MLKEM_LAYOUT_CALLER context belongs to the caller.
+}
+
+/*
+ * Single-allocation layout: ctx || matrix and vectorT || vectorS || ek || dk. The polynomial regions are multiples
+ * of 512 bytes, so every region after the 64-byte aligned ctx header is 64-byte aligned as well.
+ */
+#define MLKEM_BLOCK_ALIGN 64
+#define MLKEM_ALIGN_UP(x) (((x) + MLKEM_BLOCK_ALIGN - 1) & ~((uint32_t)MLKEM_BLOCK_ALIGN - 1))
+
+static uint32_t MlKemBlockSize(const CRYPT_MlKemInfo *info)
+{
+    uint32_t k = info->k;
+    uint32_t polys = k * k + k + MLKEM_SECRET_POLYS(k);
+    return MLKEM_ALIGN_UP(sizeof(CRYPT_ML_KEM_Ctx)) + polys * MLKEM_N * sizeof(int16_t) +
+        MLKEM_ALIGN_UP(info->encapsKeyLen) + info->decapsKeyLen;
+}
+
+static CRYPT_ML_KEM_Ctx *MlKemBlockInit(uint8_t *mem, void *blockAddr, void *libCtx, const CRYPT_MlKemInfo *info)
+{
+    CRYPT_ML_KEM_Ctx *ctx = (CRYPT_ML_KEM_Ctx *)mem;
+    (void)memset_s(ctx, sizeof(CRYPT_ML_KEM_Ctx), 0, sizeof(CRYPT_ML_KEM_Ctx));
+    BSL_SAL_ReferencesInit(&(ctx->references));
+    ctx->info = info;
+    ctx->libCtx = libCtx;
+    ctx->blockAddr = blockAddr;
+    ctx->layout = (blockAddr != NULL) ? MLKEM_LAYOUT_BLOCK : MLKEM_LAYOUT_CALLER;
+    uint8_t k = info->k;
+    uint8_t *p = mem + MLKEM_ALIGN_UP(sizeof(CRYPT_ML_KEM_Ctx));
+    ctx->keyData.blockPub = (int16_t *)p;
+    p += (k * k + k) * MLKEM_N * sizeof(int16_t);
+    ctx->keyData.blockSecret = (int16_t *)p;
+    p += MLKEM_SECRET_POLYS(k) * MLKEM_N * sizeof(int16_t);
+    ctx->blockEk = p;
+    ctx->blockDk = p + MLKEM_ALIGN_UP(info->encapsKeyLen);
+    return ctx;
+}
+
+static CRYPT_ML_KEM_Ctx *MlKemNewBlock(void *libCtx, const CRYPT_MlKemInfo *info)
+{
+    uint8_t *addr = BSL_SAL_Malloc(MlKemBlockSize(info) + MLKEM_BLOCK_ALIGN - 1);
+    if (addr == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return NULL;
+    }
+    uintptr_t pad = (MLKEM_BLOCK_ALIGN - (uintptr_t)addr % MLKEM_BLOCK_ALIGN) % MLKEM_BLOCK_ALIGN;
+    return MlKemBlockInit(addr + pad, addr, libCtx, info);
+}
+
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_NewCtxBlock(void *libCtx, int32_t keyType)
+{
+    const CRYPT_MlKemInfo *info = MLKEM_GetInfoByType(keyType);
+    if (info == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NOT_SUPPORT);
+        return NULL;
+    }
+    return MlKemNewBlock(libCtx, info);
+}
+
+uint32_t CRYPT_ML_KEM_GetCtxBlockSize(int32_t keyType)
+{
+    const CRYPT_MlKemInfo *info = MLKEM_GetInfoByType(keyType);
+    return (info == NULL) ? 0 : MlKemBlockSize(info);
+}
+
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_InitCtxBlock(void *mem, uint32_t memLen, void *libCtx, int32_t keyType)
+{
+    if (mem == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return NULL;
+    }
+    const CRYPT_MlKemInfo *info = MLKEM_GetInfoByType(keyType);
+    if (info == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NOT_SUPPORT);
+        return NULL;
+    }
+    if ((uintptr_t)mem % MLKEM_BLOCK_ALIGN != 0 || memLen < MlKemBlockSize(info)) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return NULL;
+    }
+    return MlKemBlockInit(mem, NULL, libCtx, info);
+}
+
+// Cleanses the key of an MLKEM_LAYOUT_BLOCK context whose last reference was dropped and makes it a new context.
+void MLKEM_CtxRecycle(CRYPT_ML_KEM_Ctx *ctx)
+{
+    MLKEM_KeyReset(ctx);
     BSL_SAL_ReferencesFree(&(ctx->references));
-    BSL_SAL_FREE(ctx);
+    (void)MlKemBlockInit((uint8_t *)ctx, ctx->blockAddr, ctx->libCtx, ctx->info);
 }
 
 static int32_t MlKemSetAlgInfo(CRYPT_ML_KEM_Ctx *ctx, void *val, uint32_t len)
@@ -104,16 +269,7 @@ static int32_t MlKemSetAlgInfo(CRYPT_ML_KEM_Ctx *ctx, void *val, uint32_t len)
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_CTRL_INIT_REPEATED);
         return CRYPT_MLKEM_CTRL_INIT_REPEATED;
     }
-    uint32_t bits = 0;
-    int32_t keyType = *(int32_t*)val;
-    if (keyType == CRYPT_KEM_TYPE_MLKEM_512) {
-        bits = 512;  // MLKEM512
-    } else if (keyType == CRYPT_KEM_TYPE_MLKEM_768) {
-        bits = 768;  // MLKEM768
-    } else if (keyType == CRYPT_KEM_TYPE_MLKEM_1024) {
-        bits = 1024;  // MLKEM1024
-    }
-    const CRYPT_MlKemInfo *info = MlKemGetInfo(bits);
+    const CRYPT_MlKemInfo *info = MLKEM_GetInfoByType(*(int32_t *)val);
     if (info == NULL) {
         BSL_ERR_PUSH_ERROR(CRYPT_NOT_SUPPORT);
         return CRYPT_NOT_SUPPORT;
@@ -122,34 +278,15 @@ static int32_t MlKemSetAlgInfo(CRYPT_ML_KEM_Ctx *ctx, void *val, uint32_t len)
     return CRYPT_SUCCESS;
 }
 
-static int32_t MlKemDupKeyData(CRYPT_ML_KEM_Ctx *ctx, CRYPT_ML_KEM_Ctx *newCtx)
-{
-    int32_t ret = MLKEM_CreateMatrixBuf(ctx->info->k, &newCtx->keyData);
-    if (ret != CRYPT_SUCCESS) {
-        return ret;
-    }
-    for (uint8_t i = 0; i < ctx->info->k; i++) {
-        for (uint8_t j = 0; j < ctx->info->k; j++) {
-            (void)memcpy_s(newCtx->keyData.matrix[i][j], MLKEM_N * sizeof(int16_t), ctx->keyData.matrix[i][j],
-                MLKEM_N * sizeof(int16_t));
-        }
-        (void)memcpy_s(newCtx->keyData.vectorS[i], MLKEM_N * sizeof(int16_t), ctx->keyData.vectorS[i],
-            MLKEM_N * sizeof(int16_t));
-        (void)memcpy_s(newCtx->keyData.vectorE[i], MLKEM_N * sizeof(int16_t), ctx->keyData.vectorE[i],
-            MLKEM_N * sizeof(int16_t));
-        (void)memcpy_s(newCtx->keyData.vectorT[i], MLKEM_N * sizeof(int16_t), ctx->keyData.vectorT[i],
-            MLKEM_N * sizeof(int16_t));
-    }
-    return CRYPT_SUCCESS;
-}
-
 CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_DupCtx(CRYPT_ML_KEM_Ctx *ctx)
 {
     if (ctx == NULL) {
         BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
         return NULL;
     }
-    CRYPT_ML_KEM_Ctx *newCtx = CRYPT_ML_KEM_NewCtx();
+    // The copy of a single-allocation context is a single allocation as well.
+    CRYPT_ML_KEM_Ctx *newCtx = (ctx->layout == MLKEM_LAYOUT_HEAP || ctx->layout == MLKEM_LAYOUT_MAPPED) ?
+        CRYPT_ML_KEM_NewCtx() : MlKemNewBlock(ctx->libCtx, ctx->info);
     if (newCtx == NULL) {
         BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
         return NULL;
@@ -157,8 +294,11 @@ CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_DupCtx(CRYPT_ML_KEM_Ctx *ctx)
     if (ctx->info != NULL) {
         newCtx->info = ctx->info;
     }
+    newCtx->keyData.noMatrix = ctx->keyData.noMatrix;
+    newCtx->keyData.mulCache = ctx->keyData.mulCache;
+    newCtx->dkFormat = ctx->dkFormat;
     if (ctx->ek != NULL) {
-        newCtx->ek = BSL_SAL_Dump(ctx->ek, ctx->ekLen);
+        newCtx->ek = MlKemKeyBufNew(newCtx, false, ctx->ek, ctx->ekLen);
         if (newCtx->ek == NULL) {
             CRYPT_ML_KEM_FreeCtx(newCtx);
             return NULL;
@@ -166,16 +306,27 @@ CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_DupCtx(CRYPT_ML_KEM_Ctx *ctx)
         newCtx->ekLen = ctx->ekLen;
     }
     if (ctx->dk != NULL) {
-        newCtx->dk = BSL_SAL_Dump(ctx->dk, ctx->dkLen);
+        newCtx->dk = MlKemKeyBufNew(newCtx, true, ctx->dk, ctx->dkLen);
         if (newCtx->dk == NULL) {
             CRYPT_ML_KEM_FreeCtx(newCtx);
             return NULL;
         }
         newCtx->dkLen = ctx->dkLen;
     }
-    if (MlKemDupKeyData(ctx, newCtx) != CRYPT_SUCCESS) {
-        CRYPT_ML_KEM_FreeCtx(newCtx);
-        return NULL;
+    if (ctx->hasSeed) {
+        (void)memcpy_s(newCtx->seed, sizeof(newCtx->seed), ctx->seed, sizeof(ctx->seed));
+        newCtx->hasSeed = true;
+    }
+    // The expanded key is immutable and shared with the copy. A key that is not expanded yet is expanded by the
+    // first operation on the copy.
+    if (__atomic_load_n(&ctx->expandState, __ATOMIC_ACQUIRE) == MLKEM_KEY_EXPANDED) {
+        if (MLKEM_CopyMatrixBuf(ctx->info->k, &ctx->keyData, &newCtx->keyData) != CRYPT_SUCCESS) {
+            CRYPT_ML_KEM_FreeCtx(newCtx);
+            return NULL;
+        }
+        (void)memcpy_s(newCtx->ekHash, sizeof(newCtx->ekHash), ctx->ekHash, sizeof(ctx->ekHash));
+        newCtx->dkVerified = ctx->dkVerified;
+        newCtx->expandState = MLKEM_KEY_EXPANDED;
     }
 
     newCtx->libCtx = ctx->libCtx;
@@ -206,7 +357,7 @@ static int32_t MlKemGetDecapsKeyLen(CRYPT_ML_KEM_Ctx *ctx, void *val, uint32_t l
         BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
         return CRYPT_INVALID_ARG;
     }
-    *(uint32_t*)val = ctx->info->decapsKeyLen;
+    *(uint32_t*)val = (ctx->dkFormat == CRYPT_ML_KEM_DK_FORMAT_SEED) ? MLKEM_DK_SEED_LEN : ctx->info->decapsKeyLen;
     return CRYPT_SUCCESS;
 }
 
@@ -252,21 +403,15 @@ int32_t CRYPT_ML_KEM_SetEncapsKey(CRYPT_ML_KEM_Ctx *ctx, const CRYPT_KemEncapsKe
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_REPEATED_SET);
         return CRYPT_MLKEM_KEY_REPEATED_SET;
     }
-    int32_t ret =  MLKEM_DecodeEk(ctx, ek->data, ek->len);
-    if (ret != CRYPT_SUCCESS) {
-        MLKEM_KeyReset(ctx);
-        BSL_ERR_PUSH_ERROR(ret);
-        return ret;
-    }
-    uint8_t *data = BSL_SAL_Dump(ek->data, ek->len);
+    // Only the modulus check runs here, the matrix is expanded by the first encapsulation.
+    int32_t ret = MLKEM_CheckBits12(ek->data, ctx->info->k);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    MlKemDropExpandedKey(ctx);  // Left by a key whose ek was cleaned
+    uint8_t *data = MlKemKeyBufNew(ctx, false, ek->data, ek->len);
     if (data == NULL) {
-        MLKEM_KeyReset(ctx);
         BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
         return CRYPT_MEM_ALLOC_FAIL;
     }
-    if (ctx->ek != NULL) {
-        BSL_SAL_Free(ctx->ek);
-    }
     ctx->ek = data;
     ctx->ekLen = ek->len;
     return CRYPT_SUCCESS;
@@ -297,7 +442,7 @@ int32_t CRYPT_ML_KEM_SetDecapsKey(CRYPT_ML_KEM_Ctx *ctx, const CRYPT_KemDecapsKe
         BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
         return CRYPT_NULL_INPUT;
     }
-    if (dk->len != ctx->info->decapsKeyLen) {
+    if (dk->len != ctx->info->decapsKeyLen && dk->len != MLKEM_DK_SEED_LEN) {
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEYLEN_ERROR);
         return CRYPT_MLKEM_KEYLEN_ERROR;
     }
@@ -305,44 +450,106 @@ int32_t CRYPT_ML_KEM_SetDecapsKey(CRYPT_ML_KEM_Ctx *ctx, const CRYPT_KemDecapsKe
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_REPEATED_SET);
         return CRYPT_MLKEM_KEY_REPEATED_SET;
     }
-    int32_t ret = MLKEM_DecodeDk(ctx, dk->data, dk->len);
-    if (ret != CRYPT_SUCCESS) {
-        MLKEM_KeyReset(ctx);
-        BSL_ERR_PUSH_ERROR(ret);
-        return ret;
+    MlKemDropExpandedKey(ctx);  // Left by a key whose ek was cleaned
+    if (dk->len == MLKEM_DK_SEED_LEN) {
+        // Seed form d || z: the key is rebuilt by ML-KEM.KeyGen_internal right away.
+        (void)memcpy_s(ctx->seed, sizeof(ctx->seed), dk->data, dk->len);
+        ctx->hasSeed = true;
+        int32_t ret = MLKEM_ExpandSeed(ctx);
+        if (ret != CRYPT_SUCCESS) {
+            MLKEM_KeyReset(ctx);
+            return ret;
+        }
+        __atomic_store_n(&ctx->expandState, MLKEM_KEY_EXPANDED, __ATOMIC_RELEASE);
+        return CRYPT_SUCCESS;
     }
-    uint8_t *data = BSL_SAL_Dump(dk->data, dk->len);
+    // Only the modulus checks of s and ek run here, the key is expanded and h is checked by the first decapsulation.
+    uint8_t k = ctx->info->k;
+    int32_t ret = MLKEM_CheckBits12(dk->data, k);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    ret = MLKEM_CheckBits12(dk->data + MLKEM_CIPHER_LEN * k, k);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    uint8_t *data = MlKemKeyBufNew(ctx, true, dk->data, dk->len);
     if (data == NULL) {
-        MLKEM_KeyReset(ctx);
         BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
         return CRYPT_MEM_ALLOC_FAIL;
     }
-    if (ctx->dk != NULL) {
-        BSL_SAL_CleanseData(ctx->dk, ctx->dkLen);
-        BSL_SAL_Free(ctx->dk);
-    }
     ctx->dk = data;
     ctx->dkLen = dk->len;
     return CRYPT_SUCCESS;
 }
 
-int32_t CRYPT_ML_KEM_GetDecapsKey(const CRYPT_ML_KEM_Ctx *ctx, CRYPT_KemDecapsKey *dk)
+/*
+ * Points *dk at the decapsulation key of ctx, NULL if it has none. A key that is not expanded and has a seed may have
+ * no dk, or get one from a concurrent expansion: its dk is derived from the seed into buf (decapsKeyLen bytes)
+ * without touching ctx.
+ */
+static int32_t MlKemDkOf(const CRYPT_ML_KEM_Ctx *ctx, uint8_t *buf, const uint8_t **dk, uint32_t *dkLen)
 {
-    if (ctx == NULL || ctx->info == NULL || dk == NULL || dk->data == NULL) {
-        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
-        return CRYPT_NULL_INPUT;
+    if (__atomic_load_n(&ctx->expandState, __ATOMIC_ACQUIRE) == MLKEM_KEY_EXPANDED || !ctx->hasSeed) {
+        *dk = ctx->dk;
+        *dkLen = ctx->dkLen;
+        return CRYPT_SUCCESS;
     }
+    CRYPT_ML_KEM_Ctx *tmp = CRYPT_ML_KEM_NewCtxEx(ctx->libCtx);
+    if (tmp == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return CRYPT_MEM_ALLOC_FAIL;
+    }
+    tmp->info = ctx->info;
+    tmp->keyData.noMatrix = true;
+    (void)memcpy_s(tmp->seed, sizeof(tmp->seed), ctx->seed, sizeof(ctx->seed));
+    tmp->hasSeed = true;
+    int32_t ret = MLKEM_ExpandSeed(tmp);
+    if (ret == CRYPT_SUCCESS) {
+        (void)memcpy_s(buf, ctx->info->decapsKeyLen, tmp->dk, tmp->dkLen);
+        *dk = buf;
+        *dkLen = tmp->dkLen;
+    }
+    CRYPT_ML_KEM_FreeCtx(tmp);
+    return ret;
+}
 
-    if (ctx->dk == NULL) {
+static int32_t MlKemGetDkSeed(const CRYPT_ML_KEM_Ctx *ctx, CRYPT_KemDecapsKey *dk)
+{
+    if (!ctx->hasSeed) {
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_NOT_SET);
         return CRYPT_MLKEM_KEY_NOT_SET;
     }
+    if (dk->len < sizeof(ctx->seed)) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_LEN_NOT_ENOUGH);
+        return CRYPT_MLKEM_LEN_NOT_ENOUGH;
+    }
+    (void)memcpy_s(dk->data, dk->len, ctx->seed, sizeof(ctx->seed));
+    dk->len = sizeof(ctx->seed);
+    return CRYPT_SUCCESS;
+}
 
-    if (memcpy_s(dk->data, dk->len, ctx->dk, ctx->dkLen) != EOK) {
+int32_t CRYPT_ML_KEM_GetDecapsKey(const CRYPT_ML_KEM_Ctx *ctx, CRYPT_KemDecapsKey *dk)
+{
+    if (ctx == NULL || ctx->info == NULL || dk == NULL || dk->data == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return CRYPT_NULL_INPUT;
+    }
+    if (ctx->dkFormat == CRYPT_ML_KEM_DK_FORMAT_SEED) {
+        return MlKemGetDkSeed(ctx, dk);
+    }
+    if (dk->len < ctx->info->decapsKeyLen) {
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEYLEN_ERROR);
         return CRYPT_MLKEM_KEYLEN_ERROR;
     }
-    dk->len = ctx->dkLen;
+    const uint8_t *key = NULL;
+    uint32_t keyLen = 0;
+    int32_t ret = MlKemDkOf(ctx, dk->data, &key, &keyLen);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    if (key == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_NOT_SET);
+        return CRYPT_MLKEM_KEY_NOT_SET;
+    }
+    if (key != dk->data) {
+        (void)memcpy_s(dk->data, dk->len, key, keyLen);
+    }
+    dk->len = keyLen;
     return CRYPT_SUCCESS;
 }
 
@@ -403,7 +610,7 @@ int32_t CRYPT_ML_KEM_GetDecapsKeyEx(const CRYPT_ML_KEM_Ctx *ctx, BSL_Param *para
 #endif
 
 #ifdef HITLS_CRYPTO_MLKEM_CMP
-static int32_t MlKemCmpKey(uint8_t *a, uint32_t aLen, uint8_t *b, uint32_t bLen)
+static int32_t MlKemCmpKey(const uint8_t *a, uint32_t aLen, const uint8_t *b, uint32_t bLen)
 {
     if (aLen != bLen) {
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_NOT_EQUAL);
@@ -422,6 +629,33 @@ static int32_t MlKemCmpKey(uint8_t *a, uint32_t aLen, uint8_t *b, uint32_t bLen)
     return CRYPT_SUCCESS;
 }
 
+// A key kept as its seed only is compared through the dk derived from its seed.
+static int32_t MlKemCmpDk(const CRYPT_ML_KEM_Ctx *a, const CRYPT_ML_KEM_Ctx *b)
+{
+    if (a->info == NULL) {
+        return MlKemCmpKey(a->dk, a->dkLen, b->dk, b->dkLen);
+    }
+    uint32_t bufLen = a->info->decapsKeyLen;
+    uint8_t *buf = BSL_SAL_Malloc(bufLen * 2);
+    if (buf == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return CRYPT_MEM_ALLOC_FAIL;
+    }
+    const uint8_t *dkA = NULL;
+    const uint8_t *dkB = NULL;
+    uint32_t dkLenA = 0;
+    uint32_t dkLenB = 0;
+    int32_t ret = MlKemDkOf(a, buf, &dkA, &dkLenA);
+    if (ret == CRYPT_SUCCESS) {
+        ret = MlKemDkOf(b, buf + bufLen, &dkB, &dkLenB);
+    }
+    if (ret == CRYPT_SUCCESS) {
+        ret = MlKemCmpKey(dkA, dkLenA, dkB, dkLenB);
+    }
+    BSL_SAL_ClearFree(buf, bufLen * 2);
+    return ret;
+}
+
 int32_t CRYPT_ML_KEM_Cmp(const CRYPT_ML_KEM_Ctx *a, const CRYPT_ML_KEM_Ctx *b)
 {
     if (a == NULL || b == NULL) {
@@ -436,10 +670,10 @@ int32_t CRYPT_ML_KEM_Cmp(const CRYPT_ML_KEM_Ctx *a, const CRYPT_ML_KEM_Ctx *b)
     if (MlKemCmpKey(a->ek, a->ekLen, b->ek, b->ekLen) != CRYPT_SUCCESS) {
         return CRYPT_MLKEM_KEY_NOT_EQUAL;
     }
-    if (MlKemCmpKey(a->dk, a->dkLen, b->dk, b->dkLen) != CRYPT_SUCCESS) {
-        return CRYPT_MLKEM_KEY_NOT_EQUAL;
+    if (a->hasSeed && b->hasSeed) {  // Equal seeds give equal keys, and equal dk hold the same z.
+        return MlKemCmpKey(a->seed, sizeof(a->seed), b->seed, sizeof(b->seed));
     }
-    return CRYPT_SUCCESS;
+    return MlKemCmpDk(a, b);
 }
 #endif
 
@@ -453,11 +687,61 @@ int32_t CRYPT_ML_KEM_GetSecBits(const CRYPT_ML_KEM_Ctx *ctx)
 
 static int32_t MlKemCleanPubKey(CRYPT_ML_KEM_Ctx *ctx)
 {
+    if (ctx->layout == MLKEM_LAYOUT_MAPPED) {
+        return MlKemDetachMapped(ctx, true);  // ek stays in the image, dk is kept.
+    }
     if (ctx->ek != NULL) {
         BSL_SAL_CleanseData(ctx->ek, ctx->ekLen);
-        BSL_SAL_FREE(ctx->ek);
+        MlKemKeyBufFree(ctx, &ctx->ek);
         ctx->ekLen = 0;
+        // The expanded key and H(ek) belong to the cleaned ek, a dk left in the context is expanded again.
+        MlKemDropExpandedKey(ctx);
+    }
+    return CRYPT_SUCCESS;
+}
+
+static int32_t MlKemSetNoMatrix(CRYPT_ML_KEM_Ctx *ctx, void *val, uint32_t len)
+{
+    if (len != sizeof(uint32_t)) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return CRYPT_INVALID_ARG;
     }
+    // The layout of keyData is fixed once it is allocated.
+    if (ctx->keyData.bufAddr != NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_REPEATED_SET);
+        return CRYPT_MLKEM_KEY_REPEATED_SET;
+    }
+    ctx->keyData.noMatrix = (*(uint32_t *)val != 0);
+    return CRYPT_SUCCESS;
+}
+
+static int32_t MlKemSetDkFormat(CRYPT_ML_KEM_Ctx *ctx, void *val, uint32_t len)
+{
+    if (len != sizeof(uint32_t)) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return CRYPT_INVALID_ARG;
+    }
+    uint32_t format = *(uint32_t *)val;
+    if (format != CRYPT_ML_KEM_DK_FORMAT_EXPANDED && format != CRYPT_ML_KEM_DK_FORMAT_SEED) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return CRYPT_INVALID_ARG;
+    }
+    ctx->dkFormat = (uint8_t)format;
+    return CRYPT_SUCCESS;
+}
+
+static int32_t MlKemSetMulCache(CRYPT_ML_KEM_Ctx *ctx, void *val, uint32_t len)
+{
+    if (len != sizeof(uint32_t)) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return CRYPT_INVALID_ARG;
+    }
+    // The mulcache is built with the expanded key, which is immutable once it exists.
+    if (ctx->keyData.bufAddr != NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_REPEATED_SET);
+        return CRYPT_MLKEM_KEY_REPEATED_SET;
+    }
+    ctx->keyData.mulCache = (*(uint32_t *)val != 0);
     return CRYPT_SUCCESS;
 }
 
@@ -488,6 +772,12 @@ int32_t CRYPT_ML_KEM_Ctrl(CRYPT_ML_KEM_Ctx *ctx, int32_t opt, void *val, uint32_
             return MlKemGetCipherTextLen(ctx, val, len);
         case CRYPT_CTRL_GET_SHARED_KEY_LEN:
             return MlKemGetSharedLen(ctx, val, len);
+        case CRYPT_CTRL_ML_KEM_SET_NO_MATRIX:
+            return MlKemSetNoMatrix(ctx, val, len);
+        case CRYPT_CTRL_ML_KEM_SET_MULCACHE:
+            return MlKemSetMulCache(ctx, val, len);
+        case CRYPT_CTRL_ML_KEM_SET_DK_FORMAT:
+            return MlKemSetDkFormat(ctx, val, len);
         default:
             BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_CTRL_NOT_SUPPORT);
             return CRYPT_MLKEM_CTRL_NOT_SUPPORT;
@@ -497,7 +787,7 @@ int32_t CRYPT_ML_KEM_Ctrl(CRYPT_ML_KEM_Ctx *ctx, int32_t opt, void *val, uint32_
 static int32_t MlKemCreateKeyBuf(CRYPT_ML_KEM_Ctx *ctx)
 {
     if (ctx->dk == NULL) {
-        uint8_t *dk = BSL_SAL_Malloc(ctx->info->decapsKeyLen);
+        uint8_t *dk = MlKemKeyBufNew(ctx, true, NULL, ctx->info->decapsKeyLen);
         if (dk == NULL) {
             BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
             return CRYPT_MEM_ALLOC_FAIL;
@@ -506,7 +796,7 @@ static int32_t MlKemCreateKeyBuf(CRYPT_ML_KEM_Ctx *ctx)
         ctx->dkLen = ctx->info->decapsKeyLen;
     }
     if (ctx->ek == NULL) {
-        uint8_t *ek = BSL_SAL_Malloc(ctx->info->encapsKeyLen);
+        uint8_t *ek = MlKemKeyBufNew(ctx, false, NULL, ctx->info->encapsKeyLen);
         if (ek == NULL) {
             BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
             return CRYPT_MEM_ALLOC_FAIL;
@@ -527,6 +817,9 @@ int32_t CRYPT_ML_KEM_GenKey(CRYPT_ML_KEM_Ctx *ctx)
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEYINFO_NOT_SET);
         return CRYPT_MLKEM_KEYINFO_NOT_SET;
     }
+    if (ctx->layout == MLKEM_LAYOUT_MAPPED) {
+        MLKEM_KeyReset(ctx);  // The new key must not be written to the read-only image.
+    }
     if (MlKemCreateKeyBuf(ctx) != CRYPT_SUCCESS) {
         return CRYPT_MEM_ALLOC_FAIL;
     }
@@ -537,12 +830,49 @@ int32_t CRYPT_ML_KEM_GenKey(CRYPT_ML_KEM_Ctx *ctx)
     ret = CRYPT_RandEx(ctx->libCtx, z, MLKEM_SEED_LEN);
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
 
+    // The old expanded key may be shared with duplicated contexts, the new one gets its own buffers.
+    ctx->expandState = MLKEM_KEY_NOT_EXPANDED;
+    MLKEM_FreeMatrixBuf(ctx->info->k, &ctx->keyData);
     ret = MLKEM_KeyGenInternal(ctx, d, z);
+    if (ret == CRYPT_SUCCESS) {
+        // Keep the seed so that the key can be exported in seed form.
+        (void)memcpy_s(ctx->seed, sizeof(ctx->seed), d, MLKEM_SEED_LEN);
+        (void)memcpy_s(ctx->seed + MLKEM_SEED_LEN, sizeof(ctx->seed) - MLKEM_SEED_LEN, z, MLKEM_SEED_LEN);
+        ctx->hasSeed = true;
+        __atomic_store_n(&ctx->expandState, MLKEM_KEY_EXPANDED, __ATOMIC_RELEASE);
+    }
     BSL_SAL_CleanseData(d, MLKEM_SEED_LEN);
     BSL_SAL_CleanseData(z, MLKEM_SEED_LEN);
     return ret;
 }
 
+// Rebuild ek, dk and keyData from the seed d || z.
+int32_t MLKEM_ExpandSeed(CRYPT_ML_KEM_Ctx *ctx)
+{
+    if (MlKemCreateKeyBuf(ctx) != CRYPT_SUCCESS) {
+        return CRYPT_MEM_ALLOC_FAIL;
+    }
+    return MLKEM_KeyGenInternal(ctx, ctx->seed, ctx->seed + MLKEM_SEED_LEN);
+}
+
+int32_t CRYPT_ML_KEM_KeepSeedOnly(CRYPT_ML_KEM_Ctx *ctx)
+{
+    if (ctx == NULL || ctx->info == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return CRYPT_NULL_INPUT;
+    }
+    if (!ctx->hasSeed) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_NOT_SET);
+        return CRYPT_MLKEM_KEY_NOT_SET;
+    }
+    // ek and H(ek) stay, dk and keyData are rebuilt from the seed by the next decapsulation or encapsulation.
+    BSL_SAL_CleanseData(ctx->dk, ctx->dkLen);
+    MlKemKeyBufFree(ctx, &ctx->dk);
+    MLKEM_FreeMatrixBuf(ctx->info->k, &ctx->keyData);
+    ctx->expandState = MLKEM_KEY_NOT_EXPANDED;
+    return CRYPT_SUCCESS;
+}
+
 static int32_t EncCapsInputCheck(const CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t *ctLen,
     uint8_t *sk, uint32_t *skLen)
 {
@@ -565,6 +895,8 @@ int32_t CRYPT_ML_KEM_Encaps(CRYPT_ML_KEM_Ctx *ctx, uint8_t *cipher, uint32_t *ci
 {
     int32_t ret = EncCapsInputCheck(ctx, cipher, cipherLen, share, shareLen);
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    ret = MLKEM_ExpandKey(ctx);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
 
     uint8_t m[MLKEM_SEED_LEN];
     ret = CRYPT_RandEx(ctx->libCtx, m, MLKEM_SEED_LEN);
@@ -575,10 +907,44 @@ int32_t CRYPT_ML_KEM_Encaps(CRYPT_ML_KEM_Ctx *ctx, uint8_t *cipher, uint32_t *ci
     return ret;
 }
 
+int32_t CRYPT_ML_KEM_EncapsBatch(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint8_t *cipher, uint32_t *cipherLen,
+    uint8_t *share, uint32_t *shareLen)
+{
+    int32_t ret = EncCapsInputCheck(ctx, cipher, cipherLen, share, shareLen);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    if (num == 0) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return CRYPT_INVALID_ARG;
+    }
+    if (*cipherLen / ctx->info->cipherLen < num || *shareLen / MLKEM_SHARED_KEY_LEN < num ||
+        num > UINT32_MAX / MLKEM_SEED_LEN) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_LEN_NOT_ENOUGH);
+        return CRYPT_MLKEM_LEN_NOT_ENOUGH;
+    }
+
+    ret = MLKEM_ExpandKey(ctx);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+
+    uint32_t mLen = MLKEM_SEED_LEN * num;
+    uint8_t *m = BSL_SAL_Malloc(mLen);
+    if (m == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return CRYPT_MEM_ALLOC_FAIL;
+    }
+    GOTO_ERR_IF(CRYPT_RandEx(ctx->libCtx, m, mLen), ret);
+    GOTO_ERR_IF(MLKEM_EncapsBatchInternal(ctx, num, cipher, share, m), ret);
+    *cipherLen = ctx->info->cipherLen * num;
+    *shareLen = ctx->info->sharedLen * num;
+ERR:
+    BSL_SAL_ClearFree(m, mLen);
+    return ret;
+}
+
 static int32_t DecCapsInputCheck(const CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t ctLen,
     uint8_t *sk, uint32_t *skLen)
 {
-    if (ctx == NULL || ctx->dk == NULL || ct == NULL || sk == NULL || skLen == NULL) {
+    // hasSeed first: ctx->dk of a seed-only key is written by the thread that expands it.
+    if (ctx == NULL || (!ctx->hasSeed && ctx->dk == NULL) || ct == NULL || sk == NULL || skLen == NULL) {
         return CRYPT_NULL_INPUT;
     }
     if (ctx->info == NULL) {
@@ -595,10 +961,35 @@ int32_t CRYPT_ML_KEM_Decaps(CRYPT_ML_KEM_Ctx *ctx, uint8_t *cipher, uint32_t cip
 {
     int32_t ret = DecCapsInputCheck(ctx, cipher, cipherLen, share, shareLen);
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    ret = MLKEM_ExpandKey(ctx);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
 
     return MLKEM_DecapsInternal(ctx, cipher, cipherLen, share, shareLen);
 }
 
+int32_t CRYPT_ML_KEM_DecapsBatch(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint8_t *cipher, uint32_t cipherLen,
+    uint8_t *share, uint32_t *shareLen)
+{
+    if (num == 0) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return CRYPT_INVALID_ARG;
+    }
+    // The checks of CRYPT_ML_KEM_Decaps on the first item, the others are the same size and only need to fit.
+    int32_t ret = DecCapsInputCheck(ctx, cipher, cipherLen / num, share, shareLen);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    if (cipherLen % num != 0 || *shareLen / MLKEM_SHARED_KEY_LEN < num) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_LEN_NOT_ENOUGH);
+        return CRYPT_MLKEM_LEN_NOT_ENOUGH;
+    }
+
+    ret = MLKEM_ExpandKey(ctx);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    ret = MLKEM_DecapsBatchInternal(ctx, num, cipher, share);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    *shareLen = MLKEM_SHARED_KEY_LEN * num;
+    return CRYPT_SUCCESS;
+}
+
 #ifdef HITLS_CRYPTO_MLKEM_CHECK
 
 static int32_t MlKemKeyPairCheck(CRYPT_ML_KEM_Ctx *pubKey, CRYPT_ML_KEM_Ctx *prvKey)
@@ -648,6 +1039,10 @@ static int32_t MlKemPrvKeyCheck(const CRYPT_ML_KEM_Ctx *prvKey)
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEYINFO_NOT_SET);
         return CRYPT_MLKEM_KEYINFO_NOT_SET;
     }
+    // A seed always gives a valid dk, a key kept as its seed only has none until it is expanded again.
+    if (prvKey->hasSeed) {
+        return CRYPT_SUCCESS;
+    }
     if (prvKey->dk == NULL || prvKey->dkLen != prvKey->info->decapsKeyLen) {
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_INVALID_PRVKEY);
         return CRYPT_MLKEM_INVALID_PRVKEY;
@@ -0,0 +1,146 @@
+/*
+ * This file is part of the openHiTLS project.
+ *
+ * openHiTLS is licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *     http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "hitls_build.h"
+#if defined(HITLS_CRYPTO_MLKEM) && defined(HITLS_CRYPTO_MLKEM_POOL)
+#include "securec.h"
+#include "crypt_errno.h"
+#include "bsl_sal.h"
+#include "bsl_err_internal.h"
+#include "ml_kem_local.h"
+
+/*
+ * Pool of reusable single-allocation contexts of one parameter set.
+ * Released contexts are cleansed and queued in one of MLKEM_CTXPOOL_SHARDS lock-free rings. Every thread starts
+ * with the shard picked by the address of a thread-local variable, so threads mostly work on their own ring and
+ * only fall back to the other shards when it is empty or full. The allocator is used when all shards are empty.
+ * The rings are rounded up to powers of two and together hold more than maxCached contexts, the cap is kept by the
+ * cached count instead: a release takes a place in it before pushing, and a context beyond maxCached is freed.
+ */
+#define MLKEM_CTXPOOL_SHARDS 8
+#define MLKEM_CTXPOOL_MAX_CACHED (1U << 16)
+
+struct CryptMlKemCtxPool {
+    void *libCtx;
+    int32_t keyType;
+    const CRYPT_MlKemInfo *info;
+    uint32_t maxCached;
+    uint32_t cached;  // Contexts in the shards, or about to be pushed
+    MLKEM_Ring shards[MLKEM_CTXPOOL_SHARDS];
+};
+
+static __thread uint8_t g_ctxPoolThreadTag;
+
+static uint32_t CtxPoolShard(void)
+{
+    uintptr_t addr = (uintptr_t)&g_ctxPoolThreadTag;
+    return (uint32_t)((addr >> 6) ^ (addr >> 12) ^ (addr >> 20)) % MLKEM_CTXPOOL_SHARDS;
+}
+
+CRYPT_ML_KEM_CtxPool *CRYPT_ML_KEM_CtxPoolNew(void *libCtx, int32_t keyType, uint32_t maxCached)
+{
+    const CRYPT_MlKemInfo *info = MLKEM_GetInfoByType(keyType);
+    if (info == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NOT_SUPPORT);
+        return NULL;
+    }
+    if (maxCached == 0 || maxCached > MLKEM_CTXPOOL_MAX_CACHED) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return NULL;
+    }
+    CRYPT_ML_KEM_CtxPool *pool = BSL_SAL_Calloc(1, sizeof(CRYPT_ML_KEM_CtxPool));
+    if (pool == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return NULL;
+    }
+    pool->libCtx = libCtx;
+    pool->keyType = keyType;
+    pool->info = info;
+    pool->maxCached = maxCached;
+    uint32_t perShard = (maxCached + MLKEM_CTXPOOL_SHARDS - 1) / MLKEM_CTXPOOL_SHARDS;
+    for (uint32_t i = 0; i < MLKEM_CTXPOOL_SHARDS; i++) {
+        if (MLKEM_RingInit(&pool->shards[i], perShard) != CRYPT_SUCCESS) {
+            BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+            CRYPT_ML_KEM_CtxPoolFree(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_CtxPoolAcquire(CRYPT_ML_KEM_CtxPool *pool)
+{
+    if (pool == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return NULL;
+    }
+    uint32_t shard = CtxPoolShard();
+    for (uint32_t i = 0; i < MLKEM_CTXPOOL_SHARDS; i++) {
+        CRYPT_ML_KEM_Ctx *ctx = MLKEM_RingPop(&pool->shards[(shard + i) % MLKEM_CTXPOOL_SHARDS]);
+        if (ctx != NULL) {
+            (void)__atomic_sub_fetch(&pool->cached, 1, __ATOMIC_RELAXED);
+            return ctx;
+        }
+    }
+    return CRYPT_ML_KEM_NewCtxBlock(pool->libCtx, pool->keyType);
+}
+
+int32_t CRYPT_ML_KEM_CtxPoolRelease(CRYPT_ML_KEM_CtxPool *pool, CRYPT_ML_KEM_Ctx *ctx)
+{
+    if (pool == NULL || ctx == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return CRYPT_NULL_INPUT;
+    }
+    if (ctx->layout != MLKEM_LAYOUT_BLOCK || ctx->info != pool->info || ctx->libCtx != pool->libCtx) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return CRYPT_INVALID_ARG;
+    }
+    int ret = 0;
+    BSL_SAL_AtomicDownReferences(&(ctx->references), &ret);
+    if (ret > 0) {
+        return CRYPT_SUCCESS;  // Still referenced by another holder.
+    }
+    MLKEM_CtxRecycle(ctx);
+    if (__atomic_fetch_add(&pool->cached, 1, __ATOMIC_RELAXED) < pool->maxCached) {
+        uint32_t shard = CtxPoolShard();
+        for (uint32_t i = 0; i < MLKEM_CTXPOOL_SHARDS; i++) {
+            if (MLKEM_RingPush(&pool->shards[(shard + i) % MLKEM_CTXPOOL_SHARDS], ctx)) {
+                return CRYPT_SUCCESS;
+            }
+        }
+    }
+    (void)__atomic_sub_fetch(&pool->cached, 1, __ATOMIC_RELAXED);
+    CRYPT_ML_KEM_FreeCtx(ctx);
+    return CRYPT_SUCCESS;
+}
+
+void CRYPT_ML_KEM_CtxPoolFree(CRYPT_ML_KEM_CtxPool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < MLKEM_CTXPOOL_SHARDS; i++) {
+        if (pool->shards[i].cells == NULL) {
+            continue;
+        }
+        CRYPT_ML_KEM_Ctx *ctx;
+        while ((ctx = MLKEM_RingPop(&pool->shards[i])) != NULL) {
+            CRYPT_ML_KEM_FreeCtx(ctx);
+        }
+        MLKEM_RingDeinit(&pool->shards[i]);
+    }
+    BSL_SAL_FREE(pool);
+}
+#endif
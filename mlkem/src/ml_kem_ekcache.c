@@ -0,0 +1,347 @@
+/*
+ * This file is part of the openHiTLS project.
+ *
+ * openHiTLS is licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *     http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "hitls_build.h"
+#if defined(HITLS_CRYPTO_MLKEM) && defined(HITLS_CRYPTO_MLKEM_EKCACHE)
+#include "securec.h"
+#include "crypt_errno.h"
+#include "bsl_sal.h"
+#include "bsl_errno.h"
+#include "bsl_err_internal.h"
+#include "crypt_util_rand.h"
+#include "ml_kem_local.h"
+
+/*
+ * LRU cache of expanded encapsulation keys of one parameter set, keyed by the encoded ek.
+ * Every entry owns one reference to a single-allocation context, and every context handed out holds another one,
+ * so an evicted key stays valid until its last user calls CRYPT_ML_KEM_FreeCtx. A hash table with chaining finds
+ * the entries, a doubly linked list keeps them in LRU order, and both are protected by one lock. Keys are expanded
+ * outside the lock. The ek is chosen by the peer, so the buckets are indexed by SipHash-2-4 under a random key of
+ * the cache: without the key, no set of eks can be made to collide into one chain.
+ */
+#define EKCACHE_MIN_BUCKETS 16
+#define EKCACHE_MAX_BUCKETS (1U << 20)
+#define EKCACHE_HASH_KEY_LEN 16
+
+typedef struct MlKemEkCacheEntry {
+    struct MlKemEkCacheEntry *hashNext;
+    struct MlKemEkCacheEntry *prev;  // Towards the most recently used entry
+    struct MlKemEkCacheEntry *next;
+    uint32_t hash;
+    CRYPT_ML_KEM_Ctx *ctx;
+} MlKemEkCacheEntry;
+
+struct CryptMlKemEkCache {
+    void *libCtx;
+    int32_t keyType;
+    uint32_t ekLen;
+    uint64_t maxBytes;
+    uint64_t entryBytes;
+    uint32_t mask;
+    uint64_t hashKey[2];
+    MlKemEkCacheEntry **buckets;
+    MlKemEkCacheEntry *head;  // Most recently used
+    MlKemEkCacheEntry *tail;
+    CRYPT_ML_KEM_EkCacheStat stat;
+    BSL_SAL_ThreadLockHandle lock;
+};
+
+static inline uint64_t EkCacheRotl(uint64_t x, uint32_t n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+// Little-endian load of len <= 8 bytes.
+static inline uint64_t EkCacheLoad(const uint8_t *p, uint32_t len)
+{
+    uint64_t x = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        x |= (uint64_t)p[i] << (8 * i);
+    }
+    return x;
+}
+
+static void EkCacheSipRounds(uint64_t v[4], uint32_t rounds)
+{
+    for (uint32_t r = 0; r < rounds; r++) {
+        v[0] += v[1];
+        v[1] = EkCacheRotl(v[1], 13) ^ v[0];
+        v[0] = EkCacheRotl(v[0], 32);
+        v[2] += v[3];
+        v[3] = EkCacheRotl(v[3], 16) ^ v[2];
+        v[0] += v[3];
+        v[3] = EkCacheRotl(v[3], 21) ^ v[0];
+        v[2] += v[1];
+        v[1] = EkCacheRotl(v[1], 17) ^ v[2];
+        v[2] = EkCacheRotl(v[2], 32);
+    }
+}
+
+// SipHash-2-4 of ek under the key of the cache, folded to 32 bits.
+static uint32_t EkCacheHash(const CRYPT_ML_KEM_EkCache *cache, const uint8_t *ek, uint32_t ekLen)
+{
+    uint64_t v[4] = {
+        cache->hashKey[0] ^ 0x736f6d6570736575ULL, cache->hashKey[1] ^ 0x646f72616e646f6dULL,
+        cache->hashKey[0] ^ 0x6c7967656e657261ULL, cache->hashKey[1] ^ 0x7465646279746573ULL
+    };
+    uint32_t tail = ekLen % 8;
+    uint64_t m;
+    for (uint32_t i = 0; i < ekLen - tail; i += 8) {
+        m = EkCacheLoad(ek + i, 8);
+        v[3] ^= m;
+        EkCacheSipRounds(v, 2);
+        v[0] ^= m;
+    }
+    m = ((uint64_t)ekLen << 56) | EkCacheLoad(ek + ekLen - tail, tail);
+    v[3] ^= m;
+    EkCacheSipRounds(v, 2);
+    v[0] ^= m;
+    v[2] ^= 0xff;
+    EkCacheSipRounds(v, 4);
+    uint64_t h = v[0] ^ v[1] ^ v[2] ^ v[3];
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static void EkCacheUnlink(CRYPT_ML_KEM_EkCache *cache, MlKemEkCacheEntry *entry)
+{
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void EkCachePushFront(CRYPT_ML_KEM_EkCache *cache, MlKemEkCacheEntry *entry)
+{
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+static MlKemEkCacheEntry *EkCacheFind(const CRYPT_ML_KEM_EkCache *cache, const uint8_t *ek, uint32_t hash)
+{
+    for (MlKemEkCacheEntry *e = cache->buckets[hash & cache->mask]; e != NULL; e = e->hashNext) {
+        if (e->hash == hash && memcmp(e->ctx->ek, ek, cache->ekLen) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void EkCacheRemoveHash(CRYPT_ML_KEM_EkCache *cache, MlKemEkCacheEntry *entry)
+{
+    MlKemEkCacheEntry **p = &cache->buckets[entry->hash & cache->mask];
+    while (*p != entry) {
+        p = &(*p)->hashNext;
+    }
+    *p = entry->hashNext;
+}
+
+// Moves entry to the front and takes a reference for the caller. Called with the lock held.
+static CRYPT_ML_KEM_Ctx *EkCacheUse(CRYPT_ML_KEM_EkCache *cache, MlKemEkCacheEntry *entry)
+{
+    int ref = 0;
+    EkCacheUnlink(cache, entry);
+    EkCachePushFront(cache, entry);
+    BSL_SAL_AtomicUpReferences(&(entry->ctx->references), &ref);
+    return entry->ctx;
+}
+
+/*
+ * Evicts least recently used entries until the cache fits in maxBytes, keeping at least the most recent one.
+ * The evicted entries are chained through hashNext into *evicted, to be freed after the lock is released.
+ */
+static void EkCacheEvict(CRYPT_ML_KEM_EkCache *cache, MlKemEkCacheEntry **evicted)
+{
+    while (cache->stat.bytes > cache->maxBytes && cache->tail != cache->head) {
+        MlKemEkCacheEntry *victim = cache->tail;
+        EkCacheUnlink(cache, victim);
+        EkCacheRemoveHash(cache, victim);
+        victim->hashNext = *evicted;
+        *evicted = victim;
+        cache->stat.entries--;
+        cache->stat.bytes -= cache->entryBytes;
+        cache->stat.evictions++;
+    }
+}
+
+static void EkCacheFreeEntries(MlKemEkCacheEntry *entry)
+{
+    while (entry != NULL) {
+        MlKemEkCacheEntry *next = entry->hashNext;
+        CRYPT_ML_KEM_FreeCtx(entry->ctx);
+        BSL_SAL_Free(entry);
+        entry = next;
+    }
+}
+
+CRYPT_ML_KEM_EkCache *CRYPT_ML_KEM_EkCacheNew(void *libCtx, int32_t keyType, uint64_t maxBytes)
+{
+    const CRYPT_MlKemInfo *info = MLKEM_GetInfoByType(keyType);
+    if (info == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NOT_SUPPORT);
+        return NULL;
+    }
+    uint64_t entryBytes = (uint64_t)CRYPT_ML_KEM_GetCtxBlockSize(keyType) + sizeof(MlKemEkCacheEntry);
+    if (maxBytes < entryBytes) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return NULL;
+    }
+    CRYPT_ML_KEM_EkCache *cache = BSL_SAL_Calloc(1, sizeof(CRYPT_ML_KEM_EkCache));
+    if (cache == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return NULL;
+    }
+    cache->libCtx = libCtx;
+    cache->keyType = keyType;
+    cache->ekLen = info->encapsKeyLen;
+    cache->maxBytes = maxBytes;
+    cache->entryBytes = entryBytes;
+    uint8_t hashKey[EKCACHE_HASH_KEY_LEN];
+    int32_t ret = CRYPT_RandEx(libCtx, hashKey, sizeof(hashKey));
+    if (ret != CRYPT_SUCCESS) {
+        BSL_ERR_PUSH_ERROR(ret);
+        BSL_SAL_FREE(cache);
+        return NULL;
+    }
+    cache->hashKey[0] = EkCacheLoad(hashKey, 8);
+    cache->hashKey[1] = EkCacheLoad(hashKey + 8, 8);
+    BSL_SAL_CleanseData(hashKey, sizeof(hashKey));
+    uint32_t bucketNum = EKCACHE_MIN_BUCKETS;
+    while (bucketNum < EKCACHE_MAX_BUCKETS && bucketNum < maxBytes / entryBytes) {
+        bucketNum <<= 1;
+    }
+    cache->mask = bucketNum - 1;
+    cache->buckets = BSL_SAL_Calloc(bucketNum, sizeof(MlKemEkCacheEntry *));
+    if (cache->buckets == NULL || BSL_SAL_ThreadLockNew(&cache->lock) != BSL_SUCCESS) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        CRYPT_ML_KEM_EkCacheFree(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+// An expanded context of ek, not yet in the cache.
+static MlKemEkCacheEntry *EkCacheNewEntry(const CRYPT_ML_KEM_EkCache *cache, const CRYPT_KemEncapsKey *ek,
+    uint32_t hash)
+{
+    MlKemEkCacheEntry *entry = BSL_SAL_Calloc(1, sizeof(MlKemEkCacheEntry));
+    if (entry == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->ctx = CRYPT_ML_KEM_NewCtxBlock(cache->libCtx, cache->keyType);
+    if (entry->ctx == NULL || CRYPT_ML_KEM_SetEncapsKey(entry->ctx, ek) != CRYPT_SUCCESS ||
+        MLKEM_ExpandKey(entry->ctx) != CRYPT_SUCCESS) {
+        CRYPT_ML_KEM_FreeCtx(entry->ctx);
+        BSL_SAL_Free(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_EkCacheGet(CRYPT_ML_KEM_EkCache *cache, const CRYPT_KemEncapsKey *ek)
+{
+    if (cache == NULL || ek == NULL || ek->data == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return NULL;
+    }
+    if (ek->len != cache->ekLen) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEYLEN_ERROR);
+        return NULL;
+    }
+    uint32_t hash = EkCacheHash(cache, ek->data, ek->len);
+    CRYPT_ML_KEM_Ctx *ctx = NULL;
+    (void)BSL_SAL_ThreadWriteLock(cache->lock);
+    MlKemEkCacheEntry *entry = EkCacheFind(cache, ek->data, hash);
+    if (entry != NULL) {
+        cache->stat.hits++;
+        ctx = EkCacheUse(cache, entry);
+    } else {
+        cache->stat.misses++;
+    }
+    (void)BSL_SAL_ThreadUnlock(cache->lock);
+    if (ctx != NULL) {
+        return ctx;
+    }
+
+    MlKemEkCacheEntry *newEntry = EkCacheNewEntry(cache, ek, hash);
+    if (newEntry == NULL) {
+        return NULL;
+    }
+    MlKemEkCacheEntry *evicted = NULL;
+    (void)BSL_SAL_ThreadWriteLock(cache->lock);
+    entry = EkCacheFind(cache, ek->data, hash);
+    if (entry != NULL) {
+        // Expanded by another thread in the meantime.
+        ctx = EkCacheUse(cache, entry);
+        evicted = newEntry;
+    } else {
+        uint32_t bucket = hash & cache->mask;
+        newEntry->hashNext = cache->buckets[bucket];
+        cache->buckets[bucket] = newEntry;
+        cache->stat.entries++;
+        cache->stat.bytes += cache->entryBytes;
+        EkCachePushFront(cache, newEntry);
+        ctx = EkCacheUse(cache, newEntry);
+        EkCacheEvict(cache, &evicted);
+    }
+    (void)BSL_SAL_ThreadUnlock(cache->lock);
+    EkCacheFreeEntries(evicted);
+    return ctx;
+}
+
+int32_t CRYPT_ML_KEM_EkCacheGetStat(const CRYPT_ML_KEM_EkCache *cache, CRYPT_ML_KEM_EkCacheStat *stat)
+{
+    if (cache == NULL || stat == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return CRYPT_NULL_INPUT;
+    }
+    (void)BSL_SAL_ThreadReadLock(cache->lock);
+    *stat = cache->stat;
+    (void)BSL_SAL_ThreadUnlock(cache->lock);
+    return CRYPT_SUCCESS;
+}
+
+void CRYPT_ML_KEM_EkCacheFree(CRYPT_ML_KEM_EkCache *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+    MlKemEkCacheEntry *entry = cache->head;
+    while (entry != NULL) {
+        MlKemEkCacheEntry *next = entry->next;
+        CRYPT_ML_KEM_FreeCtx(entry->ctx);
+        BSL_SAL_Free(entry);
+        entry = next;
+    }
+    BSL_SAL_ThreadLockFree(cache->lock);
+    BSL_SAL_CleanseData(cache->hashKey, sizeof(cache->hashKey));
+    BSL_SAL_FREE(cache->buckets);
+    BSL_SAL_FREE(cache);
+}
+#endif
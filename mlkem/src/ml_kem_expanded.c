@@ -0,0 +1,297 @@
+/*
+ * This file is part of the openHiTLS project.
+ *
+ * openHiTLS is licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *     http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "hitls_build.h"
+#if defined(HITLS_CRYPTO_MLKEM) && defined(HITLS_CRYPTO_MLKEM_EXPANDED_KEY)
+#include <stddef.h>
+#include "securec.h"
+#include "crypt_errno.h"
+#include "bsl_sal.h"
+#include "bsl_err_internal.h"
+#include "crypt_utils.h"
+#include "eal_md_local.h"
+#include "ml_kem_local.h"
+
+/*
+ * Expanded key image, all regions 64-byte aligned:
+ *   header (MLKEM_IMAGE_HDR_LEN bytes)
+ *   matrix A (k * k polynomials, absent with MLKEM_IMAGE_NO_MATRIX) || t (k polynomials)
+ *   s (k polynomials, only with MLKEM_IMAGE_HAS_DK)
+ *   dk (decapsKeyLen bytes, which holds ek, H(ek) and z) with MLKEM_IMAGE_HAS_DK, ek (encapsKeyLen bytes) otherwise
+ * The polynomials are keyData as is: int16_t in the NTT and Montgomery domain, in host byte order.
+ * The checksum covers the header up to the checksum field and everything after the header.
+ */
+#define MLKEM_IMAGE_MAGIC "MLKEMEXK"
+#define MLKEM_IMAGE_MAGIC_LEN 8
+#define MLKEM_IMAGE_VERSION 1
+#define MLKEM_IMAGE_BYTE_ORDER 0x01020304U
+#define MLKEM_IMAGE_HDR_LEN 128
+#define MLKEM_IMAGE_ALIGN 64
+#define MLKEM_IMAGE_HAS_DK 0x1U
+#define MLKEM_IMAGE_NO_MATRIX 0x2U
+#define MLKEM_IMAGE_POLY_BYTES (MLKEM_N * sizeof(int16_t))
+
+typedef struct {
+    uint8_t magic[MLKEM_IMAGE_MAGIC_LEN];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t bits;
+    uint32_t flags;
+    uint32_t totalLen;
+    uint32_t reserved;
+    uint8_t ekHash[CRYPT_SHA3_256_DIGESTSIZE];
+    uint64_t checksum;
+} MlKemImageHdr;
+
+typedef struct {
+    uint32_t pubOff;
+    uint32_t secretOff;
+    uint32_t keyOff;
+    uint32_t keyLen;
+    uint32_t totalLen;
+} MlKemImageLayout;
+
+static void ImageLayout(const CRYPT_MlKemInfo *info, uint32_t flags, MlKemImageLayout *layout)
+{
+    uint32_t k = info->k;
+    uint32_t pubPolys = ((flags & MLKEM_IMAGE_NO_MATRIX) != 0 ? 0 : k * k) + k;
+    uint32_t secretPolys = (flags & MLKEM_IMAGE_HAS_DK) != 0 ? MLKEM_SECRET_POLYS(k) : 0;
+    layout->pubOff = MLKEM_IMAGE_HDR_LEN;
+    layout->secretOff = layout->pubOff + pubPolys * MLKEM_IMAGE_POLY_BYTES;
+    layout->keyOff = layout->secretOff + secretPolys * MLKEM_IMAGE_POLY_BYTES;
+    layout->keyLen = (flags & MLKEM_IMAGE_HAS_DK) != 0 ? info->decapsKeyLen : info->encapsKeyLen;
+    layout->totalLen = layout->keyOff + layout->keyLen;
+}
+
+// Fletcher-64 over 32-bit words, len is a multiple of 4. Detects corruption of the stored image, not tampering.
+static void ImageChecksumUpdate(uint64_t sum[2], const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i += sizeof(uint32_t)) {
+        uint32_t w;
+        (void)memcpy_s(&w, sizeof(w), data + i, sizeof(w));
+        sum[0] = (sum[0] + w) % 0xffffffffULL;
+        sum[1] = (sum[1] + sum[0]) % 0xffffffffULL;
+    }
+}
+
+static uint64_t ImageChecksum(const uint8_t *image, uint32_t totalLen)
+{
+    uint64_t sum[2] = { 0, 0 };
+    ImageChecksumUpdate(sum, image, offsetof(MlKemImageHdr, checksum));
+    ImageChecksumUpdate(sum, image + MLKEM_IMAGE_HDR_LEN, totalLen - MLKEM_IMAGE_HDR_LEN);
+    return (sum[1] << 32) | sum[0];
+}
+
+static uint32_t ImageFlags(const CRYPT_ML_KEM_Ctx *ctx)
+{
+    return (ctx->dk != NULL ? MLKEM_IMAGE_HAS_DK : 0) | (ctx->keyData.noMatrix ? MLKEM_IMAGE_NO_MATRIX : 0);
+}
+
+int32_t CRYPT_ML_KEM_GetExpandedKeyLen(const CRYPT_ML_KEM_Ctx *ctx, uint32_t *len)
+{
+    if (ctx == NULL || len == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return CRYPT_NULL_INPUT;
+    }
+    if (ctx->info == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEYINFO_NOT_SET);
+        return CRYPT_MLKEM_KEYINFO_NOT_SET;
+    }
+    if (ctx->ek == NULL && ctx->dk == NULL && !ctx->hasSeed) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_NOT_SET);
+        return CRYPT_MLKEM_KEY_NOT_SET;
+    }
+    MlKemImageLayout layout;
+    // A seed-only key gets dk back from its expansion.
+    ImageLayout(ctx->info, ImageFlags(ctx) | (ctx->hasSeed ? MLKEM_IMAGE_HAS_DK : 0), &layout);
+    *len = layout.totalLen;
+    return CRYPT_SUCCESS;
+}
+
+int32_t CRYPT_ML_KEM_ExportExpandedKey(CRYPT_ML_KEM_Ctx *ctx, uint8_t *out, uint32_t *outLen)
+{
+    uint32_t need = 0;
+    int32_t ret = CRYPT_ML_KEM_GetExpandedKeyLen(ctx, &need);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    if (out == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return CRYPT_NULL_INPUT;
+    }
+    if (*outLen < need) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_LEN_NOT_ENOUGH);
+        return CRYPT_MLKEM_LEN_NOT_ENOUGH;
+    }
+    ret = MLKEM_ExpandKey(ctx);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+
+    uint32_t flags = ImageFlags(ctx);
+    MlKemImageLayout layout;
+    ImageLayout(ctx->info, flags, &layout);
+    MlKemImageHdr hdr;
+    (void)memset_s(&hdr, sizeof(hdr), 0, sizeof(hdr));
+    (void)memcpy_s(hdr.magic, sizeof(hdr.magic), MLKEM_IMAGE_MAGIC, MLKEM_IMAGE_MAGIC_LEN);
+    hdr.version = MLKEM_IMAGE_VERSION;
+    hdr.byteOrder = MLKEM_IMAGE_BYTE_ORDER;
+    hdr.bits = ctx->info->bits;
+    hdr.flags = flags;
+    hdr.totalLen = layout.totalLen;
+    (void)memcpy_s(hdr.ekHash, sizeof(hdr.ekHash), ctx->ekHash, sizeof(ctx->ekHash));
+    (void)memset_s(out, MLKEM_IMAGE_HDR_LEN, 0, MLKEM_IMAGE_HDR_LEN);
+    (void)memcpy_s(out, MLKEM_IMAGE_HDR_LEN, &hdr, sizeof(hdr));
+
+    const MLKEM_MatrixSt *st = &ctx->keyData;
+    (void)memcpy_s(out + layout.pubOff, layout.secretOff - layout.pubOff, st->bufAddr,
+        layout.secretOff - layout.pubOff);
+    if ((flags & MLKEM_IMAGE_HAS_DK) != 0) {
+        (void)memcpy_s(out + layout.secretOff, layout.keyOff - layout.secretOff, st->secretAddr,
+            layout.keyOff - layout.secretOff);
+    }
+    (void)memcpy_s(out + layout.keyOff, layout.keyLen, (flags & MLKEM_IMAGE_HAS_DK) != 0 ? ctx->dk : ctx->ek,
+        layout.keyLen);
+    uint64_t checksum = ImageChecksum(out, layout.totalLen);
+    (void)memcpy_s(out + offsetof(MlKemImageHdr, checksum), sizeof(checksum), &checksum, sizeof(checksum));
+    *outLen = layout.totalLen;
+    return CRYPT_SUCCESS;
+}
+
+/*
+ * The checksum does not stop a forged image. The lazy accumulation of the matrix-vector products takes coefficients
+ * with |x| < MLKEM_Q only, so every mapped polynomial is checked against that bound.
+ */
+static int32_t ImageCheckCoeffs(const uint8_t *polys, uint32_t len)
+{
+    const int16_t *coeffs = (const int16_t *)(uintptr_t)polys;
+    int16_t bad = 0;
+    for (uint32_t i = 0; i < len / sizeof(int16_t); i++) {
+        int16_t x = coeffs[i];
+        bad |= (int16_t)((x <= -MLKEM_Q) | (x >= MLKEM_Q));
+    }
+    return bad != 0 ? CRYPT_MLKEM_DECODE_KEY_OVERFLOW : CRYPT_SUCCESS;
+}
+
+static int32_t ImageCheck(const uint8_t *image, uint32_t imageLen, const CRYPT_MlKemInfo **info,
+    MlKemImageHdr *hdr, MlKemImageLayout *layout)
+{
+    if (image == NULL) {
+        return CRYPT_NULL_INPUT;
+    }
+    if ((uintptr_t)image % MLKEM_IMAGE_ALIGN != 0 || imageLen < MLKEM_IMAGE_HDR_LEN) {
+        return CRYPT_INVALID_ARG;
+    }
+    (void)memcpy_s(hdr, sizeof(*hdr), image, sizeof(*hdr));
+    if (memcmp(hdr->magic, MLKEM_IMAGE_MAGIC, MLKEM_IMAGE_MAGIC_LEN) != 0 || hdr->version != MLKEM_IMAGE_VERSION ||
+        hdr->byteOrder != MLKEM_IMAGE_BYTE_ORDER ||
+        (hdr->flags & ~(MLKEM_IMAGE_HAS_DK | MLKEM_IMAGE_NO_MATRIX)) != 0) {
+        return CRYPT_INVALID_ARG;
+    }
+    *info = MLKEM_GetInfoByBits(hdr->bits);
+    if (*info == NULL) {
+        return CRYPT_NOT_SUPPORT;
+    }
+    ImageLayout(*info, hdr->flags, layout);
+    if (hdr->totalLen != layout->totalLen || imageLen < layout->totalLen) {
+        return CRYPT_MLKEM_KEYLEN_ERROR;
+    }
+    if (ImageChecksum(image, layout->totalLen) != hdr->checksum) {
+        return CRYPT_INVALID_ARG;
+    }
+    return ImageCheckCoeffs(image + layout->pubOff, layout->keyOff - layout->pubOff);
+}
+
+/*
+ * H(ek) is not taken from the header: it is recomputed from the ek of the image and must match both the header and,
+ * in a private image, the H(ek) stored in dk (the FIPS 203 input check of dk).
+ */
+static int32_t ImageCheckEkHash(void *libCtx, const CRYPT_MlKemInfo *info, const uint8_t *key,
+    const MlKemImageHdr *hdr, uint8_t ekHash[CRYPT_SHA3_256_DIGESTSIZE])
+{
+    bool hasDk = (hdr->flags & MLKEM_IMAGE_HAS_DK) != 0;
+    const uint8_t *ek = hasDk ? key + MLKEM_CIPHER_LEN * info->k : key;
+    uint32_t len = CRYPT_SHA3_256_DIGESTSIZE;
+    int32_t ret = EAL_Md(CRYPT_MD_SHA3_256, libCtx, NULL, ek, info->encapsKeyLen, ekHash, &len, libCtx != NULL);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    if (memcmp(ekHash, hdr->ekHash, CRYPT_SHA3_256_DIGESTSIZE) != 0) {
+        return CRYPT_INVALID_ARG;
+    }
+    if (hasDk && memcmp(ek + info->encapsKeyLen, ekHash, CRYPT_SHA3_256_DIGESTSIZE) != 0) {
+        return CRYPT_MLKEM_INVALID_PRVKEY;
+    }
+    return CRYPT_SUCCESS;
+}
+
+// Points keyData into the image, as MLKEM_CreateMatrixBuf and MLKEM_CreateSecretBuf do into their buffers.
+static void ImageMapKeyData(CRYPT_ML_KEM_Ctx *ctx, const uint8_t *image, const MlKemImageLayout *layout)
+{
+    MLKEM_MatrixSt *st = &ctx->keyData;
+    uint8_t k = ctx->info->k;
+    st->bufAddr = (int16_t *)(uintptr_t)(image + layout->pubOff);
+    uint32_t matrixPolys = MLKEM_MATRIX_POLYS(k, st);
+    for (uint8_t i = 0; i < k; i++) {
+        for (uint8_t j = 0; j < k && matrixPolys != 0; j++) {
+            st->matrix[i][j] = st->bufAddr + (i * k + j) * MLKEM_N;
+        }
+        st->vectorT[i] = st->bufAddr + (matrixPolys + i) * MLKEM_N;
+    }
+    if (ctx->dk != NULL) {
+        st->secretAddr = (int16_t *)(uintptr_t)(image + layout->secretOff);
+        for (uint8_t i = 0; i < k; i++) {
+            st->vectorS[i] = st->secretAddr + i * MLKEM_N;
+        }
+    }
+    (void)memcpy_s(st->rho, MLKEM_SEED_LEN, ctx->ek + MLKEM_CIPHER_LEN * k, MLKEM_SEED_LEN);
+}
+
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_NewCtxFromExpandedKey(void *libCtx, const uint8_t *image, uint32_t imageLen)
+{
+    const CRYPT_MlKemInfo *info = NULL;
+    MlKemImageHdr hdr;
+    MlKemImageLayout layout;
+    uint8_t ekHash[CRYPT_SHA3_256_DIGESTSIZE];
+    int32_t ret = ImageCheck(image, imageLen, &info, &hdr, &layout);
+    if (ret == CRYPT_SUCCESS) {
+        ret = ImageCheckEkHash(libCtx, info, image + layout.keyOff, &hdr, ekHash);
+    }
+    if (ret != CRYPT_SUCCESS) {
+        BSL_ERR_PUSH_ERROR(ret);
+        return NULL;
+    }
+    CRYPT_ML_KEM_Ctx *ctx = CRYPT_ML_KEM_NewCtxEx(libCtx);
+    if (ctx == NULL) {
+        return NULL;
+    }
+    ctx->info = info;
+    ctx->layout = MLKEM_LAYOUT_MAPPED;
+    uint8_t *key = (uint8_t *)(uintptr_t)(image + layout.keyOff);
+    if ((hdr.flags & MLKEM_IMAGE_HAS_DK) != 0) {
+        ctx->dk = key;
+        ctx->dkLen = info->decapsKeyLen;
+        ctx->ek = key + MLKEM_CIPHER_LEN * info->k;
+        ctx->dkVerified = true;  // Checked by ImageCheckEkHash.
+    } else {
+        ctx->ek = key;
+    }
+    ctx->ekLen = info->encapsKeyLen;
+    // MlKemKeyBufFree never frees these, MLKEM_KeyReset does not cleanse them.
+    ctx->blockEk = ctx->ek;
+    ctx->blockDk = ctx->dk;
+    ctx->keyData.noMatrix = (hdr.flags & MLKEM_IMAGE_NO_MATRIX) != 0;
+    ImageMapKeyData(ctx, image, &layout);
+    (void)memcpy_s(ctx->ekHash, sizeof(ctx->ekHash), ekHash, sizeof(ekHash));
+    ctx->expandState = MLKEM_KEY_EXPANDED;
+    return ctx;
+}
+#endif
@@ -0,0 +1,166 @@
+/*
+ * This file is part of the openHiTLS project.
+ *
+ * openHiTLS is licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *     http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "hitls_build.h"
+#if defined(HITLS_CRYPTO_MLKEM) && defined(HITLS_CRYPTO_MLKEM_X8664)
+#include <immintrin.h>
+#include "securec.h"
+#include "ml_kem_local.h"
+
+/*
+ * 4-way Keccak-f[1600] with AVX2: each ymm register holds the same state word of 4 independent instances,
+ * so one permutation call advances 4 SHAKE streams. The state word index is x + 5 * y as in FIPS 202.
+ */
+#define MLKEM_AVX2_FUNC __attribute__((target("avx2")))
+#define KECCAK_ROUNDS 24
+#define KECCAK_WORDS 25
+#define KECCAK_LAST_PAD 0x80
+
+#define ROL64(x, n) _mm256_or_si256(_mm256_slli_epi64((x), (n)), _mm256_srli_epi64((x), 64 - (n)))
+
+static const uint64_t KECCAK_RC[KECCAK_ROUNDS] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+    0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+static inline MLKEM_AVX2_FUNC void KeccakRoundX4(__m256i a[KECCAK_WORDS], uint64_t rc)
+{
+    __m256i c[5];
+    __m256i d[5];
+    __m256i b[KECCAK_WORDS];
+    // theta
+    for (uint32_t x = 0; x < 5; x++) {
+        c[x] = _mm256_xor_si256(_mm256_xor_si256(a[x], a[x + 5]), _mm256_xor_si256(a[x + 10], a[x + 15]));
+        c[x] = _mm256_xor_si256(c[x], a[x + 20]);
+    }
+    for (uint32_t x = 0; x < 5; x++) {
+        d[x] = _mm256_xor_si256(c[(x + 4) % 5], ROL64(c[(x + 1) % 5], 1));
+    }
+    // rho and pi: b[y + 5 * ((2 * x + 3 * y) % 5)] = ROL64(a[x + 5 * y] ^ d[x], r[x][y])
+    b[0] = _mm256_xor_si256(a[0], d[0]);
+    b[1] = ROL64(_mm256_xor_si256(a[6], d[1]), 44);
+    b[2] = ROL64(_mm256_xor_si256(a[12], d[2]), 43);
+    b[3] = ROL64(_mm256_xor_si256(a[18], d[3]), 21);
+    b[4] = ROL64(_mm256_xor_si256(a[24], d[4]), 14);
+    b[5] = ROL64(_mm256_xor_si256(a[3], d[3]), 28);
+    b[6] = ROL64(_mm256_xor_si256(a[9], d[4]), 20);
+    b[7] = ROL64(_mm256_xor_si256(a[10], d[0]), 3);
+    b[8] = ROL64(_mm256_xor_si256(a[16], d[1]), 45);
+    b[9] = ROL64(_mm256_xor_si256(a[22], d[2]), 61);
+    b[10] = ROL64(_mm256_xor_si256(a[1], d[1]), 1);
+    b[11] = ROL64(_mm256_xor_si256(a[7], d[2]), 6);
+    b[12] = ROL64(_mm256_xor_si256(a[13], d[3]), 25);
+    b[13] = ROL64(_mm256_xor_si256(a[19], d[4]), 8);
+    b[14] = ROL64(_mm256_xor_si256(a[20], d[0]), 18);
+    b[15] = ROL64(_mm256_xor_si256(a[4], d[4]), 27);
+    b[16] = ROL64(_mm256_xor_si256(a[5], d[0]), 36);
+    b[17] = ROL64(_mm256_xor_si256(a[11], d[1]), 10);
+    b[18] = ROL64(_mm256_xor_si256(a[17], d[2]), 15);
+    b[19] = ROL64(_mm256_xor_si256(a[23], d[3]), 56);
+    b[20] = ROL64(_mm256_xor_si256(a[2], d[2]), 62);
+    b[21] = ROL64(_mm256_xor_si256(a[8], d[3]), 55);
+    b[22] = ROL64(_mm256_xor_si256(a[14], d[4]), 39);
+    b[23] = ROL64(_mm256_xor_si256(a[15], d[0]), 41);
+    b[24] = ROL64(_mm256_xor_si256(a[21], d[1]), 2);
+    // chi
+    for (uint32_t y = 0; y < KECCAK_WORDS; y += 5) {
+        for (uint32_t x = 0; x < 5; x++) {
+            a[y + x] = _mm256_xor_si256(b[y + x], _mm256_andnot_si256(b[y + (x + 1) % 5], b[y + (x + 2) % 5]));
+        }
+    }
+    // iota
+    a[0] = _mm256_xor_si256(a[0], _mm256_set1_epi64x((long long)rc));
+}
+
+static void MLKEM_AVX2_FUNC KeccakF1600X4(uint64_t state[KECCAK_WORDS][MLKEM_KECCAK_WAYS])
+{
+    __m256i a[KECCAK_WORDS];
+    for (uint32_t i = 0; i < KECCAK_WORDS; i++) {
+        a[i] = _mm256_loadu_si256((const __m256i *)state[i]);
+    }
+    for (uint32_t r = 0; r < KECCAK_ROUNDS; r++) {
+        KeccakRoundX4(a, KECCAK_RC[r]);
+    }
+    for (uint32_t i = 0; i < KECCAK_WORDS; i++) {
+        _mm256_storeu_si256((__m256i *)state[i], a[i]);
+    }
+}
+
+// XOR len bytes of in into the rate part of instance n, starting at byte 0.
+static void KeccakX4XorBytes(MLKEM_KeccakX4Ctx *ctx, uint32_t n, const uint8_t *in, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        ctx->state[i / 8][n] ^= (uint64_t)in[i] << (8 * (i % 8));
+    }
+}
+
+static void KeccakX4Absorb(MLKEM_KeccakX4Ctx *ctx, uint32_t rate, uint8_t pad, const uint8_t *in[MLKEM_KECCAK_WAYS],
+    uint32_t inLen)
+{
+    uint32_t offset = 0;
+    (void)memset_s(ctx->state, sizeof(ctx->state), 0, sizeof(ctx->state));
+    while (inLen - offset >= rate) {
+        for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS; n++) {
+            KeccakX4XorBytes(ctx, n, in[n] + offset, rate);
+        }
+        KeccakF1600X4(ctx->state);
+        offset += rate;
+    }
+    uint32_t last = inLen - offset;
+    for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS; n++) {
+        KeccakX4XorBytes(ctx, n, in[n] + offset, last);
+        ctx->state[last / 8][n] ^= (uint64_t)pad << (8 * (last % 8));
+        ctx->state[(rate - 1) / 8][n] ^= (uint64_t)KECCAK_LAST_PAD << (8 * ((rate - 1) % 8));
+    }
+}
+
+void MLKEM_ShakeX4Absorb(MLKEM_KeccakX4Ctx *ctx, uint32_t rate, const uint8_t *in[MLKEM_KECCAK_WAYS], uint32_t inLen)
+{
+    KeccakX4Absorb(ctx, rate, MLKEM_SHAKE_PAD, in, inLen);
+}
+
+// Permutes and reads the first len bytes of the rate part of every instance.
+static void KeccakX4SqueezeBytes(MLKEM_KeccakX4Ctx *ctx, uint8_t *out[MLKEM_KECCAK_WAYS], uint32_t offset,
+    uint32_t len)
+{
+    KeccakF1600X4(ctx->state);
+    for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS; n++) {
+        uint8_t *o = out[n] + offset;
+        for (uint32_t i = 0; i < len; i++) {
+            o[i] = (uint8_t)(ctx->state[i / 8][n] >> (8 * (i % 8)));
+        }
+    }
+}
+
+void MLKEM_ShakeX4Squeeze(MLKEM_KeccakX4Ctx *ctx, uint32_t rate, uint8_t *out[MLKEM_KECCAK_WAYS], uint32_t blocks)
+{
+    for (uint32_t blk = 0; blk < blocks; blk++) {
+        KeccakX4SqueezeBytes(ctx, out, blk * rate, rate);
+    }
+}
+
+void MLKEM_HashX4(uint32_t rate, uint8_t pad, const uint8_t *in[MLKEM_KECCAK_WAYS], uint32_t inLen,
+    uint8_t *out[MLKEM_KECCAK_WAYS], uint32_t outLen)
+{
+    MLKEM_KeccakX4Ctx ctx;
+    KeccakX4Absorb(&ctx, rate, pad, in, inLen);
+    KeccakX4SqueezeBytes(&ctx, out, 0, outLen);
+    (void)memset_s(ctx.state, sizeof(ctx.state), 0, sizeof(ctx.state));
+}
+#endif
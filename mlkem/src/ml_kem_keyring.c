@@ -0,0 +1,386 @@
+/*
+ * This file is part of the openHiTLS project.
+ *
+ * openHiTLS is licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *     http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "hitls_build.h"
+#if defined(HITLS_CRYPTO_MLKEM) && defined(HITLS_CRYPTO_MLKEM_KEYRING)
+#include "securec.h"
+#include "crypt_errno.h"
+#include "bsl_sal.h"
+#include "bsl_err_internal.h"
+#include "crypt_utils.h"
+#include "ml_kem_local.h"
+
+/*
+ * Keyring of decapsulation keys of one parameter set.
+ * The keys live in one allocation of maxKeys expanded single-allocation contexts (the storage), the unused ones are
+ * kept in a lock-free ring. The index is an open-addressing table with linear probing and at least twice as many
+ * slots as keys. The state word of a slot holds its kind in the top 2 bits and the number of running lookups in the
+ * others: a lookup pins a READY slot with a CAS before it reads the ID and uses the key, a removal turns the slot
+ * into a tombstone and waits for the pinned lookups before the key is cleansed and its storage reused.
+ * An insertion reserves a slot, writes the ID and marks it with KEYRING_ID_SET, then probes again for the same ID
+ * (KeyringClaim) before the slot becomes READY, so that two insertions of one ID cannot both succeed.
+ */
+#define KEYRING_MAX_KEYS (1U << 20)
+#define KEYRING_ALIGN 64
+#define KEYRING_KIND_SHIFT 30
+#define KEYRING_ID_SET (1U << 29)  // Of a RESERVED slot: its ID is written, and stable while the slot is pinned
+#define KEYRING_USERS_MASK (KEYRING_ID_SET - 1)
+#define KEYRING_SLOT_EMPTY (0U << KEYRING_KIND_SHIFT)     // Never used, ends a probe sequence
+#define KEYRING_SLOT_RESERVED (1U << KEYRING_KIND_SHIFT)  // Being filled by an insertion
+#define KEYRING_SLOT_READY (2U << KEYRING_KIND_SHIFT)
+#define KEYRING_SLOT_DELETED (3U << KEYRING_KIND_SHIFT)   // Tombstone, reusable once no lookup pins it
+#define KEYRING_KIND(state) ((state) & ~((1U << KEYRING_KIND_SHIFT) - 1))
+
+#define KEYRING_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define KEYRING_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define KEYRING_SUB(p, v) __atomic_sub_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define KEYRING_CAS(p, e, v) __atomic_compare_exchange_n((p), (e), (v), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+typedef struct {
+    uint32_t state;
+    uint8_t idLen;
+    uint8_t id[CRYPT_ML_KEM_KEY_ID_MAX_LEN];
+    CRYPT_ML_KEM_Ctx *ctx;
+} MlKemKeySlot;
+
+struct CryptMlKemKeyring {
+    void *libCtx;
+    int32_t keyType;
+    uint32_t mask;
+    MlKemKeySlot *slots;
+    MLKEM_Ring freeBlocks;
+    uint8_t *storage;
+    uint32_t blockSize;
+};
+
+// FNV-1a, the IDs may be chosen by the caller and are not necessarily uniform.
+static uint32_t KeyringHash(const uint8_t *id, uint32_t idLen)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; i < idLen; i++) {
+        h = (h ^ id[i]) * 0x100000001b3ULL;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+// Pins slot if it is READY, or RESERVED with KEYRING_ID_SET if reserved is true. The ID of a pinned slot is stable.
+static bool KeyringPin(MlKemKeySlot *slot, bool reserved)
+{
+    uint32_t state = KEYRING_LOAD(&slot->state);
+    while (KEYRING_KIND(state) == KEYRING_SLOT_READY ||
+        (reserved && KEYRING_KIND(state) == KEYRING_SLOT_RESERVED && (state & KEYRING_ID_SET) != 0)) {
+        if (KEYRING_CAS(&slot->state, &state, state + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void KeyringUnpin(MlKemKeySlot *slot)
+{
+    (void)KEYRING_SUB(&slot->state, 1);
+}
+
+/*
+ * Returns the pinned slot holding id, or NULL. If reuse is not NULL it receives the first tombstone or empty slot
+ * seen on the probe sequence, or NULL if the table has none.
+ */
+static MlKemKeySlot *KeyringFind(const CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen,
+    MlKemKeySlot **reuse)
+{
+    uint32_t pos = KeyringHash(id, idLen);
+    if (reuse != NULL) {
+        *reuse = NULL;
+    }
+    for (uint32_t i = 0; i <= ring->mask; i++) {
+        MlKemKeySlot *slot = &ring->slots[(pos + i) & ring->mask];
+        uint32_t state = KEYRING_LOAD(&slot->state);
+        if (KEYRING_KIND(state) == KEYRING_SLOT_EMPTY || KEYRING_KIND(state) == KEYRING_SLOT_DELETED) {
+            if (reuse != NULL && *reuse == NULL) {
+                *reuse = slot;
+            }
+            if (KEYRING_KIND(state) == KEYRING_SLOT_EMPTY) {
+                return NULL;
+            }
+            continue;
+        }
+        if (!KeyringPin(slot, false)) {
+            continue;
+        }
+        if (slot->idLen == idLen && memcmp(slot->id, id, idLen) == 0) {
+            return slot;
+        }
+        KeyringUnpin(slot);
+    }
+    return NULL;
+}
+
+static int32_t KeyringCheckId(const CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen)
+{
+    if (ring == NULL || id == NULL) {
+        return CRYPT_NULL_INPUT;
+    }
+    if (idLen == 0 || idLen > CRYPT_ML_KEM_KEY_ID_MAX_LEN) {
+        return CRYPT_INVALID_ARG;
+    }
+    return CRYPT_SUCCESS;
+}
+
+CRYPT_ML_KEM_Keyring *CRYPT_ML_KEM_KeyringNew(void *libCtx, int32_t keyType, uint32_t maxKeys)
+{
+    uint32_t blockSize = CRYPT_ML_KEM_GetCtxBlockSize(keyType);
+    if (blockSize == 0) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NOT_SUPPORT);
+        return NULL;
+    }
+    if (maxKeys == 0 || maxKeys > KEYRING_MAX_KEYS) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return NULL;
+    }
+    CRYPT_ML_KEM_Keyring *ring = BSL_SAL_Calloc(1, sizeof(CRYPT_ML_KEM_Keyring));
+    if (ring == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return NULL;
+    }
+    ring->libCtx = libCtx;
+    ring->keyType = keyType;
+    ring->blockSize = (blockSize + KEYRING_ALIGN - 1) & ~((uint32_t)KEYRING_ALIGN - 1);
+    uint32_t slotNum = 2;
+    while (slotNum < 2 * maxKeys) {
+        slotNum <<= 1;
+    }
+    ring->mask = slotNum - 1;
+    ring->slots = BSL_SAL_Calloc(slotNum, sizeof(MlKemKeySlot));
+    ring->storage = BSL_SAL_Malloc((size_t)ring->blockSize * maxKeys + KEYRING_ALIGN - 1);
+    if (ring->slots == NULL || ring->storage == NULL || MLKEM_RingInit(&ring->freeBlocks, maxKeys) != CRYPT_SUCCESS) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        CRYPT_ML_KEM_KeyringFree(ring);
+        return NULL;
+    }
+    uint8_t *base = ring->storage + (KEYRING_ALIGN - (uintptr_t)ring->storage % KEYRING_ALIGN) % KEYRING_ALIGN;
+    for (uint32_t i = 0; i < maxKeys; i++) {
+        (void)MLKEM_RingPush(&ring->freeBlocks, base + (size_t)ring->blockSize * i);
+    }
+    return ring;
+}
+
+// Builds the expanded key in block, the ID is H(ek) when id is NULL.
+static int32_t KeyringLoadKey(CRYPT_ML_KEM_Keyring *ring, void *block, const CRYPT_KemDecapsKey *dk,
+    CRYPT_ML_KEM_Ctx **out)
+{
+    CRYPT_ML_KEM_Ctx *ctx = CRYPT_ML_KEM_InitCtxBlock(block, ring->blockSize, ring->libCtx, ring->keyType);
+    if (ctx == NULL) {
+        return CRYPT_INVALID_ARG;
+    }
+    int32_t ret = CRYPT_ML_KEM_SetDecapsKey(ctx, dk);
+    if (ret == CRYPT_SUCCESS) {
+        ret = MLKEM_ExpandKey(ctx);
+    }
+    if (ret != CRYPT_SUCCESS) {
+        CRYPT_ML_KEM_FreeCtx(ctx);
+        return ret;
+    }
+    *out = ctx;
+    return CRYPT_SUCCESS;
+}
+
+// Changes the kind of a slot, keeping the lookups that pin it.
+static void KeyringSetKind(MlKemKeySlot *slot, uint32_t kind)
+{
+    uint32_t state = KEYRING_LOAD(&slot->state);
+    while (!KEYRING_CAS(&slot->state, &state, kind | (state & KEYRING_USERS_MASK))) {
+    }
+}
+
+/*
+ * Probes again for id once the reserved slot own carries it. Another slot with the same ID that is READY, or
+ * reserved before own in the probe sequence, wins. One reserved after own is waited for until it is published or
+ * dropped: waits only go forward along the probe sequence, so two insertions never wait for each other, and of two
+ * insertions at least the one that probes last sees the other.
+ */
+static int32_t KeyringClaim(const CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen,
+    const MlKemKeySlot *own)
+{
+    uint32_t pos = KeyringHash(id, idLen);
+    bool beforeOwn = true;
+    for (uint32_t i = 0; i <= ring->mask; i++) {
+        MlKemKeySlot *slot = &ring->slots[(pos + i) & ring->mask];
+        if (slot == own) {
+            beforeOwn = false;
+            continue;
+        }
+        uint32_t spins = 1;
+        for (;;) {
+            uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_SEQ_CST);
+            if (KEYRING_KIND(state) == KEYRING_SLOT_EMPTY) {
+                return CRYPT_SUCCESS;
+            }
+            if (KEYRING_KIND(state) == KEYRING_SLOT_DELETED) {
+                break;
+            }
+            if (!KeyringPin(slot, true)) {
+                if (KEYRING_KIND(state) == KEYRING_SLOT_RESERVED) {
+                    MLKEM_SpinPause(&spins);  // The ID is being written.
+                }
+                continue;
+            }
+            bool same = slot->idLen == idLen && memcmp(slot->id, id, idLen) == 0;
+            uint32_t kind = KEYRING_KIND(KEYRING_LOAD(&slot->state));
+            KeyringUnpin(slot);
+            if (!same || kind == KEYRING_SLOT_DELETED) {
+                break;
+            }
+            if (kind == KEYRING_SLOT_READY || beforeOwn) {
+                return CRYPT_MLKEM_KEY_REPEATED_SET;
+            }
+            MLKEM_SpinPause(&spins);
+        }
+    }
+    return CRYPT_SUCCESS;
+}
+
+static int32_t KeyringPublish(CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen, CRYPT_ML_KEM_Ctx *ctx)
+{
+    for (;;) {
+        MlKemKeySlot *reuse = NULL;
+        MlKemKeySlot *slot = KeyringFind(ring, id, idLen, &reuse);
+        if (slot != NULL) {
+            KeyringUnpin(slot);
+            return CRYPT_MLKEM_KEY_REPEATED_SET;
+        }
+        if (reuse == NULL) {
+            return CRYPT_MLKEM_LEN_NOT_ENOUGH;  // Every slot is in use, only possible with maxKeys tombstones.
+        }
+        uint32_t state = KEYRING_LOAD(&reuse->state);
+        if ((KEYRING_KIND(state) != KEYRING_SLOT_EMPTY && state != KEYRING_SLOT_DELETED) ||
+            !KEYRING_CAS(&reuse->state, &state, KEYRING_SLOT_RESERVED)) {
+            continue;  // Taken by another insertion, or a tombstone still pinned by a lookup.
+        }
+        reuse->idLen = (uint8_t)idLen;
+        (void)memcpy_s(reuse->id, sizeof(reuse->id), id, idLen);
+        reuse->ctx = ctx;
+        // Sequentially consistent as the loads of KeyringClaim: of two insertions of one ID, one sees the other.
+        (void)__atomic_fetch_or(&reuse->state, KEYRING_ID_SET, __ATOMIC_SEQ_CST);
+        int32_t ret = KeyringClaim(ring, id, idLen, reuse);
+        KeyringSetKind(reuse, (ret == CRYPT_SUCCESS) ? KEYRING_SLOT_READY : KEYRING_SLOT_DELETED);
+        return ret;
+    }
+}
+
+int32_t CRYPT_ML_KEM_KeyringInsert(CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen,
+    const CRYPT_KemDecapsKey *dk)
+{
+    if (ring == NULL || dk == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return CRYPT_NULL_INPUT;
+    }
+    if (id != NULL && (idLen == 0 || idLen > CRYPT_ML_KEM_KEY_ID_MAX_LEN)) {
+        BSL_ERR_PUSH_ERROR(CRYPT_INVALID_ARG);
+        return CRYPT_INVALID_ARG;
+    }
+    void *block = MLKEM_RingPop(&ring->freeBlocks);
+    if (block == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_LEN_NOT_ENOUGH);
+        return CRYPT_MLKEM_LEN_NOT_ENOUGH;
+    }
+    CRYPT_ML_KEM_Ctx *ctx = NULL;
+    int32_t ret = KeyringLoadKey(ring, block, dk, &ctx);
+    if (ret == CRYPT_SUCCESS) {
+        ret = (id != NULL) ? KeyringPublish(ring, id, idLen, ctx) :
+            KeyringPublish(ring, ctx->ekHash, CRYPT_SHA3_256_DIGESTSIZE, ctx);
+        if (ret != CRYPT_SUCCESS) {
+            CRYPT_ML_KEM_FreeCtx(ctx);
+        }
+    }
+    if (ret != CRYPT_SUCCESS) {
+        (void)MLKEM_RingPush(&ring->freeBlocks, block);
+        BSL_ERR_PUSH_ERROR(ret);
+    }
+    return ret;
+}
+
+int32_t CRYPT_ML_KEM_KeyringRemove(CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen)
+{
+    int32_t ret = KeyringCheckId(ring, id, idLen);
+    if (ret != CRYPT_SUCCESS) {
+        BSL_ERR_PUSH_ERROR(ret);
+        return ret;
+    }
+    MlKemKeySlot *slot = KeyringFind(ring, id, idLen, NULL);
+    if (slot == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_NOT_SET);
+        return CRYPT_MLKEM_KEY_NOT_SET;
+    }
+    CRYPT_ML_KEM_Ctx *ctx = slot->ctx;
+    uint32_t state = KEYRING_LOAD(&slot->state);
+    bool removed = false;
+    while (KEYRING_KIND(state) == KEYRING_SLOT_READY) {
+        if (KEYRING_CAS(&slot->state, &state, KEYRING_SLOT_DELETED | (state & KEYRING_USERS_MASK))) {
+            removed = true;
+            break;
+        }
+    }
+    KeyringUnpin(slot);
+    if (!removed) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_NOT_SET);
+        return CRYPT_MLKEM_KEY_NOT_SET;  // Removed by another thread in the meantime.
+    }
+    // Wait for the lookups that pinned the slot before it became a tombstone.
+    uint32_t spins = 1;
+    while ((KEYRING_LOAD(&slot->state) & KEYRING_USERS_MASK) != 0) {
+        MLKEM_SpinPause(&spins);
+    }
+    void *block = (void *)ctx;
+    CRYPT_ML_KEM_FreeCtx(ctx);  // Cleanses the key, the storage belongs to the keyring.
+    (void)MLKEM_RingPush(&ring->freeBlocks, block);
+    return CRYPT_SUCCESS;
+}
+
+int32_t CRYPT_ML_KEM_KeyringDecaps(CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen,
+    uint8_t *cipher, uint32_t cipherLen, uint8_t *share, uint32_t *shareLen)
+{
+    int32_t ret = KeyringCheckId(ring, id, idLen);
+    if (ret != CRYPT_SUCCESS) {
+        BSL_ERR_PUSH_ERROR(ret);
+        return ret;
+    }
+    MlKemKeySlot *slot = KeyringFind(ring, id, idLen, NULL);
+    if (slot == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEY_NOT_SET);
+        return CRYPT_MLKEM_KEY_NOT_SET;
+    }
+    ret = CRYPT_ML_KEM_Decaps(slot->ctx, cipher, cipherLen, share, shareLen);
+    KeyringUnpin(slot);
+    return ret;
+}
+
+void CRYPT_ML_KEM_KeyringFree(CRYPT_ML_KEM_Keyring *ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+    if (ring->slots != NULL) {
+        for (uint32_t i = 0; i <= ring->mask; i++) {
+            if (KEYRING_KIND(ring->slots[i].state) == KEYRING_SLOT_READY) {
+                CRYPT_ML_KEM_FreeCtx(ring->slots[i].ctx);
+            }
+        }
+    }
+    MLKEM_RingDeinit(&ring->freeBlocks);
+    BSL_SAL_FREE(ring->slots);
+    BSL_SAL_FREE(ring->storage);
+    BSL_SAL_FREE(ring);
+}
+#endif
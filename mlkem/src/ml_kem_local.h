@@ -18,25 +18,32 @@
 #include "crypt_mlkem.h"
 #include "sal_atomic.h"
 #include "crypt_local_types.h"
+#include "crypt_sha3.h"
 
 #define MLKEM_N        256
 #define MLKEM_N_HALF   128
 #define MLKEM_CIPHER_LEN   384
 
 #define MLKEM_SEED_LEN 32
+#define MLKEM_DK_SEED_LEN (MLKEM_SEED_LEN * 2)  // Seed form d || z of a decapsulation key, FIPS 203 section 7.1
 #define MLKEM_SHARED_KEY_LEN 32
 #define MLKEM_PRF_BLOCKSIZE 64
+#define MLKEM_PRF_RATE 136  // SHAKE256 rate in bytes.
+#define MLKEM_G_RATE 72     // SHA3-512 rate in bytes.
+#define MLKEM_BATCH_MAX 4   // Operations processed together by the batch APIs.
 #define MLKEM_ENCODE_BLOCKSIZE 32
 
-// 9 = 8.38 = (((MLKEM_BITS_OF_Q * (MLKEM_N/8) * 2^MLKEM_BITS_OF_Q) / MLKEM_Q) + 64) / 64;
-// array_B_arbitrary_length = 9 * 64 + 2 = 578
-#define MLKEM_XOF_OUTPUT_LENGTH 578
+#define MLKEM_XOF_BLOCKSIZE 168  // SHAKE128 rate in bytes, a multiple of the 3 bytes consumed by Parse.
+// 3 = (((MLKEM_BITS_OF_Q * (MLKEM_N/8) * 2^MLKEM_BITS_OF_Q) / MLKEM_Q) + MLKEM_XOF_BLOCKSIZE) / MLKEM_XOF_BLOCKSIZE;
+// Blocks squeezed up front for each matrix entry, further blocks are squeezed one by one only when needed.
+#define MLKEM_XOF_INIT_BLOCKS 3
 
 #define MLKEM_Q    3329
 #define MLKEM_Q_INV_BETA (-3327)  //(-MLKEM_Q) ^{-1} mod BETA, BETA = 2^{16}
 #define MLKEM_Q_HALF ((MLKEM_Q + 1) / 2)
 #define MLKEM_BITS_OF_Q 12
 #define MLKEM_INVN 3303  // MLKEM_N_HALF * MLKEM_INVN = 1 mod MLKEM_Q
+#define MLKEM_MONT_R2 1353  // 2^32 mod MLKEM_Q, MontgomeryReduction(a * MLKEM_MONT_R2) = a * 2^16 mod MLKEM_Q
 #define MLKEM_K_MAX    4
 typedef int32_t (*MlKemHashFunc)(uint32_t id, const uint8_t *in, uint32_t inLen, uint8_t *out, uint32_t *outLen);
 
@@ -56,12 +63,38 @@ static inline int16_t MontgomeryReduction(int32_t a)
     return t;
 }
 
+/*
+ * The matrix, vectorS and vectorT are kept in the Montgomery domain (multiplied by 2^16 mod MLKEM_Q),
+ * so that the base multiplication with a normal-domain operand needs no conversion.
+ * The public part (matrix || vectorT) and the secret part (vectorS) live in separate buffers: an encapsulation-only
+ * context never allocates vectorS, and only the secret buffer has to be cleansed.
+ * With noMatrix the matrix is not stored, every operation regenerates the rows it needs from rho.
+ */
+#define MLKEM_MATRIX_POLYS(k, st) ((st)->noMatrix ? 0 : (k) * (k))
+#define MLKEM_PUBLIC_POLYS(k, st) (MLKEM_MATRIX_POLYS(k, st) + (k))
+#define MLKEM_SECRET_POLYS(k) (k)
+/*
+ * The optional mulcache holds, for every stored polynomial, its odd coefficients already multiplied by the zeta of
+ * their pair (MLKEM_N_HALF values per polynomial), so that the base multiplications with the static key operands
+ * skip that step. It is built with the expanded key, shared with it and kept in its own heap buffer.
+ */
+#define MLKEM_CACHE_POLYS(k, st) (MLKEM_PUBLIC_POLYS(k, st) + MLKEM_SECRET_POLYS(k))
 typedef struct {
-    int16_t *bufAddr;
+    bool noMatrix;
+    bool mulCache;  // Build the mulcache with the expanded key
+    uint8_t rho[MLKEM_SEED_LEN];  // Seed of the matrix
+    BSL_SAL_RefCount *bufRef;  // The buffers are shared by the contexts duplicated from the expanded key.
+    int16_t *bufAddr;     // matrix || vectorT
+    int16_t *secretAddr;  // vectorS, NULL for an encapsulation key
+    int16_t *blockPub;     // Storage of bufAddr in the single-allocation layout, NULL otherwise
+    int16_t *blockSecret;  // Storage of secretAddr in the single-allocation layout, NULL otherwise
     int16_t *matrix[MLKEM_K_MAX][MLKEM_K_MAX];
     int16_t *vectorS[MLKEM_K_MAX];
-    int16_t *vectorE[MLKEM_K_MAX];
     int16_t *vectorT[MLKEM_K_MAX];
+    int16_t *cacheAddr;  // Mulcache of matrix || vectorT || vectorS, NULL if not built
+    int16_t *matrixCache[MLKEM_K_MAX][MLKEM_K_MAX];
+    int16_t *vectorSCache[MLKEM_K_MAX];
+    int16_t *vectorTCache[MLKEM_K_MAX];
 } MLKEM_MatrixSt;
 
 typedef struct {
@@ -88,25 +121,143 @@ struct CryptMlKemCtx {
     BSL_SAL_RefCount references;
     void *libCtx;
     MLKEM_MatrixSt keyData;
+    uint8_t ekHash[CRYPT_SHA3_256_DIGESTSIZE];  // H(ek), computed once when the key is generated or expanded.
+    bool dkVerified;  // The h stored in dk matches H(ek), checked once when the key is generated or expanded.
+    uint32_t expandState;  // MLKEM_KEY_*, keyData, ekHash and dkVerified are valid once MLKEM_KEY_EXPANDED.
+    uint8_t seed[MLKEM_DK_SEED_LEN];  // d || z, valid if hasSeed
+    bool hasSeed;  // The key was generated or imported from its seed, dk can be rebuilt by MLKEM_ExpandSeed.
+    uint8_t dkFormat;  // CRYPT_ML_KEM_DK_FORMAT_*, of CRYPT_ML_KEM_GetDecapsKey
+    uint8_t layout;  // MLKEM_LAYOUT_*
+    void *blockAddr;  // Allocation of an MLKEM_LAYOUT_BLOCK context
+    uint8_t *blockEk;  // Storage of ek and dk in the single-allocation layout, NULL otherwise
+    uint8_t *blockDk;
 };
+
+#define MLKEM_LAYOUT_HEAP 0    // ctx, ek, dk and keyData are separate allocations
+#define MLKEM_LAYOUT_BLOCK 1   // One 64-byte aligned allocation holds ctx, ek, dk and keyData
+#define MLKEM_LAYOUT_CALLER 2  // As MLKEM_LAYOUT_BLOCK, in memory provided by the caller
+#define MLKEM_LAYOUT_MAPPED 3  // Heap ctx, ek, dk and keyData point into a read-only expanded key image
+
+/*
+ * Backs off in a spin wait on another thread: the wait between two loads doubles up to MLKEM_SPIN_MAX pause
+ * instructions, which keeps the spinning core off the cache line and frees its resources for a sibling thread.
+ */
+#define MLKEM_SPIN_MAX 64
+static inline void MLKEM_SpinPause(uint32_t *spins)
+{
+    for (uint32_t i = 0; i < *spins; i++) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__("yield" ::: "memory");
+#else
+        __asm__ __volatile__("" ::: "memory");
+#endif
+    }
+    if (*spins < MLKEM_SPIN_MAX) {
+        *spins <<= 1;
+    }
+}
+
+/*
+ * An imported key is only checked and copied, keyData is expanded from ek or dk by the first operation that
+ * needs it. MLKEM_ExpandKey runs the expansion once even when several threads use a new context concurrently.
+ * The release store of MLKEM_KEY_EXPANDED publishes keyData, ekHash, dkVerified and a dk rebuilt from the seed;
+ * encapsulation and decapsulation read them only after the acquire load that sees it, and never write the context.
+ */
+#define MLKEM_KEY_NOT_EXPANDED 0
+#define MLKEM_KEY_EXPANDING 1
+#define MLKEM_KEY_EXPANDED 2
+int32_t MLKEM_ExpandKey(CRYPT_ML_KEM_Ctx *ctx);
+int32_t MLKEM_CheckBits12(const uint8_t *a, uint8_t num);
 int32_t MLKEM_DecodeDk(CRYPT_ML_KEM_Ctx *ctx, const uint8_t *dk, uint32_t dkLen);
 int32_t MLKEM_DecodeEk(CRYPT_ML_KEM_Ctx *ctx, const uint8_t *ek, uint32_t ekLen);
 void MLKEM_ComputNTT(int16_t *a, const int16_t *psi);
 void MLKEM_ComputINTT(int16_t *a, const int16_t *psi);
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+void MLKEM_ComputNTTAvx2(int16_t *a, const int16_t *psi);
+void MLKEM_ComputINTTAvx2(int16_t *a, const int16_t *psi);
+
+// 4 independent SHAKE instances with the same rate, processed in parallel by an AVX2 Keccak-f[1600].
+#define MLKEM_KECCAK_WAYS 4
+typedef struct {
+    uint64_t state[25][MLKEM_KECCAK_WAYS];
+} MLKEM_KeccakX4Ctx;
+// Absorbs inLen bytes of each input and pads the SHAKE suffix. rate is in bytes.
+void MLKEM_ShakeX4Absorb(MLKEM_KeccakX4Ctx *ctx, uint32_t rate, const uint8_t *in[MLKEM_KECCAK_WAYS],
+    uint32_t inLen);
+// Squeezes blocks * rate bytes into each output.
+void MLKEM_ShakeX4Squeeze(MLKEM_KeccakX4Ctx *ctx, uint32_t rate, uint8_t *out[MLKEM_KECCAK_WAYS], uint32_t blocks);
+// One-shot SHA3 (pad = MLKEM_SHA3_PAD) or SHAKE (pad = MLKEM_SHAKE_PAD) of 4 inputs, outLen must not exceed rate.
+#define MLKEM_SHA3_PAD 0x06
+#define MLKEM_SHAKE_PAD 0x1F
+void MLKEM_HashX4(uint32_t rate, uint8_t pad, const uint8_t *in[MLKEM_KECCAK_WAYS], uint32_t inLen,
+    uint8_t *out[MLKEM_KECCAK_WAYS], uint32_t outLen);
+#endif
 void MLKEM_SamplePolyCBD(int16_t *polyF, uint8_t *buf, uint8_t eta);
-void MLKEM_TransposeMatrixMulAdd(uint8_t k, int16_t **matrix, int16_t **polyVec, int16_t **polyVecOut,
-                                 const int16_t *factor);
+void MLKEM_PolyToMont(int16_t *poly);
+void MLKEM_MatrixRowMulAdd(uint8_t k, int16_t **row, int16_t **polyVec, int16_t *polyOut, const int16_t *factor);
+void MLKEM_TransposeMatrixMulAddBatch(uint8_t k, int16_t **matrix, int16_t **matrixCache, int16_t **polyVec[],
+                                      int16_t **polyVecOut[], uint32_t num, const int16_t *factor);
 void MLKEM_MatrixMulAdd(uint8_t k, int16_t **matrix, int16_t **polyVec, int16_t **polyVecOut, const int16_t *factor);
-void MLKEM_VectorInnerProductAdd(uint8_t k, int16_t **polyVec1, int16_t **polyVec2, int16_t *polyOut,
-                                 const int16_t *factor);
+void MLKEM_VectorInnerProductAdd(uint8_t k, int16_t **polyVec1, int16_t **cache1, int16_t **polyVec2,
+                                 int16_t *polyOut, const int16_t *factor);
+void MLKEM_PolyMulCache(int16_t cache[MLKEM_N_HALF], const int16_t *poly, const int16_t *factor);
 
 int32_t MLKEM_KeyGenInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *d, uint8_t *z);
 
+int32_t MLKEM_ExpandSeed(CRYPT_ML_KEM_Ctx *ctx);
+
 int32_t MLKEM_EncapsInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t *ctLen, uint8_t *sk, uint32_t *skLen,
     uint8_t *m);
 
+// num encapsulations with the messages m[32 * i], ct and sk receive num ciphertexts and shared keys back to back.
+int32_t MLKEM_EncapsBatchInternal(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint8_t *ct, uint8_t *sk, const uint8_t *m);
+
 int32_t MLKEM_DecapsInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t ctLen, uint8_t *sk, uint32_t *skLen);
 
+// num decapsulations of the ciphertexts in ct back to back, sk receives the num shared keys back to back.
+int32_t MLKEM_DecapsBatchInternal(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, const uint8_t *ct, uint8_t *sk);
+
 int32_t MLKEM_CreateMatrixBuf(uint8_t k, MLKEM_MatrixSt *st);
 
+int32_t MLKEM_CreateSecretBuf(uint8_t k, MLKEM_MatrixSt *st);
+
+void MLKEM_FreeMatrixBuf(uint8_t k, MLKEM_MatrixSt *st);
+
+int32_t MLKEM_CopyMatrixBuf(uint8_t k, MLKEM_MatrixSt *src, MLKEM_MatrixSt *dst);
+
+int32_t MLKEM_BuildMulCache(uint8_t k, MLKEM_MatrixSt *st);
+
+const CRYPT_MlKemInfo *MLKEM_GetInfoByBits(uint32_t bits);
+const CRYPT_MlKemInfo *MLKEM_GetInfoByType(int32_t keyType);
+
+void MLKEM_CtxRecycle(CRYPT_ML_KEM_Ctx *ctx);
+
+#if defined(HITLS_CRYPTO_MLKEM_POOL) || defined(HITLS_CRYPTO_MLKEM_KEYRING)
+typedef struct {
+    uint64_t seq;
+    void *item;
+} MLKEM_RingCell;
+
+// Bounded lock-free MPMC queue of pointers, see ml_kem_ring.c.
+typedef struct {
+    uint32_t mask;
+    MLKEM_RingCell *cells;
+    uint64_t enqPos;
+    uint64_t deqPos;
+} MLKEM_Ring;
+
+// The capacity is minCapacity rounded up to a power of 2.
+int32_t MLKEM_RingInit(MLKEM_Ring *ring, uint32_t minCapacity);
+
+void MLKEM_RingDeinit(MLKEM_Ring *ring);
+
+// Returns false if the ring is full.
+bool MLKEM_RingPush(MLKEM_Ring *ring, void *item);
+
+// Returns NULL if the ring is empty.
+void *MLKEM_RingPop(MLKEM_Ring *ring);
+#endif
+
 #endif    // ML_KEM_LOCAL_H
@@ -15,9 +15,10 @@
 
 #include "hitls_build.h"
 #ifdef HITLS_CRYPTO_MLKEM
+#include "crypt_utils.h"
 #include "ml_kem_local.h"
 
-void MLKEM_ComputNTT(int16_t *a, const int16_t *psi)
+static void ComputNTTScalar(int16_t *a, const int16_t *psi)
 {
     uint32_t start = 0;
     uint32_t j = 0;
@@ -38,7 +39,7 @@ void MLKEM_ComputNTT(int16_t *a, const int16_t *psi)
     }
 }
 
-void MLKEM_ComputINTT(int16_t *a, const int16_t *psi)
+static void ComputINTTScalar(int16_t *a, const int16_t *psi)
 {
     int16_t t;
     int16_t zeta;
@@ -61,4 +62,27 @@ void MLKEM_ComputINTT(int16_t *a, const int16_t *psi)
         a[j] = MontgomeryReduction(a[j] * f);
     }
 }
+
+// The AVX2 backend is bit-identical to the scalar one, the scalar code is the fallback.
+void MLKEM_ComputNTT(int16_t *a, const int16_t *psi)
+{
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+    if (IsSupportAVX2()) {
+        MLKEM_ComputNTTAvx2(a, psi);
+        return;
+    }
+#endif
+    ComputNTTScalar(a, psi);
+}
+
+void MLKEM_ComputINTT(int16_t *a, const int16_t *psi)
+{
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+    if (IsSupportAVX2()) {
+        MLKEM_ComputINTTAvx2(a, psi);
+        return;
+    }
+#endif
+    ComputINTTScalar(a, psi);
+}
 #endif
\ No newline at end of file
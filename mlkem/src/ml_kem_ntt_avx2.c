@@ -0,0 +1,206 @@
+/*
+ * This file is part of the openHiTLS project.
+ *
+ * openHiTLS is licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *     http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "hitls_build.h"
+#if defined(HITLS_CRYPTO_MLKEM) && defined(HITLS_CRYPTO_MLKEM_X8664)
+#include <immintrin.h>
+#include "ml_kem_local.h"
+
+/*
+ * AVX2 implementation of MLKEM_ComputNTT / MLKEM_ComputINTT.
+ * Every ymm register holds 16 int16 coefficients. The butterflies and the reductions are the same
+ * operations as the scalar code, lane by lane, so both backends produce bit-identical results.
+ * Layers with len >= 16 pair whole registers. The layers with len = 8, 4, 2 are merged per pair of
+ * registers (32 coefficients): the coefficients are shuffled so that the butterfly partners sit in
+ * the same lane of two registers, and are shuffled back after the last layer.
+ */
+#define MLKEM_AVX2_FUNC __attribute__((target("avx2")))
+#define MLKEM_AVX2_LANES 16
+#define MLKEM_AVX2_REGS (MLKEM_N / MLKEM_AVX2_LANES)
+#define MLKEM_BARRETT_V 20159  // ((1 << 26) + MLKEM_Q / 2) / MLKEM_Q
+#define MLKEM_INTT_F 512       // Mont / 128
+
+// Same as MontgomeryReduction(a * b) for each lane.
+static inline MLKEM_AVX2_FUNC __m256i MontMulAvx2(__m256i a, __m256i b)
+{
+    __m256i lo = _mm256_mullo_epi16(a, b);
+    __m256i hi = _mm256_mulhi_epi16(a, b);
+    lo = _mm256_mullo_epi16(lo, _mm256_set1_epi16(MLKEM_Q_INV_BETA));
+    lo = _mm256_mulhi_epi16(lo, _mm256_set1_epi16(MLKEM_Q));
+    return _mm256_sub_epi16(hi, lo);
+}
+
+// Same as BarrettReduction(a) for each lane: (v * a + 2^25) >> 26 == ((v * a >> 16) + 2^9) >> 10.
+static inline MLKEM_AVX2_FUNC __m256i BarrettAvx2(__m256i a)
+{
+    __m256i t = _mm256_mulhi_epi16(a, _mm256_set1_epi16(MLKEM_BARRETT_V));
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(1 << 9));
+    t = _mm256_srai_epi16(t, 10);
+    t = _mm256_mullo_epi16(t, _mm256_set1_epi16(MLKEM_Q));
+    return _mm256_sub_epi16(a, t);
+}
+
+// Cooley-Tukey butterfly used by the NTT.
+static inline MLKEM_AVX2_FUNC void ButterflyCT(__m256i *x, __m256i *y, __m256i zeta)
+{
+    __m256i t = MontMulAvx2(*y, zeta);
+    *y = _mm256_sub_epi16(*x, t);
+    *x = _mm256_add_epi16(*x, t);
+}
+
+// Gentleman-Sande butterfly used by the INTT.
+static inline MLKEM_AVX2_FUNC void ButterflyGS(__m256i *x, __m256i *y, __m256i zeta)
+{
+    __m256i t = *x;
+    *x = BarrettAvx2(_mm256_add_epi16(t, *y));
+    *y = MontMulAvx2(_mm256_sub_epi16(*y, t), zeta);
+}
+
+// Lane i of each 128-bit half holds zeta[0] or zeta[1].
+static inline MLKEM_AVX2_FUNC __m256i ExpandZeta8(int16_t zeta0, int16_t zeta1)
+{
+    __m256i v = _mm256_castsi128_si256(_mm_set1_epi16(zeta0));
+    return _mm256_inserti128_si256(v, _mm_set1_epi16(zeta1), 1);
+}
+
+// Each of the 4 zetas is repeated 4 times.
+static inline MLKEM_AVX2_FUNC __m256i ExpandZeta4(__m128i zeta)
+{
+    __m256i v = _mm256_cvtepu16_epi64(zeta);
+    v = _mm256_shufflelo_epi16(v, 0);
+    return _mm256_shufflehi_epi16(v, 0);
+}
+
+// Each of the 8 zetas is repeated 2 times.
+static inline MLKEM_AVX2_FUNC __m256i ExpandZeta2(__m128i zeta)
+{
+    __m256i v = _mm256_cvtepu16_epi32(zeta);
+    return _mm256_or_si256(v, _mm256_slli_epi32(v, 16));
+}
+
+/*
+ * a = coefficients 0..15, b = coefficients 16..31 of a 32-coefficient block.
+ * After the shuffle, lane i of *x and lane i of *y are the butterfly partners of the len = 2 layer.
+ */
+static inline MLKEM_AVX2_FUNC void ShuffleToLen2(__m256i a, __m256i b, __m256i *x, __m256i *y)
+{
+    __m256i lo = _mm256_permute2x128_si256(a, b, 0x20);
+    __m256i hi = _mm256_permute2x128_si256(a, b, 0x31);
+    __m256i p = _mm256_unpacklo_epi64(lo, hi);
+    __m256i q = _mm256_unpackhi_epi64(lo, hi);
+    *x = _mm256_blend_epi32(p, _mm256_slli_epi64(q, 32), 0xAA);
+    *y = _mm256_blend_epi32(_mm256_srli_epi64(p, 32), q, 0xAA);
+}
+
+static void MLKEM_AVX2_FUNC NttLowLayers(__m256i *a, __m256i *b, const int16_t *psi, uint32_t block)
+{
+    // len = 8: the partners are the two 128-bit halves of a (and of b).
+    __m256i x = _mm256_permute2x128_si256(*a, *b, 0x20);
+    __m256i y = _mm256_permute2x128_si256(*a, *b, 0x31);
+    ButterflyCT(&x, &y, ExpandZeta8(psi[16 + 2 * block], psi[16 + 2 * block + 1]));
+    // len = 4: the partners are the 64-bit groups of x and y.
+    __m256i p = _mm256_unpacklo_epi64(x, y);
+    __m256i q = _mm256_unpackhi_epi64(x, y);
+    ButterflyCT(&p, &q, ExpandZeta4(_mm_loadl_epi64((const __m128i *)(psi + 32 + 4 * block))));
+    // len = 2: the partners are the 32-bit groups of p and q.
+    x = _mm256_blend_epi32(p, _mm256_slli_epi64(q, 32), 0xAA);
+    y = _mm256_blend_epi32(_mm256_srli_epi64(p, 32), q, 0xAA);
+    ButterflyCT(&x, &y, ExpandZeta2(_mm_loadu_si128((const __m128i *)(psi + 64 + 8 * block))));
+    x = BarrettAvx2(x);
+    y = BarrettAvx2(y);
+    // Restore the natural coefficient order.
+    p = _mm256_blend_epi32(x, _mm256_slli_epi64(y, 32), 0xAA);
+    q = _mm256_blend_epi32(_mm256_srli_epi64(x, 32), y, 0xAA);
+    x = _mm256_unpacklo_epi64(p, q);
+    y = _mm256_unpackhi_epi64(p, q);
+    *a = _mm256_permute2x128_si256(x, y, 0x20);
+    *b = _mm256_permute2x128_si256(x, y, 0x31);
+}
+
+void MLKEM_AVX2_FUNC MLKEM_ComputNTTAvx2(int16_t *a, const int16_t *psi)
+{
+    __m256i r[MLKEM_AVX2_REGS];
+    uint32_t k = 1;
+    for (uint32_t i = 0; i < MLKEM_AVX2_REGS; i++) {
+        r[i] = _mm256_loadu_si256((const __m256i *)(a + MLKEM_AVX2_LANES * i));
+    }
+    // len = 128, 64, 32, 16, counted in registers.
+    for (uint32_t len = MLKEM_AVX2_REGS / 2; len >= 1; len >>= 1) {
+        for (uint32_t start = 0; start < MLKEM_AVX2_REGS; start += 2 * len) {
+            __m256i zeta = _mm256_set1_epi16(psi[k++]);
+            for (uint32_t j = start; j < start + len; j++) {
+                ButterflyCT(&r[j], &r[j + len], zeta);
+            }
+        }
+    }
+    // len = 8, 4, 2 and the final reduction.
+    for (uint32_t i = 0; i < MLKEM_AVX2_REGS; i += 2) {
+        NttLowLayers(&r[i], &r[i + 1], psi, i / 2);
+    }
+    for (uint32_t i = 0; i < MLKEM_AVX2_REGS; i++) {
+        _mm256_storeu_si256((__m256i *)(a + MLKEM_AVX2_LANES * i), r[i]);
+    }
+}
+
+static void MLKEM_AVX2_FUNC InttLowLayers(__m256i *a, __m256i *b, const int16_t *psi, uint32_t block)
+{
+    __m256i x;
+    __m256i y;
+    ShuffleToLen2(*a, *b, &x, &y);
+    // len = 2: the zetas are read backwards from psi[127 - 8 * block].
+    __m128i zeta = _mm_loadu_si128((const __m128i *)(psi + 120 - 8 * block));
+    zeta = _mm_shuffle_epi32(zeta, _MM_SHUFFLE(1, 0, 3, 2));
+    zeta = _mm_shufflelo_epi16(zeta, _MM_SHUFFLE(0, 1, 2, 3));
+    zeta = _mm_shufflehi_epi16(zeta, _MM_SHUFFLE(0, 1, 2, 3));
+    ButterflyGS(&x, &y, ExpandZeta2(zeta));
+    // len = 4: the zetas are read backwards from psi[63 - 4 * block].
+    __m256i p = _mm256_blend_epi32(x, _mm256_slli_epi64(y, 32), 0xAA);
+    __m256i q = _mm256_blend_epi32(_mm256_srli_epi64(x, 32), y, 0xAA);
+    zeta = _mm_loadl_epi64((const __m128i *)(psi + 60 - 4 * block));
+    ButterflyGS(&p, &q, ExpandZeta4(_mm_shufflelo_epi16(zeta, _MM_SHUFFLE(0, 1, 2, 3))));
+    // len = 8
+    x = _mm256_unpacklo_epi64(p, q);
+    y = _mm256_unpackhi_epi64(p, q);
+    ButterflyGS(&x, &y, ExpandZeta8(psi[31 - 2 * block], psi[30 - 2 * block]));
+    *a = _mm256_permute2x128_si256(x, y, 0x20);
+    *b = _mm256_permute2x128_si256(x, y, 0x31);
+}
+
+void MLKEM_AVX2_FUNC MLKEM_ComputINTTAvx2(int16_t *a, const int16_t *psi)
+{
+    __m256i r[MLKEM_AVX2_REGS];
+    // The len = 2, 4, 8 layers consume psi[127] down to psi[16].
+    uint32_t k = MLKEM_AVX2_REGS - 1;
+    for (uint32_t i = 0; i < MLKEM_AVX2_REGS; i++) {
+        r[i] = _mm256_loadu_si256((const __m256i *)(a + MLKEM_AVX2_LANES * i));
+    }
+    for (uint32_t i = 0; i < MLKEM_AVX2_REGS; i += 2) {
+        InttLowLayers(&r[i], &r[i + 1], psi, i / 2);
+    }
+    // len = 16, 32, 64, 128, counted in registers.
+    for (uint32_t len = 1; len <= MLKEM_AVX2_REGS / 2; len <<= 1) {
+        for (uint32_t start = 0; start < MLKEM_AVX2_REGS; start += 2 * len) {
+            __m256i zeta = _mm256_set1_epi16(psi[k--]);
+            for (uint32_t j = start; j < start + len; j++) {
+                ButterflyGS(&r[j], &r[j + len], zeta);
+            }
+        }
+    }
+    const __m256i f = _mm256_set1_epi16(MLKEM_INTT_F);
+    for (uint32_t i = 0; i < MLKEM_AVX2_REGS; i++) {
+        _mm256_storeu_si256((__m256i *)(a + MLKEM_AVX2_LANES * i), MontMulAvx2(r[i], f));
+    }
+}
+#endif
@@ -14,7 +14,7 @@
  */
 
 #include "hitls_build.h"
-// #ifdef HITLS_CRYPTO_MLKEM
+#ifdef HITLS_CRYPTO_MLKEM
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -26,25 +26,17 @@
 #include "crypt_errno.h"
 #include "bsl_err_internal.h"
 #include "eal_md_local.h"
+#include "crypt_eal_md.h"
 #include "ml_kem_local.h"
 
 #define BITS_OF_BYTE 8
 #define MLKEM_ETA1_MAX    3
 #define MLKEM_ETA2_MAX    2
-
-// A LUT of the primitive n-th roots of unity (psi) in bit-reversed order.
-static const int16_t PRE_COMPUT_TABLE_NTT[MLKEM_N_HALF] = {
-    1, 1729, 2580, 3289, 2642, 630, 1897, 848, 1062, 1919, 193, 797, 2786, 3260, 569, 1746, 296, 2447, 1339, 1476,
-    3046, 56, 2240, 1333, 1426, 2094, 535, 2882, 2393, 2879, 1974, 821, 289, 331, 3253, 1756, 1197, 2304, 2277, 2055,
-    650, 1977, 2513, 632, 2865, 33, 1320, 1915, 2319, 1435, 807, 452, 1438, 2868, 1534, 2402, 2647, 2617, 1481, 648,
-    2474, 3110, 1227, 910, 17, 2761, 583, 2649, 1637, 723, 2288, 1100, 1409, 2662, 3281, 233, 756, 2156, 3015, 3050,
-    1703, 1651, 2789, 1789, 1847, 952, 1461, 2687, 939, 2308, 2437, 2388, 733, 2337, 268, 641, 1584, 2298, 2037, 3220,
-    375, 2549, 2090, 1645, 1063, 319, 2773, 757, 2099, 561, 2466, 2594, 2804, 1092, 403, 1026, 1143, 2150, 2775, 886,
-    1722, 1212, 1874, 1029, 2110, 2935, 885, 2154
-};
+#define MLKEM_CIPHERTEXT_MAX_LEN 1568  // ML-KEM-1024
+#define MLKEM_PRF_X4_BLOCKS ((MLKEM_PRF_BLOCKSIZE * MLKEM_ETA1_MAX + MLKEM_PRF_RATE - 1) / MLKEM_PRF_RATE)
 
 /* A LUT of the primitive n-th roots of unity (psi) multiplied by montgomery factor in bit-reversed order:
-PRE_COMPUT_TABLE_NTT_MONT[i] = PRE_COMPUT_TABLE_NTT[i] * 2^{16} mod MLKEM_Q;
+PRE_COMPUT_TABLE_NTT_MONT[i] = 17^{BitRev7(i)} * 2^{16} mod MLKEM_Q;
 if (PRE_COMPUT_TABLE_NTT_MONT[i] >= MLKEM_Q / 2) {
     PRE_COMPUT_TABLE_NTT_MONT[i] -= MLKEM_Q
     }
@@ -59,80 +51,214 @@ static const int16_t PRE_COMPUT_TABLE_NTT_MONT[MLKEM_N_HALF] = {
     817,   1097,  603,   610,   1322,  -1285, -1465, 384,   -1215, -136, 1218,  -1335, -874,  220,   -1187, -1659,
     -1185, -1530, -1278, 794,   -1510, -854,  -870,  478,   -108,  -308, 996,   991,   958,   -1460, 1522,  1628};
 
+// The reference count of the buffers is created with the first of them.
+static int32_t MatrixBufRefNew(MLKEM_MatrixSt *st)
+{
+    if (st->bufRef != NULL) {
+        return CRYPT_SUCCESS;
+    }
+    st->bufRef = BSL_SAL_Malloc(sizeof(BSL_SAL_RefCount));
+    if (st->bufRef == NULL) {
+        return BSL_MALLOC_FAIL;
+    }
+    BSL_SAL_ReferencesInit(st->bufRef);
+    return CRYPT_SUCCESS;
+}
+
+// Allocates the public part: the matrix and vectorT use (k * k + k) data blocks, or k without the matrix.
+// Each block has 512 bytes.
 int32_t MLKEM_CreateMatrixBuf(uint8_t k, MLKEM_MatrixSt *st)
 {
-    // A total of (k * k + 3 * k) data blocks are required. Each block has 512 bytes.
     if (st->bufAddr != NULL) {
         return CRYPT_SUCCESS;
     }
-    int16_t *buf = BSL_SAL_Calloc((k * k + 3 * k) * MLKEM_N, sizeof(int16_t));
-
-    if (buf == NULL) {
-        return BSL_MALLOC_FAIL;
+    uint32_t len = MLKEM_PUBLIC_POLYS(k, st) * MLKEM_N;
+    int16_t *buf = st->blockPub;  // Set in the single-allocation layout
+    if (buf != NULL) {
+        (void)memset_s(buf, len * sizeof(int16_t), 0, len * sizeof(int16_t));
+    } else {
+        if (MatrixBufRefNew(st) != CRYPT_SUCCESS) {
+            return BSL_MALLOC_FAIL;
+        }
+        buf = BSL_SAL_Calloc(len, sizeof(int16_t));
+        if (buf == NULL) {
+            return BSL_MALLOC_FAIL;
+        }
     }
     st->bufAddr = buf;  // Used to release memory.
+    uint32_t matrixPolys = MLKEM_MATRIX_POLYS(k, st);
     for (uint8_t i = 0; i < k; i++) {
-        for (uint8_t j = 0; j < k; j++) {
+        for (uint8_t j = 0; j < k && matrixPolys != 0; j++) {
             st->matrix[i][j] = buf + (i * k + j) * MLKEM_N;
         }
-        // vectorS,vectorE,vectorT use 3 * k data blocks.
-        st->vectorS[i] = buf + (k * k + i * 3) * MLKEM_N;
-        st->vectorE[i] = buf + (k * k + i * 3 + 1) * MLKEM_N;
-        st->vectorT[i] = buf + (k * k + i * 3 + 2) * MLKEM_N;
+        st->vectorT[i] = buf + (matrixPolys + i) * MLKEM_N;
     }
     return CRYPT_SUCCESS;
 }
 
+// Allocates the secret part: vectorS uses k data blocks, only needed by a decapsulation key.
+int32_t MLKEM_CreateSecretBuf(uint8_t k, MLKEM_MatrixSt *st)
+{
+    if (st->secretAddr != NULL) {
+        return CRYPT_SUCCESS;
+    }
+    uint32_t len = MLKEM_SECRET_POLYS(k) * MLKEM_N;
+    int16_t *buf = st->blockSecret;
+    if (buf != NULL) {
+        (void)memset_s(buf, len * sizeof(int16_t), 0, len * sizeof(int16_t));
+    } else {
+        if (MatrixBufRefNew(st) != CRYPT_SUCCESS) {
+            return BSL_MALLOC_FAIL;
+        }
+        buf = BSL_SAL_Calloc(len, sizeof(int16_t));
+        if (buf == NULL) {
+            return BSL_MALLOC_FAIL;
+        }
+    }
+    st->secretAddr = buf;
+    for (uint8_t i = 0; i < k; i++) {
+        st->vectorS[i] = buf + i * MLKEM_N;
+    }
+    return CRYPT_SUCCESS;
+}
 
-// Compress
-typedef struct {
-    uint64_t barrettMultiplier;  /* round(2 ^ barrettShift / MLKEM_Q) */
-    uint16_t barrettShift;
-    uint16_t halfQ;              /* rounded (MLKEM_Q / 2) down or up */
-    uint8_t  bits;
-} MLKEM_BARRET_REDUCE;
-
-// The values of du and dv are from NIST.FIPS.203 Table 2.
-static const MLKEM_BARRET_REDUCE MLKEM_BARRETT_TABLE[] = {
-    {80635   /* round(2^28/MLKEM_Q) */, 28, 1665 /* Ceil(MLKEM_Q/2)  */, 1},
-    {1290167 /* round(2^32/MLKEM_Q) */, 32, 1665 /* Ceil(MLKEM_Q/2)  */, 10},  // 10 is mlkem768 du
-    {80635   /* round(2^28/MLKEM_Q) */, 28, 1665 /* Ceil(MLKEM_Q/2)  */, 4},   // 4 is mlkem768 dv
-    {40318   /* round(2^27/MLKEM_Q) */, 27, 1664 /* Floor(MLKEM_Q/2) */, 5},   // 5 is mlkem1024 dv
-    {645084  /* round(2^31/MLKEM_Q) */, 31, 1664 /* Floor(MLKEM_Q/2) */, 11}   // 11 is mlkem1024 du
-};
-
-static int16_t DivMlKemQ(uint16_t x, uint8_t bits, uint16_t halfQ, uint16_t barrettShift, uint64_t barrettMultiplier)
-{
-    uint64_t round = ((uint64_t)x << bits) + halfQ;
-    round *= barrettMultiplier;
-    round >>= barrettShift;
-    return (int16_t)(round & ((1 << bits) - 1));
+// The mulcache also holds the cache of vectorS and is cleansed as a whole.
+static void MulCacheFree(uint8_t k, MLKEM_MatrixSt *st)
+{
+    if (st->cacheAddr != NULL) {
+        BSL_SAL_CleanseData(st->cacheAddr, MLKEM_CACHE_POLYS(k, st) * MLKEM_N_HALF * sizeof(int16_t));
+        BSL_SAL_FREE(st->cacheAddr);
+    }
 }
 
-static int16_t Compress(int16_t x, uint8_t d)
+/*
+ * Drops the reference of st, the buffers are freed with the last one. The public part is freed as is,
+ * only the secret part is cleansed.
+ */
+void MLKEM_FreeMatrixBuf(uint8_t k, MLKEM_MatrixSt *st)
 {
-    int16_t value = 0;
-    uint16_t t = x + ((x >> 15) & MLKEM_Q);
-    /* Computing (x << d) / MLKEM_Q by Barret Reduce */
-    for (uint32_t i = 0; i < sizeof(MLKEM_BARRETT_TABLE) / sizeof(MLKEM_BARRET_REDUCE); i++) {
-        if (d == MLKEM_BARRETT_TABLE[i].bits) {
-            value = DivMlKemQ(t,
-                MLKEM_BARRETT_TABLE[i].bits,
-                MLKEM_BARRETT_TABLE[i].halfQ,
-                MLKEM_BARRETT_TABLE[i].barrettShift,
-                MLKEM_BARRETT_TABLE[i].barrettMultiplier);
-            break;
+    if (st->bufRef == NULL) {
+        // Not allocated, or in the block of a single-allocation context.
+        if (st->secretAddr != NULL) {
+            BSL_SAL_CleanseData(st->secretAddr, MLKEM_SECRET_POLYS(k) * MLKEM_N * sizeof(int16_t));
+        }
+        MulCacheFree(k, st);
+        st->secretAddr = NULL;
+        st->bufAddr = NULL;
+        return;
+    }
+    int ret = 0;
+    BSL_SAL_AtomicDownReferences(st->bufRef, &ret);
+    if (ret <= 0) {
+        if (st->secretAddr != NULL) {
+            BSL_SAL_CleanseData(st->secretAddr, MLKEM_SECRET_POLYS(k) * MLKEM_N * sizeof(int16_t));
         }
+        MulCacheFree(k, st);
+        BSL_SAL_FREE(st->secretAddr);
+        BSL_SAL_FREE(st->bufAddr);
+        BSL_SAL_ReferencesFree(st->bufRef);
+        BSL_SAL_FREE(st->bufRef);
     }
-    return value;
+    st->secretAddr = NULL;
+    st->bufAddr = NULL;
+    st->cacheAddr = NULL;
+    st->bufRef = NULL;
 }
 
-// DeCompress
-static int16_t DeCompress(int16_t x, uint8_t bits)
+/*
+ * dst gets the expanded key of src. Heap buffers are shared and must not be modified while they are, a
+ * single-allocation dst gets a copy in its own block.
+ */
+int32_t MLKEM_CopyMatrixBuf(uint8_t k, MLKEM_MatrixSt *src, MLKEM_MatrixSt *dst)
 {
-    uint32_t product = (uint32_t)x * MLKEM_Q;
-    uint32_t power = 1 << bits;
-    return (int16_t)((product >> bits) + ((product & (power - 1)) >> (bits - 1)));
+    if (src->bufRef != NULL && dst->blockPub == NULL) {
+        int ret = 0;
+        BSL_SAL_AtomicUpReferences(src->bufRef, &ret);
+        (void)memcpy_s(dst, sizeof(MLKEM_MatrixSt), src, sizeof(MLKEM_MatrixSt));
+        return CRYPT_SUCCESS;
+    }
+    dst->noMatrix = src->noMatrix;
+    dst->mulCache = src->mulCache;
+    (void)memcpy_s(dst->rho, MLKEM_SEED_LEN, src->rho, MLKEM_SEED_LEN);
+    int32_t ret = MLKEM_CreateMatrixBuf(k, dst);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    uint32_t len = MLKEM_PUBLIC_POLYS(k, src) * MLKEM_N * sizeof(int16_t);
+    (void)memcpy_s(dst->bufAddr, len, src->bufAddr, len);
+    if (src->secretAddr != NULL) {
+        ret = MLKEM_CreateSecretBuf(k, dst);
+        RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+        len = MLKEM_SECRET_POLYS(k) * MLKEM_N * sizeof(int16_t);
+        (void)memcpy_s(dst->secretAddr, len, src->secretAddr, len);
+    }
+    return MLKEM_BuildMulCache(k, dst);
+}
+
+// Builds the mulcache of the expanded key in st if it was requested. The buffer always has room for vectorS.
+int32_t MLKEM_BuildMulCache(uint8_t k, MLKEM_MatrixSt *st)
+{
+    if (!st->mulCache) {
+        return CRYPT_SUCCESS;
+    }
+    if (st->cacheAddr == NULL) {
+        st->cacheAddr = BSL_SAL_Malloc(MLKEM_CACHE_POLYS(k, st) * MLKEM_N_HALF * sizeof(int16_t));
+        if (st->cacheAddr == NULL) {
+            return BSL_MALLOC_FAIL;
+        }
+    }
+    uint32_t matrixPolys = MLKEM_MATRIX_POLYS(k, st);
+    for (uint8_t i = 0; i < k; i++) {
+        for (uint8_t j = 0; j < k && matrixPolys != 0; j++) {
+            st->matrixCache[i][j] = st->cacheAddr + (i * k + j) * MLKEM_N_HALF;
+            MLKEM_PolyMulCache(st->matrixCache[i][j], st->matrix[i][j], PRE_COMPUT_TABLE_NTT_MONT);
+        }
+        st->vectorTCache[i] = st->cacheAddr + (matrixPolys + i) * MLKEM_N_HALF;
+        MLKEM_PolyMulCache(st->vectorTCache[i], st->vectorT[i], PRE_COMPUT_TABLE_NTT_MONT);
+        st->vectorSCache[i] = st->cacheAddr + (matrixPolys + k + i) * MLKEM_N_HALF;
+        if (st->secretAddr != NULL) {
+            MLKEM_PolyMulCache(st->vectorSCache[i], st->vectorS[i], PRE_COMPUT_TABLE_NTT_MONT);
+        }
+    }
+    return CRYPT_SUCCESS;
+}
+
+
+/*
+ * Compress_d(x) = round(2^d / MLKEM_Q * x) mod 2^d, NIST.FIPS.203 (4.7). (x << d) / MLKEM_Q is computed by Barrett
+ * reduction, the constants of each d are fixed at compile time. The values of du and dv are from Table 2.
+ */
+static inline uint16_t CompressBarrett(int16_t x, uint8_t bits, uint16_t halfQ, uint8_t barrettShift,
+    uint64_t barrettMultiplier)
+{
+    uint16_t t = x + ((x >> 15) & MLKEM_Q);
+    uint64_t round = ((uint64_t)t << bits) + halfQ;
+    round *= barrettMultiplier;
+    round >>= barrettShift;
+    return (uint16_t)(round & ((1U << bits) - 1));
+}
+
+static inline uint16_t Compress1(int16_t x)
+{
+    return CompressBarrett(x, 1, 1665 /* Ceil(MLKEM_Q/2) */, 28, 80635 /* round(2^28/MLKEM_Q) */);
+}
+
+static inline uint16_t Compress4(int16_t x)  // mlkem512 and mlkem768 dv
+{
+    return CompressBarrett(x, 4, 1665 /* Ceil(MLKEM_Q/2) */, 28, 80635 /* round(2^28/MLKEM_Q) */);
+}
+
+static inline uint16_t Compress5(int16_t x)  // mlkem1024 dv
+{
+    return CompressBarrett(x, 5, 1664 /* Floor(MLKEM_Q/2) */, 27, 40318 /* round(2^27/MLKEM_Q) */);
+}
+
+static inline uint16_t Compress10(int16_t x)  // mlkem512 and mlkem768 du
+{
+    return CompressBarrett(x, 10, 1665 /* Ceil(MLKEM_Q/2) */, 32, 1290167 /* round(2^32/MLKEM_Q) */);
+}
+
+static inline uint16_t Compress11(int16_t x)  // mlkem1024 du
+{
+    return CompressBarrett(x, 11, 1664 /* Floor(MLKEM_Q/2) */, 31, 645084 /* round(2^31/MLKEM_Q) */);
 }
 
 // hash functions
@@ -148,10 +274,30 @@ static int32_t HashFuncG(void *libCtx, const uint8_t *in, uint32_t inLen, uint8_
     return EAL_Md(CRYPT_MD_SHA3_512, libCtx, NULL, in, inLen, out, &len, libCtx != NULL);
 }
 
-static int32_t HashFuncXOF(void *libCtx, const uint8_t *in, uint32_t inLen, uint8_t *out, uint32_t outLen)
+// The XOF is squeezed incrementally, its context comes from the provider of libCtx like the digests of EAL_Md.
+static CRYPT_EAL_MdCTX *HashFuncXOFNew(void *libCtx)
 {
-    uint32_t len = outLen;
-    return EAL_Md(CRYPT_MD_SHAKE128, libCtx, NULL, in, inLen, out, &len, libCtx != NULL);
+#ifdef HITLS_CRYPTO_PROVIDER
+    if (libCtx != NULL) {
+        return CRYPT_EAL_ProviderMdNewCtx(libCtx, CRYPT_MD_SHAKE128, NULL);
+    }
+#endif
+    (void)libCtx;
+    return CRYPT_EAL_MdNewCtx(CRYPT_MD_SHAKE128);
+}
+
+static int32_t HashFuncXOFInit(CRYPT_EAL_MdCTX *xofCtx, const uint8_t *in, uint32_t inLen)
+{
+    int32_t ret = CRYPT_EAL_MdInit(xofCtx);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    return CRYPT_EAL_MdUpdate(xofCtx, in, inLen);
+}
+
+static int32_t HashFuncXOFSqueeze(CRYPT_EAL_MdCTX *xofCtx, uint8_t *out, uint32_t outLen)
+{
+    return CRYPT_EAL_MdSqueeze(xofCtx, out, outLen);
 }
 
 static int32_t HashFuncJ(void *libCtx, const uint8_t *in, uint32_t inLen, uint8_t *out, uint32_t outLen)
@@ -160,21 +306,78 @@ static int32_t HashFuncJ(void *libCtx, const uint8_t *in, uint32_t inLen, uint8_
     return EAL_Md(CRYPT_MD_SHAKE256, libCtx, NULL, in, inLen, out, &len, libCtx != NULL);
 }
 
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+/*
+ * The 4-way Keccak is built into this module. A context with a libCtx takes its hashes and XOFs from that provider,
+ * like EAL_Md does, so the 4-way paths are only taken without one.
+ */
+static inline bool UseKeccakX4(const void *libCtx)
+{
+    return libCtx == NULL && IsSupportAVX2();
+}
+
+// out[i] = Keccak(in[i]) for i < num with the 4-way Keccak, the unused lanes of the last group are dropped.
+static void HashBatchX4(uint32_t num, uint32_t rate, uint8_t pad, const uint8_t *in[], uint32_t inLen,
+    uint8_t *out[], uint32_t outLen)
+{
+    uint8_t scratch[CRYPT_SHA3_512_DIGESTSIZE];
+    const uint8_t *inX4[MLKEM_KECCAK_WAYS];
+    uint8_t *outX4[MLKEM_KECCAK_WAYS];
+    for (uint32_t base = 0; base < num; base += MLKEM_KECCAK_WAYS) {
+        for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS; n++) {
+            bool used = base + n < num;
+            inX4[n] = used ? in[base + n] : in[base];
+            outX4[n] = used ? out[base + n] : scratch;
+        }
+        MLKEM_HashX4(rate, pad, inX4, inLen, outX4, outLen);
+    }
+    BSL_SAL_CleanseData(scratch, sizeof(scratch));
+}
+#endif
+
+// out[i] = G(in[i]) for i < num, with the 4-way SHA3-512 when AVX2 is available and there is no libCtx.
+static int32_t HashFuncGBatch(void *libCtx, uint32_t num, const uint8_t *in[], uint32_t inLen, uint8_t *out[])
+{
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+    if (num > 1 && UseKeccakX4(libCtx)) {
+        HashBatchX4(num, MLKEM_G_RATE, MLKEM_SHA3_PAD, in, inLen, out, CRYPT_SHA3_512_DIGESTSIZE);
+        return CRYPT_SUCCESS;
+    }
+#endif
+    for (uint32_t i = 0; i < num; i++) {
+        int32_t ret = HashFuncG(libCtx, in[i], inLen, out[i], CRYPT_SHA3_512_DIGESTSIZE);
+        RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    }
+    return CRYPT_SUCCESS;
+}
+
+// out[i] = J(in[i]) for i < num, with the 4-way SHAKE256 when AVX2 is available and there is no libCtx.
+static int32_t HashFuncJBatch(void *libCtx, uint32_t num, const uint8_t *in[], uint32_t inLen, uint8_t *out[])
+{
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+    if (num > 1 && UseKeccakX4(libCtx)) {
+        HashBatchX4(num, MLKEM_PRF_RATE, MLKEM_SHAKE_PAD, in, inLen, out, MLKEM_SHARED_KEY_LEN);
+        return CRYPT_SUCCESS;
+    }
+#endif
+    for (uint32_t i = 0; i < num; i++) {
+        int32_t ret = HashFuncJ(libCtx, in[i], inLen, out[i], MLKEM_SHARED_KEY_LEN);
+        RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    }
+    return CRYPT_SUCCESS;
+}
+
 static int32_t PRF(void *libCtx, uint8_t *extSeed, uint32_t extSeedLen, uint8_t *outBuf, uint32_t bufLen)
 {
     uint32_t len = bufLen;
     return EAL_Md(CRYPT_MD_SHAKE256, libCtx, NULL, extSeed, extSeedLen, outBuf, &len, libCtx != NULL);
 }
 
-static int32_t Parse(uint16_t *polyNtt, uint8_t *arrayB, uint32_t arrayLen, uint32_t n)
+// Rejection sampling: appends the coefficients < MLKEM_Q found in arrayB to polyNtt, starting at polyNtt[*num].
+static void Parse(uint16_t *polyNtt, uint32_t *num, const uint8_t *arrayB, uint32_t arrayLen, uint32_t n)
 {
-    uint32_t i = 0;
-    uint32_t j = 0;
-    while (j < n) {
-        if (i + 3 > arrayLen) {  // 3 bytes of arrayB are read in each round.
-            BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_KEYLEN_ERROR);
-            return CRYPT_MLKEM_KEYLEN_ERROR;
-        }
+    uint32_t j = *num;
+    for (uint32_t i = 0; i + 3 <= arrayLen && j < n; i += 3) {  // 3 bytes are processed in each round.
         // The 4 bits of each byte are combined with the 8 bits of another byte into 12 bits.
         uint16_t d1 = ((uint16_t)arrayB[i]) + (((uint16_t)arrayB[i + 1] & 0x0f) << 8);  // 4 bits.
         uint16_t d2 = (((uint16_t)arrayB[i + 1]) >> 4) + (((uint16_t)arrayB[i + 2]) << 4);
@@ -186,81 +389,87 @@ static int32_t Parse(uint16_t *polyNtt, uint8_t *arrayB, uint32_t arrayLen, uint
             polyNtt[j] = d2;
             j++;
         }
-        i += 3;  // 3 bytes are processed in each round.
     }
-    return CRYPT_SUCCESS;
+    *num = j;
 }
 
-static void EncodeBits1(uint8_t *r, uint16_t *polyF)
+/*
+ * K-PKE.Encrypt Step 19 - 23 after the INTT, one pass per polynomial: the error is added, the sum is compressed
+ * and the d-bit values are packed straight into the ciphertext.
+ */
+// r = ByteEncode_10(Compress_10(a + e))
+static void CompressEncode10(uint8_t *r, const int16_t *a, const int16_t *e)
 {
-    for (uint32_t i = 0; i < MLKEM_N / BITS_OF_BYTE; i++) {
-        r[i] = (uint8_t)polyF[BITS_OF_BYTE * i];
-        for (uint32_t j = 1; j < BITS_OF_BYTE; j++) {
-            r[i] = (uint8_t)(polyF[BITS_OF_BYTE * i + j] << j) | r[i];
+    for (uint32_t i = 0; i < MLKEM_N / 4; i++) {
+        // 4 coefficients are packed to 5 bytes.
+        uint16_t t[4];
+        for (uint32_t j = 0; j < 4; j++) {
+            t[j] = Compress10(a[4 * i + j] + e[4 * i + j]);
         }
+        r[5 * i + 0] = (uint8_t)t[0];
+        r[5 * i + 1] = (uint8_t)((t[0] >> 8) | (t[1] << 2));
+        r[5 * i + 2] = (uint8_t)((t[1] >> 6) | (t[2] << 4));
+        r[5 * i + 3] = (uint8_t)((t[2] >> 4) | (t[3] << 6));
+        r[5 * i + 4] = (uint8_t)(t[3] >> 2);
     }
 }
 
-static void EncodeBits4(uint8_t *r, uint16_t *polyF)
+// r = ByteEncode_11(Compress_11(a + e))
+static void CompressEncode11(uint8_t *r, const int16_t *a, const int16_t *e)
 {
-    for (uint32_t i = 0; i < MLKEM_N / 2; i++) { // Two 4 bits are combined into 1 byte.
-        r[i] = ((uint8_t)polyF[2 * i] | ((uint8_t)polyF[2 * i + 1] << 4));
+    for (uint32_t i = 0; i < MLKEM_N / 8; i++) {
+        // 8 coefficients are packed to 11 bytes.
+        uint16_t t[8];
+        for (uint32_t j = 0; j < 8; j++) {
+            t[j] = Compress11(a[8 * i + j] + e[8 * i + j]);
+        }
+        uint8_t *p = r + 11 * i;
+        p[0] = (uint8_t)t[0];
+        p[1] = (uint8_t)((t[0] >> 8) | (t[1] << 3));
+        p[2] = (uint8_t)((t[1] >> 5) | (t[2] << 6));
+        p[3] = (uint8_t)(t[2] >> 2);
+        p[4] = (uint8_t)((t[2] >> 10) | (t[3] << 1));
+        p[5] = (uint8_t)((t[3] >> 7) | (t[4] << 4));
+        p[6] = (uint8_t)((t[4] >> 4) | (t[5] << 7));
+        p[7] = (uint8_t)(t[5] >> 1);
+        p[8] = (uint8_t)((t[5] >> 9) | (t[6] << 2));
+        p[9] = (uint8_t)((t[6] >> 6) | (t[7] << 5));
+        p[10] = (uint8_t)(t[7] >> 3);
     }
 }
 
-static void EncodeBits5(uint8_t *r, uint16_t *polyF)
+// Decompress_1(ByteDecode_1(m)) of coefficient n, Step 20: MLKEM_Q_HALF for a set bit, without a branch.
+static inline int16_t MessageCoeff(const uint8_t *m, uint32_t n)
 {
-    uint32_t indexR;
-    uint32_t indexF;
-    for (uint32_t i = 0; i < MLKEM_N / 8; i++) {
-        indexR = 5 * i;  // Each element in polyF has 5 bits.
-        indexF = 8 * i;  // Each element in r has 8 bits.
-        // 8 polyF elements are padded to 5 bytes.
-        r[indexR + 0] = (uint8_t)(polyF[indexF] | (polyF[indexF + 1] << 5));
-        r[indexR + 1] =
-            (uint8_t)((polyF[indexF + 1] >> 3) | (polyF[indexF + 2] << 2) | (polyF[indexF + 3] << 7));
-        r[indexR + 2] = (uint8_t)((polyF[indexF + 3] >> 1) | (polyF[indexF + 4] << 4));
-        r[indexR + 3] =
-            (uint8_t)((polyF[indexF + 4] >> 4) | (polyF[indexF + 5] << 1) | (polyF[indexF + 6] << 6));
-        r[indexR + 4] = (uint8_t)((polyF[indexF + 6] >> 2) | (polyF[indexF + 7] << 3));
-    }
+    return (int16_t)(-(int16_t)((m[n / BITS_OF_BYTE] >> (n % BITS_OF_BYTE)) & 1) & MLKEM_Q_HALF);
 }
 
-static void EncodeBits10(uint8_t *r, uint16_t *polyF)
+// r = ByteEncode_4(Compress_4(a + e + Decompress_1(m)))
+static void CompressEncode4(uint8_t *r, const int16_t *a, const int16_t *e, const uint8_t *m)
 {
-    uint32_t indexR;
-    uint32_t indexF;
-    for (uint32_t i = 0; i < MLKEM_N / 4; i++) {
-        // 4 polyF elements are padded to 5 bytes.
-        indexR = 5 * i;
-        indexF = 4 * i;
-        r[indexR + 0] = (uint8_t)polyF[indexF];
-        r[indexR + 1] = (uint8_t)((polyF[indexF] >> 8) | (polyF[indexF + 1] << 2));
-        r[indexR + 2] = (uint8_t)((polyF[indexF + 1] >> 6) | (polyF[indexF + 2] << 4));
-        r[indexR + 3] = (uint8_t)((polyF[indexF + 2] >> 4) | (polyF[indexF + 3] << 6));
-        r[indexR + 4] = (uint8_t)(polyF[indexF + 3] >> 2);
+    for (uint32_t i = 0; i < MLKEM_N / 2; i++) {
+        // Two 4 bits are combined into 1 byte.
+        uint16_t t0 = Compress4(a[2 * i] + e[2 * i] + MessageCoeff(m, 2 * i));
+        uint16_t t1 = Compress4(a[2 * i + 1] + e[2 * i + 1] + MessageCoeff(m, 2 * i + 1));
+        r[i] = (uint8_t)(t0 | (t1 << 4));
     }
 }
 
-static void EncodeBits11(uint8_t *r, uint16_t *polyF)
+// r = ByteEncode_5(Compress_5(a + e + Decompress_1(m)))
+static void CompressEncode5(uint8_t *r, const int16_t *a, const int16_t *e, const uint8_t *m)
 {
-    uint32_t indexR;
-    uint32_t indexF;
     for (uint32_t i = 0; i < MLKEM_N / 8; i++) {
-        // 8 polyF elements are padded to 11 bytes.
-        indexR = 11 * i;
-        indexF = 8 * i;
-        r[indexR + 0] = (uint8_t)polyF[indexF];
-        r[indexR + 1] = (uint8_t)((polyF[indexF] >> 8) | (polyF[indexF + 1] << 3));
-        r[indexR + 2] = (uint8_t)((polyF[indexF + 1] >> 5) | (polyF[indexF + 2] << 6));
-        r[indexR + 3] = (uint8_t)((polyF[indexF + 2] >> 2));
-        r[indexR + 4] = (uint8_t)((polyF[indexF + 2] >> 10) | (polyF[indexF + 3] << 1));
-        r[indexR + 5] = (uint8_t)((polyF[indexF + 3] >> 7) | (polyF[indexF + 4] << 4));
-        r[indexR + 6] = (uint8_t)((polyF[indexF + 4] >> 4) | (polyF[indexF + 5] << 7));
-        r[indexR + 7] = (uint8_t)((polyF[indexF + 5] >> 1));
-        r[indexR + 8] = (uint8_t)((polyF[indexF + 5] >> 9) | (polyF[indexF + 6] << 2));
-        r[indexR + 9] = (uint8_t)((polyF[indexF + 6] >> 6) | (polyF[indexF + 7] << 5));
-        r[indexR + 10] = (uint8_t)(polyF[indexF + 7] >> 3);
+        // 8 coefficients are packed to 5 bytes.
+        uint16_t t[8];
+        for (uint32_t j = 0; j < 8; j++) {
+            t[j] = Compress5(a[8 * i + j] + e[8 * i + j] + MessageCoeff(m, 8 * i + j));
+        }
+        uint8_t *p = r + 5 * i;
+        p[0] = (uint8_t)(t[0] | (t[1] << 5));
+        p[1] = (uint8_t)((t[1] >> 3) | (t[2] << 2) | (t[3] << 7));
+        p[2] = (uint8_t)((t[3] >> 1) | (t[4] << 4));
+        p[3] = (uint8_t)((t[4] >> 4) | (t[5] << 1) | (t[6] << 6));
+        p[4] = (uint8_t)((t[6] >> 2) | (t[7] << 3));
     }
 }
 
@@ -279,25 +488,10 @@ static void EncodeBits12(uint8_t *r, uint16_t *polyF)
     }
 }
 
-// Encodes an array of d-bit integers into a byte array for 1 ≤ d ≤ 12.
+// Encodes an array of d-bit integers into a byte array for d = 12, the ciphertext is packed by CompressEncode*.
 static void ByteEncode(uint8_t *r, int16_t *polyF, uint8_t bit)
 {
     switch (bit) {  // Valid bits of each element in polyF.
-        case 1:    // 1 Used for K-PKE.Decrypt Step 7.
-            EncodeBits1(r, (uint16_t *)polyF);
-            break;
-        case 4:    // From FIPS 203 Table 2, dv = 4
-            EncodeBits4(r, (uint16_t *)polyF);
-            break;
-        case 5:    // dv = 5
-            EncodeBits5(r, (uint16_t *)polyF);
-            break;
-        case 10:   // du = 10
-            EncodeBits10(r, (uint16_t *)polyF);
-            break;
-        case 11:    // du = 11
-            EncodeBits11(r, (uint16_t *)polyF);
-            break;
         case 12:    // 12 Used for K-PKE.KeyGen Step 19.
             for (int i = 0; i < MLKEM_N; ++i) {
                 polyF[i] += (polyF[i] >> 15) & MLKEM_Q;
@@ -309,83 +503,80 @@ static void ByteEncode(uint8_t *r, int16_t *polyF, uint8_t bit)
     }
 }
 
-static void DecodeBits1(int16_t *polyF, const uint8_t *a)
+/*
+ * K-PKE.Decrypt Step 3: u' = Decompress_du(ByteDecode_du(c1)) in one pass per polynomial, which then goes to the NTT.
+ * Decompress_d(y) = round(MLKEM_Q / 2^d * y) is computed as (y * MLKEM_Q + 2^(d - 1)) >> d.
+ */
+static inline int16_t Decompress(uint16_t y, uint8_t d)
 {
-    uint32_t i;
-    uint32_t j;
-    for (i = 0; i < MLKEM_N / BITS_OF_BYTE; i++) {
-        // 1 byte data is decoded into 8 polyF elements.
-        for (j = 0; j < BITS_OF_BYTE; j++) {
-            polyF[BITS_OF_BYTE * i + j] = (a[i] >> j) & 0x01;
-        }
-    }
+    return (int16_t)(((uint32_t)y * MLKEM_Q + (1U << (d - 1))) >> d);
 }
 
-static void DecodeBits4(int16_t *polyF, const uint8_t *a)
+static void DecodeDecompress10(int16_t *polyF, const uint8_t *a)
 {
-    uint32_t i;
-    for (i = 0; i < MLKEM_N / 2; i++) {
-        // 1 byte data is decoded into 2 polyF elements.
-        polyF[2 * i] = a[i] & 0xF;
-        polyF[2 * i + 1] = (a[i] >> 4) & 0xF;
+    for (uint32_t i = 0; i < MLKEM_N / 4; i++) {
+        // 5 bytes are decoded into 4 coefficients, value & 0x3FF is used to obtain 10 bits.
+        const uint8_t *p = a + 5 * i;
+        polyF[4 * i + 0] = Decompress(((p[0] >> 0) | ((uint16_t)p[1] << 8)) & 0x3FF, 10);
+        polyF[4 * i + 1] = Decompress(((p[1] >> 2) | ((uint16_t)p[2] << 6)) & 0x3FF, 10);
+        polyF[4 * i + 2] = Decompress(((p[2] >> 4) | ((uint16_t)p[3] << 4)) & 0x3FF, 10);
+        polyF[4 * i + 3] = Decompress(((p[3] >> 6) | ((uint16_t)p[4] << 2)) & 0x3FF, 10);
     }
 }
 
-static void DecodeBits5(int16_t *polyF, const uint8_t *a)
+static void DecodeDecompress11(int16_t *polyF, const uint8_t *a)
 {
-    uint32_t indexF;
-    uint32_t indexA;
     for (uint32_t i = 0; i < MLKEM_N / 8; i++) {
-        // 8 byte data is decoded into 5 polyF elements.
-        indexF = 8 * i;
-        indexA = 5 * i;
-        // value & 0x1F is used to obtain 5 bits.
-        polyF[indexF + 0] = ((a[indexA + 0] >> 0)) & 0x1F;
-        polyF[indexF + 1] = ((a[indexA + 0] >> 5) | (a[indexA + 1] << 3)) & 0x1F;
-        polyF[indexF + 2] = ((a[indexA + 1] >> 2)) & 0x1F;
-        polyF[indexF + 3] = ((a[indexA + 1] >> 7) | (a[indexA + 2] << 1)) & 0x1F;
-        polyF[indexF + 4] = ((a[indexA + 2] >> 4) | (a[indexA + 3] << 4)) & 0x1F;
-        polyF[indexF + 5] = ((a[indexA + 3] >> 1)) & 0x1F;
-        polyF[indexF + 6] = ((a[indexA + 3] >> 6) | (a[indexA + 4] << 2)) & 0x1F;
-        polyF[indexF + 7] = ((a[indexA + 4] >> 3)) & 0x1F;
+        // 11 bytes are decoded into 8 coefficients, value & 0x7FF is used to obtain 11 bits.
+        const uint8_t *p = a + 11 * i;
+        int16_t *f = polyF + 8 * i;
+        f[0] = Decompress(((p[0] >> 0) | ((uint16_t)p[1] << 8)) & 0x7FF, 11);
+        f[1] = Decompress(((p[1] >> 3) | ((uint16_t)p[2] << 5)) & 0x7FF, 11);
+        f[2] = Decompress(((p[2] >> 6) | ((uint16_t)p[3] << 2) | ((uint16_t)p[4] << 10)) & 0x7FF, 11);
+        f[3] = Decompress(((p[4] >> 1) | ((uint16_t)p[5] << 7)) & 0x7FF, 11);
+        f[4] = Decompress(((p[5] >> 4) | ((uint16_t)p[6] << 4)) & 0x7FF, 11);
+        f[5] = Decompress(((p[6] >> 7) | ((uint16_t)p[7] << 1) | ((uint16_t)p[8] << 9)) & 0x7FF, 11);
+        f[6] = Decompress(((p[8] >> 2) | ((uint16_t)p[9] << 6)) & 0x7FF, 11);
+        f[7] = Decompress(((p[9] >> 5) | ((uint16_t)p[10] << 3)) & 0x7FF, 11);
     }
 }
 
-static void DecodeBits10(int16_t *polyF, const uint8_t *a)
+/*
+ * K-PKE.Decrypt Step 4, 6 and 7 in one pass after the INTT of w:
+ * m = ByteEncode_1(Compress_1(Decompress_dv(ByteDecode_dv(c2)) - w)), one byte of m per 8 coefficients.
+ */
+static void DecodeDecryptEncode4(uint8_t *m, const uint8_t *c2, const int16_t *w)
 {
-    uint32_t indexF;
-    uint32_t indexA;
-    for (uint32_t i = 0; i < MLKEM_N / 4; i++) {
-        // 5 byte data is decoded into 4 polyF elements.
-        indexF = 4 * i;
-        indexA = 5 * i;
-        // value & 0x3FF is used to obtain 10 bits.
-        polyF[indexF + 0] = ((a[indexA + 0] >> 0) | ((uint16_t)a[indexA + 1] << 8)) & 0x3FF;
-        polyF[indexF + 1] = ((a[indexA + 1] >> 2) | ((uint16_t)a[indexA + 2] << 6)) & 0x3FF;
-        polyF[indexF + 2] = ((a[indexA + 2] >> 4) | ((uint16_t)a[indexA + 3] << 4)) & 0x3FF;
-        polyF[indexF + 3] = ((a[indexA + 3] >> 6) | ((uint16_t)a[indexA + 4] << 2)) & 0x3FF;
+    for (uint32_t i = 0; i < MLKEM_N / BITS_OF_BYTE; i++) {
+        // 4 bytes of c2 hold 8 coefficients.
+        uint8_t byte = 0;
+        for (uint32_t j = 0; j < BITS_OF_BYTE; j++) {
+            uint16_t y = (c2[4 * i + j / 2] >> (4 * (j & 1))) & 0xF;
+            byte |= (uint8_t)(Compress1(Decompress(y, 4) - w[BITS_OF_BYTE * i + j]) << j);
+        }
+        m[i] = byte;
     }
 }
 
-static void DecodeBits11(int16_t *polyF, const uint8_t *a)
+static void DecodeDecryptEncode5(uint8_t *m, const uint8_t *c2, const int16_t *w)
 {
-    uint32_t indexF;
-    uint32_t indexA;
-    for (uint32_t i = 0; i < MLKEM_N / 8; i++) {
-        // use type conversion because 11 > 8
-        indexF = 8 * i;
-        indexA = 11 * i;
-        // value & 0x7FF is used to obtain 11 bits.
-        polyF[indexF + 0] = ((a[indexA + 0] >> 0) | ((uint16_t)a[indexA + 1] << 8)) & 0x7FF;
-        polyF[indexF + 1] = ((a[indexA + 1] >> 3) | ((uint16_t)a[indexA + 2] << 5)) & 0x7FF;
-        polyF[indexF + 2] = ((a[indexA + 2] >> 6) | ((uint16_t)a[indexA + 3] << 2) |
-            ((uint16_t)a[indexA + 4] << 10)) & 0x7FF;
-        polyF[indexF + 3] = ((a[indexA + 4] >> 1) | ((uint16_t)a[indexA + 5] << 7)) & 0x7FF;
-        polyF[indexF + 4] = ((a[indexA + 5] >> 4) | ((uint16_t)a[indexA + 6] << 4)) & 0x7FF;
-        polyF[indexF + 5] = ((a[indexA + 6] >> 7) | ((uint16_t)a[indexA + 7] << 1) |
-            ((uint16_t)a[indexA + 8] << 9)) & 0x7FF;
-        polyF[indexF + 6] = ((a[indexA + 8] >> 2) | ((uint16_t)a[indexA + 9] << 6)) & 0x7FF;
-        polyF[indexF + 7] = ((a[indexA + 9] >> 5) | ((uint16_t)a[indexA + 10] << 3)) & 0x7FF;
+    for (uint32_t i = 0; i < MLKEM_N / BITS_OF_BYTE; i++) {
+        // 5 bytes of c2 hold 8 coefficients, value & 0x1F is used to obtain 5 bits.
+        const uint8_t *p = c2 + 5 * i;
+        uint16_t y[BITS_OF_BYTE];
+        y[0] = (p[0] >> 0) & 0x1F;
+        y[1] = ((p[0] >> 5) | (p[1] << 3)) & 0x1F;
+        y[2] = (p[1] >> 2) & 0x1F;
+        y[3] = ((p[1] >> 7) | (p[2] << 1)) & 0x1F;
+        y[4] = ((p[2] >> 4) | (p[3] << 4)) & 0x1F;
+        y[5] = (p[3] >> 1) & 0x1F;
+        y[6] = ((p[3] >> 6) | (p[4] << 2)) & 0x1F;
+        y[7] = (p[4] >> 3) & 0x1F;
+        uint8_t byte = 0;
+        for (uint32_t j = 0; j < BITS_OF_BYTE; j++) {
+            byte |= (uint8_t)(Compress1(Decompress(y[j], 5) - w[BITS_OF_BYTE * i + j]) << j);
+        }
+        m[i] = byte;
     }
 }
 
@@ -408,32 +599,107 @@ static int32_t DecodeBits12(int16_t *polyF, const uint8_t *a)
     return CRYPT_SUCCESS;
 }
 
-// Decodes a byte array into an array of d-bit integers for 1 ≤ d ≤ 12.
-static void ByteDecode(int16_t *polyF, const uint8_t *a, uint8_t bit)
+// The modulus check of DecodeBits12 for num encoded polynomials, without decoding them.
+int32_t MLKEM_CheckBits12(const uint8_t *a, uint8_t num)
 {
-    switch (bit) {
-        case 1:
-            DecodeBits1(polyF, a);
-            break;
-        case 4:
-            DecodeBits4(polyF, a);
-            break;
-        case 5:
-            DecodeBits5(polyF, a);
-            break;
-        case 10:
-            DecodeBits10(polyF, a);
-            break;
-        case 11:
-            DecodeBits11(polyF, a);
-            break;
-        case 12:
-            (void)DecodeBits12(polyF, a);
-            break;
-        default:
+    for (uint32_t i = 0; i < (uint32_t)num * MLKEM_N / 2; i++) {
+        uint16_t f0 = ((a[3 * i + 0] >> 0) | ((uint16_t)a[3 * i + 1] << 8)) & 0xFFF;
+        uint16_t f1 = ((a[3 * i + 1] >> 4) | ((uint16_t)a[3 * i + 2] << 4)) & 0xFFF;
+        if (f0 >= MLKEM_Q || f1 >= MLKEM_Q) {
+            BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_DECODE_KEY_OVERFLOW);
+            return CRYPT_MLKEM_DECODE_KEY_OVERFLOW;
+        }
+    }
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * @brief: Sample one polynomial of matrix A from the seed p = rho || i || j.
+ * SHAKE128 is squeezed incrementally: MLKEM_XOF_INIT_BLOCKS blocks first, then one block at a time until Parse
+ * has filled all MLKEM_N coefficients, so the sampling never runs short and no block is squeezed for nothing.
+ */
+static int32_t SampleNtt(CRYPT_EAL_MdCTX *xofCtx, const uint8_t *p, int16_t *poly)
+{
+    uint8_t xofOut[MLKEM_XOF_BLOCKSIZE * MLKEM_XOF_INIT_BLOCKS];
+    uint32_t num = 0;
+    int32_t ret = HashFuncXOFInit(xofCtx, p, MLKEM_SEED_LEN + 2);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    ret = HashFuncXOFSqueeze(xofCtx, xofOut, sizeof(xofOut));
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    Parse((uint16_t *)poly, &num, xofOut, sizeof(xofOut), MLKEM_N);
+    while (num < MLKEM_N) {
+        ret = HashFuncXOFSqueeze(xofCtx, xofOut, MLKEM_XOF_BLOCKSIZE);
+        RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+        Parse((uint16_t *)poly, &num, xofOut, MLKEM_XOF_BLOCKSIZE, MLKEM_N);
+    }
+    return CRYPT_SUCCESS;
+}
+
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+/*
+ * SampleNtt for 4 seeds at once with the 4-way SHAKE128. While any lane is still short, one more block is
+ * squeezed for all lanes, so every lane parses the same byte stream as SampleNtt would.
+ */
+static void SampleNttX4(const uint8_t *p[MLKEM_KECCAK_WAYS], int16_t *poly[MLKEM_KECCAK_WAYS])
+{
+    MLKEM_KeccakX4Ctx xofCtx;
+    uint8_t xofOut[MLKEM_KECCAK_WAYS][MLKEM_XOF_BLOCKSIZE * MLKEM_XOF_INIT_BLOCKS];
+    uint8_t *out[MLKEM_KECCAK_WAYS];
+    uint32_t num[MLKEM_KECCAK_WAYS] = { 0 };
+    uint32_t outLen = sizeof(xofOut[0]);
+    for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS; n++) {
+        out[n] = xofOut[n];
+    }
+    MLKEM_ShakeX4Absorb(&xofCtx, MLKEM_XOF_BLOCKSIZE, p, MLKEM_SEED_LEN + 2);
+    MLKEM_ShakeX4Squeeze(&xofCtx, MLKEM_XOF_BLOCKSIZE, out, MLKEM_XOF_INIT_BLOCKS);
+    while (true) {
+        bool done = true;
+        for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS; n++) {
+            Parse((uint16_t *)poly[n], &num[n], xofOut[n], outLen, MLKEM_N);
+            done = done && (num[n] == MLKEM_N);
+        }
+        if (done) {
             break;
+        }
+        MLKEM_ShakeX4Squeeze(&xofCtx, MLKEM_XOF_BLOCKSIZE, out, 1);
+        outLen = MLKEM_XOF_BLOCKSIZE;
+    }
+}
+
+/*
+ * GenMatrix with the k * k entries sampled in groups of 4. The unused lanes of the last group repeat the first
+ * seed of the group and are parsed into a scratch polynomial.
+ */
+static void GenMatrixX4(uint8_t k, const uint8_t *digest, int16_t *polyMatrix[MLKEM_K_MAX][MLKEM_K_MAX], bool isEnc)
+{
+    uint8_t p[MLKEM_KECCAK_WAYS][MLKEM_SEED_LEN + 2];  // Reserved lengths of i and j is 2 byte.
+    const uint8_t *seed[MLKEM_KECCAK_WAYS];
+    int16_t *poly[MLKEM_KECCAK_WAYS];
+    int16_t scratch[MLKEM_N];
+    uint32_t total = (uint32_t)k * k;
+
+    for (uint32_t base = 0; base < total; base += MLKEM_KECCAK_WAYS) {
+        for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS; n++) {
+            if (base + n >= total) {
+                seed[n] = p[0];
+                poly[n] = scratch;
+                continue;
+            }
+            uint8_t i = (uint8_t)((base + n) / k);
+            uint8_t j = (uint8_t)((base + n) % k);
+            (void)memcpy_s(p[n], MLKEM_SEED_LEN, digest, MLKEM_SEED_LEN);
+            p[n][MLKEM_SEED_LEN] = isEnc ? i : j;
+            p[n][MLKEM_SEED_LEN + 1] = isEnc ? j : i;
+            seed[n] = p[n];
+            poly[n] = polyMatrix[i][j];
+        }
+        SampleNttX4(seed, poly);
+        for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS && base + n < total; n++) {
+            MLKEM_PolyToMont(poly[n]);
+        }
     }
 }
+#endif
 
 /**
  * @brief: Generate matrix A or A transpose.
@@ -442,18 +708,28 @@ static void ByteDecode(int16_t *polyF, const uint8_t *a, uint8_t bit)
  * @param[out] polyMatrix: The generated matrix A or A transpose.
  * @param[in] isEnc: true: generate matrix A; false: generate matrix A transpose.
  * @return: CRYPT_SUCCESS on success, others on failure.
- * HashFuncXOF is used to generate each polynomial in the matrix.
+ * SampleNtt is used to generate each polynomial in the matrix.
  * According to NIST.FIPS.203, when generating matrix A transpose,
- * the row index and column index are swapped compared to generating matrix A.  
- * Parse is used to parse the output of HashFuncXOF into a polynomial.
+ * the row index and column index are swapped compared to generating matrix A.
  * Each polynomial has n coefficients.
  */
 static int32_t GenMatrix(const CRYPT_ML_KEM_Ctx *ctx, const uint8_t *digest,
     int16_t *polyMatrix[MLKEM_K_MAX][MLKEM_K_MAX], bool isEnc)
 {
     uint8_t k = ctx->info->k;
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+    if (UseKeccakX4(ctx->libCtx)) {
+        GenMatrixX4(k, digest, polyMatrix, isEnc);
+        return CRYPT_SUCCESS;
+    }
+#endif
     uint8_t p[MLKEM_SEED_LEN + 2];  // Reserved lengths of i and j is 2 byte.
-    uint8_t xofOut[MLKEM_XOF_OUTPUT_LENGTH];
+    int32_t ret = CRYPT_SUCCESS;
+    CRYPT_EAL_MdCTX *xofCtx = HashFuncXOFNew(ctx->libCtx);
+    if (xofCtx == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return CRYPT_MEM_ALLOC_FAIL;
+    }
 
     (void)memcpy_s(p, MLKEM_SEED_LEN, digest, MLKEM_SEED_LEN);
     for (uint8_t i = 0; i < k; i++) {
@@ -466,56 +742,190 @@ static int32_t GenMatrix(const CRYPT_ML_KEM_Ctx *ctx, const uint8_t *digest,
                 p[MLKEM_SEED_LEN] = j;
                 p[MLKEM_SEED_LEN + 1] = i;
             }
-            // 根据p，派生伪随机字节流xofOut.
-            int32_t ret = HashFuncXOF(ctx->libCtx, p, MLKEM_SEED_LEN + 2, xofOut, MLKEM_XOF_OUTPUT_LENGTH);
-            RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
-            // 解析xofOut（拒绝采样），得到多项式polyMatrix[i][j].
-            ret = Parse((uint16_t *)polyMatrix[i][j], xofOut, MLKEM_XOF_OUTPUT_LENGTH, MLKEM_N);
-            RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+            // 根据p派生伪随机字节流并拒绝采样，得到多项式polyMatrix[i][j].
+            GOTO_ERR_IF(SampleNtt(xofCtx, p, polyMatrix[i][j]), ret);
+            MLKEM_PolyToMont(polyMatrix[i][j]);
         }
     }
-    return CRYPT_SUCCESS;
+ERR:
+    CRYPT_EAL_MdFreeCtx(xofCtx);
+    return ret;
 }
 
-static int32_t SampleEta1(const CRYPT_ML_KEM_Ctx *ctx, uint8_t *digest, int16_t *polyS[], uint8_t *nonce)
+/*
+ * The SHAKE128 context that GenMatrixRow reuses for all the rows of one matrix product. The 4-way path has its own
+ * state on the stack, so there it stays NULL and GenMatrixRow takes that path. Otherwise this is the heap
+ * allocation that the matrix-free mode adds to an encapsulation or decapsulation: the context of CRYPT_EAL_MdNewCtx
+ * and of the provider is opaque and cannot live on the stack, and one kept in ctx would be shared by concurrent
+ * callers.
+ */
+static int32_t MatrixRowXofNew(void *libCtx, CRYPT_EAL_MdCTX **xofCtx)
 {
-    uint8_t q[MLKEM_SEED_LEN + 1] = { 0 };  // Reserved lengths of nonce is 1 byte.
-    uint8_t prfOut[MLKEM_PRF_BLOCKSIZE * MLKEM_ETA1_MAX] = { 0 };
-    (void)memcpy_s(q, MLKEM_SEED_LEN, digest, MLKEM_SEED_LEN);
+    *xofCtx = NULL;
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+    if (UseKeccakX4(libCtx)) {
+        return CRYPT_SUCCESS;
+    }
+#endif
+    *xofCtx = HashFuncXOFNew(libCtx);
+    if (*xofCtx == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return CRYPT_MEM_ALLOC_FAIL;
+    }
+    return CRYPT_SUCCESS;
+}
 
-    for (uint8_t i = 0; i < ctx->info->k; i++) {
-        q[MLKEM_SEED_LEN] = *nonce;
-        int32_t ret = PRF(ctx->libCtx, q, MLKEM_SEED_LEN + 1, prfOut, MLKEM_PRF_BLOCKSIZE * MLKEM_ETA1_MAX);
+/*
+ * Generate row i of matrix A (polyRow[j] = A[i][j]) or of A transpose (polyRow[j] = A[j][i]) in the Montgomery
+ * domain, for the modes that do not store the matrix. The entries are the same as the ones of GenMatrix. xofCtx
+ * comes from MatrixRowXofNew, NULL selects the 4-way SHAKE128.
+ */
+static int32_t GenMatrixRow(CRYPT_EAL_MdCTX *xofCtx, uint8_t k, const uint8_t *digest, uint8_t i,
+    int16_t *polyRow[MLKEM_K_MAX], bool isTransposed)
+{
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+    if (xofCtx == NULL) {
+        uint8_t p[MLKEM_KECCAK_WAYS][MLKEM_SEED_LEN + 2];
+        const uint8_t *seed[MLKEM_KECCAK_WAYS];
+        int16_t *poly[MLKEM_KECCAK_WAYS];
+        int16_t scratch[MLKEM_N];
+        for (uint8_t j = 0; j < MLKEM_KECCAK_WAYS; j++) {
+            (void)memcpy_s(p[j], MLKEM_SEED_LEN, digest, MLKEM_SEED_LEN);
+            p[j][MLKEM_SEED_LEN] = isTransposed ? i : j;
+            p[j][MLKEM_SEED_LEN + 1] = isTransposed ? j : i;
+            seed[j] = p[j];
+            poly[j] = (j < k) ? polyRow[j] : scratch;  // k <= MLKEM_KECCAK_WAYS
+        }
+        SampleNttX4(seed, poly);
+        for (uint8_t j = 0; j < k; j++) {
+            MLKEM_PolyToMont(polyRow[j]);
+        }
+        return CRYPT_SUCCESS;
+    }
+#endif
+    uint8_t p[MLKEM_SEED_LEN + 2];
+    (void)memcpy_s(p, MLKEM_SEED_LEN, digest, MLKEM_SEED_LEN);
+    for (uint8_t j = 0; j < k; j++) {
+        p[MLKEM_SEED_LEN] = isTransposed ? i : j;
+        p[MLKEM_SEED_LEN + 1] = isTransposed ? j : i;
+        int32_t ret = SampleNtt(xofCtx, p, polyRow[j]);
         RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
-        MLKEM_SamplePolyCBD(polyS[i], prfOut, ctx->info->eta1);
-        *nonce = *nonce + 1;
-        MLKEM_ComputNTT(polyS[i], PRE_COMPUT_TABLE_NTT_MONT);
+        MLKEM_PolyToMont(polyRow[j]);
     }
     return CRYPT_SUCCESS;
 }
 
-static int32_t SampleEta2(const CRYPT_ML_KEM_Ctx *ctx, uint8_t *digest, int16_t *polyS[], uint8_t *nonce){
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+// SamplePolyCBDBatch with 4 consecutive nonces per 4-way SHAKE256, the outputs of unused lanes are dropped.
+static void SamplePolyCBDX4(const uint8_t *q, int16_t *poly[], uint32_t num, uint8_t eta, uint8_t *nonce)
+{
+    MLKEM_KeccakX4Ctx prfCtx;
+    uint8_t p[MLKEM_KECCAK_WAYS][MLKEM_SEED_LEN + 1];
+    uint8_t prfOut[MLKEM_KECCAK_WAYS][MLKEM_PRF_RATE * MLKEM_PRF_X4_BLOCKS];
+    const uint8_t *in[MLKEM_KECCAK_WAYS];
+    uint8_t *out[MLKEM_KECCAK_WAYS];
+    uint32_t blocks = (MLKEM_PRF_BLOCKSIZE * eta + MLKEM_PRF_RATE - 1) / MLKEM_PRF_RATE;
+    for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS; n++) {
+        (void)memcpy_s(p[n], MLKEM_SEED_LEN, q, MLKEM_SEED_LEN);
+        in[n] = p[n];
+        out[n] = prfOut[n];
+    }
+    for (uint32_t base = 0; base < num; base += MLKEM_KECCAK_WAYS) {
+        for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS; n++) {
+            p[n][MLKEM_SEED_LEN] = (uint8_t)(*nonce + n);
+        }
+        MLKEM_ShakeX4Absorb(&prfCtx, MLKEM_PRF_RATE, in, MLKEM_SEED_LEN + 1);
+        MLKEM_ShakeX4Squeeze(&prfCtx, MLKEM_PRF_RATE, out, blocks);
+        for (uint32_t n = 0; n < MLKEM_KECCAK_WAYS && base + n < num; n++) {
+            MLKEM_SamplePolyCBD(poly[base + n], prfOut[n], eta);
+            *nonce = *nonce + 1;
+        }
+    }
+    BSL_SAL_CleanseData(&prfCtx, sizeof(prfCtx));
+    BSL_SAL_CleanseData(prfOut, sizeof(prfOut));
+    BSL_SAL_CleanseData(p, sizeof(p));
+}
+#endif
+
+// poly[i] = SamplePolyCBD(PRF(digest || nonce)) for i < num, the nonce is incremented after each polynomial.
+static int32_t SamplePolyCBDBatch(const CRYPT_ML_KEM_Ctx *ctx, const uint8_t *digest, int16_t *poly[], uint32_t num,
+    uint8_t eta, uint8_t *nonce)
+{
     uint8_t q[MLKEM_SEED_LEN + 1] = { 0 };  // Reserved lengths of nonce is 1 byte.
-    uint8_t prfOut[MLKEM_PRF_BLOCKSIZE * MLKEM_ETA2_MAX] = { 0 };
+    uint8_t prfOut[MLKEM_PRF_BLOCKSIZE * MLKEM_ETA1_MAX] = { 0 };
     (void)memcpy_s(q, MLKEM_SEED_LEN, digest, MLKEM_SEED_LEN);
-
-    for (uint8_t i = 0; i < ctx->info->k; i++) {
+#ifdef HITLS_CRYPTO_MLKEM_X8664
+    if (UseKeccakX4(ctx->libCtx)) {
+        SamplePolyCBDX4(q, poly, num, eta, nonce);
+        BSL_SAL_CleanseData(q, sizeof(q));
+        return CRYPT_SUCCESS;
+    }
+#endif
+    int32_t ret = CRYPT_SUCCESS;
+    for (uint32_t i = 0; i < num; i++) {
         q[MLKEM_SEED_LEN] = *nonce;
-        int32_t ret = PRF(ctx->libCtx, q, MLKEM_SEED_LEN + 1, prfOut, MLKEM_PRF_BLOCKSIZE * MLKEM_ETA2_MAX);
-        RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
-        MLKEM_SamplePolyCBD(polyS[i], prfOut, ctx->info->eta2);
+        GOTO_ERR_IF(PRF(ctx->libCtx, q, MLKEM_SEED_LEN + 1, prfOut, MLKEM_PRF_BLOCKSIZE * eta), ret);
+        MLKEM_SamplePolyCBD(poly[i], prfOut, eta);
         *nonce = *nonce + 1;
     }
+ERR:
+    BSL_SAL_CleanseData(q, sizeof(q));
+    BSL_SAL_CleanseData(prfOut, sizeof(prfOut));
+    return ret;
+}
+
+// Samples num polynomials with eta1 and transforms them to the NTT domain.
+static int32_t SampleEta1(const CRYPT_ML_KEM_Ctx *ctx, uint8_t *digest, int16_t *polyS[], uint32_t num,
+    uint8_t *nonce)
+{
+    int32_t ret = SamplePolyCBDBatch(ctx, digest, polyS, num, ctx->info->eta1, nonce);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    for (uint32_t i = 0; i < num; i++) {
+        MLKEM_ComputNTT(polyS[i], PRE_COMPUT_TABLE_NTT_MONT);
+    }
     return CRYPT_SUCCESS;
 }
 
+static int32_t SampleEta2(const CRYPT_ML_KEM_Ctx *ctx, uint8_t *digest, int16_t *polyS[], uint32_t num,
+    uint8_t *nonce)
+{
+    return SamplePolyCBDBatch(ctx, digest, polyS, num, ctx->info->eta2, nonce);
+}
+
 // NIST.FIPS.203 Algorithm 13 K-PKE.KeyGen(𝑑)
+// vectorT += A * vectorS and reduced. Without a stored matrix every row of A is generated just before it is used.
+static int32_t PkeMatrixMulAdd(CRYPT_ML_KEM_Ctx *ctx)
+{
+    uint8_t k = ctx->info->k;
+    MLKEM_MatrixSt *st = &ctx->keyData;
+    if (!st->noMatrix) {
+        MLKEM_MatrixMulAdd(k, (int16_t **)st->matrix, st->vectorS, st->vectorT, PRE_COMPUT_TABLE_NTT_MONT);
+        return CRYPT_SUCCESS;
+    }
+    int16_t rowBuf[MLKEM_K_MAX * MLKEM_N];
+    int16_t *row[MLKEM_K_MAX];
+    for (uint8_t j = 0; j < k; j++) {
+        row[j] = rowBuf + j * MLKEM_N;
+    }
+    CRYPT_EAL_MdCTX *xofCtx = NULL;
+    int32_t ret = MatrixRowXofNew(ctx->libCtx, &xofCtx);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    for (uint8_t i = 0; i < k; i++) {
+        GOTO_ERR_IF(GenMatrixRow(xofCtx, k, st->rho, i, row, false), ret);
+        MLKEM_MatrixRowMulAdd(k, row, st->vectorS, st->vectorT[i], PRE_COMPUT_TABLE_NTT_MONT);
+    }
+ERR:
+    CRYPT_EAL_MdFreeCtx(xofCtx);
+    return ret;
+}
+
 static int32_t PkeKeyGen(CRYPT_ML_KEM_Ctx *ctx, uint8_t *pk, uint8_t *dk, uint8_t *d)
 {
     uint8_t k = ctx->info->k;
     uint8_t nonce = 0;
     uint8_t seed[MLKEM_SEED_LEN + 1] = { 0 };  // Reserved lengths of k is 1 byte.
     uint8_t digest[CRYPT_SHA3_512_DIGESTSIZE] = { 0 };
+    int16_t *polyVecSE[MLKEM_K_MAX * 2];
 
     // (p,q) = G(d || k)
     (void)memcpy_s(seed, MLKEM_SEED_LEN + 1, d, MLKEM_SEED_LEN);
@@ -528,17 +938,25 @@ static int32_t PkeKeyGen(CRYPT_ML_KEM_Ctx *ctx, uint8_t *pk, uint8_t *dk, uint8_
     uint8_t *q = digest + CRYPT_SHA3_512_DIGESTSIZE / 2;
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
 
-    GOTO_ERR_IF(GenMatrix(ctx, p, ctx->keyData.matrix, false), ret);  // Step 3 - 7
-    GOTO_ERR_IF(SampleEta1(ctx, q, ctx->keyData.vectorS, &nonce), ret);  // Step 8 - 11
-    GOTO_ERR_IF(SampleEta1(ctx, q, ctx->keyData.vectorT, &nonce), ret);  // Step 12 - 15
-    MLKEM_MatrixMulAdd(k, (int16_t **)ctx->keyData.matrix, ctx->keyData.vectorS, ctx->keyData.vectorT,
-                       PRE_COMPUT_TABLE_NTT);
+    (void)memcpy_s(ctx->keyData.rho, MLKEM_SEED_LEN, p, MLKEM_SEED_LEN);
+    if (!ctx->keyData.noMatrix) {
+        GOTO_ERR_IF(GenMatrix(ctx, p, ctx->keyData.matrix, false), ret);  // Step 3 - 7
+    }
+    // s and e use consecutive nonces, e is sampled into vectorT and t = A * s + e is accumulated on it.
+    for (uint8_t i = 0; i < k; i++) {
+        polyVecSE[i] = ctx->keyData.vectorS[i];
+        polyVecSE[k + i] = ctx->keyData.vectorT[i];
+    }
+    GOTO_ERR_IF(SampleEta1(ctx, q, polyVecSE, 2 * k, &nonce), ret);  // Step 8 - 15
+    GOTO_ERR_IF(PkeMatrixMulAdd(ctx), ret);
     // output: pk, dk,  ekPKE ← ByteEncode12(𝐭)‖p.
     for (uint8_t i = 0; i < k; i++) {
         // Step 19
         ByteEncode(pk + MLKEM_SEED_LEN * MLKEM_BITS_OF_Q * i, ctx->keyData.vectorT[i], MLKEM_BITS_OF_Q);
         // Step 20
         ByteEncode(dk + MLKEM_SEED_LEN * MLKEM_BITS_OF_Q * i, ctx->keyData.vectorS[i], MLKEM_BITS_OF_Q);
+        MLKEM_PolyToMont(ctx->keyData.vectorT[i]);
+        MLKEM_PolyToMont(ctx->keyData.vectorS[i]);
     }
     // The buffer of pk is sufficient, check it before calling this function.
     (void)memcpy_s(pk + MLKEM_SEED_LEN * MLKEM_BITS_OF_Q * k, MLKEM_SEED_LEN, p, MLKEM_SEED_LEN);
@@ -559,19 +977,23 @@ int32_t MLKEM_DecodeDk(CRYPT_ML_KEM_Ctx *ctx, const uint8_t *dk, uint32_t dkLen)
         return CRYPT_MLKEM_KEYLEN_ERROR;
     }
     uint8_t k = ctx->info->k;
-    if (MLKEM_CreateMatrixBuf(k, &ctx->keyData) != CRYPT_SUCCESS) {
+    if (MLKEM_CreateSecretBuf(k, &ctx->keyData) != CRYPT_SUCCESS) {
         return BSL_MALLOC_FAIL;
     }
     for (int i = 0; i < k; ++i) {
         if (DecodeBits12(ctx->keyData.vectorS[i], dk + MLKEM_SEED_LEN * MLKEM_BITS_OF_Q * i) != CRYPT_SUCCESS) {
             return CRYPT_MLKEM_DECODE_KEY_OVERFLOW;
         }
+        MLKEM_PolyToMont(ctx->keyData.vectorS[i]);
     }
     const uint8_t *ekBuff = dk + MLKEM_SEED_LEN * MLKEM_BITS_OF_Q * k;
     int32_t ret = MLKEM_DecodeEk(ctx, ekBuff, ctx->info->encapsKeyLen);
     if (ret != CRYPT_SUCCESS) {
         return ret;
     }
+    // NIST.FIPS.203: test = H(dk[384k : 768k + 32]) and check test == h, the result is used by every decapsulation.
+    const uint8_t *h = ekBuff + ctx->info->encapsKeyLen;
+    ctx->dkVerified = (memcmp(h, ctx->ekHash, CRYPT_SHA3_256_DIGESTSIZE) == 0);
     return CRYPT_SUCCESS;
 }
 
@@ -590,128 +1012,238 @@ int32_t MLKEM_DecodeEk(CRYPT_ML_KEM_Ctx *ctx, const uint8_t *ek, uint32_t ekLen)
     if (MLKEM_CreateMatrixBuf(k, &ctx->keyData) != CRYPT_SUCCESS) {
         return BSL_MALLOC_FAIL;
     }
-    int32_t ret = GenMatrix(ctx, ek + MLKEM_CIPHER_LEN * k, ctx->keyData.matrix, false);
-    if (ret != CRYPT_SUCCESS) {
-        return ret;
+    int32_t ret;
+    (void)memcpy_s(ctx->keyData.rho, MLKEM_SEED_LEN, ek + MLKEM_CIPHER_LEN * k, MLKEM_SEED_LEN);
+    if (!ctx->keyData.noMatrix) {
+        ret = GenMatrix(ctx, ctx->keyData.rho, ctx->keyData.matrix, false);
+        if (ret != CRYPT_SUCCESS) {
+            return ret;
+        }
     }
     for (uint8_t i = 0; i < k; i++) {
         ret = DecodeBits12(ctx->keyData.vectorT[i], ek + MLKEM_CIPHER_LEN * i);
         if (ret != CRYPT_SUCCESS) {
             return ret;
         }
+        MLKEM_PolyToMont(ctx->keyData.vectorT[i]);
     }
-    return CRYPT_SUCCESS;
+    // vectorS of a decapsulation key has been decoded before.
+    ret = MLKEM_BuildMulCache(k, &ctx->keyData);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    return HashFuncH(ctx->libCtx, ek, ekLen, ctx->ekHash, CRYPT_SHA3_256_DIGESTSIZE);
 }
 
-// NIST.FIPS.203 Algorithm 14 K-PKE.Encrypt(ekPKE, m, r)
-static int32_t PkeEncrypt(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint8_t *m, uint8_t *r)
+// cache if the mulcache of st has been built, NULL otherwise.
+static inline int16_t **MulCacheOf(const MLKEM_MatrixSt *st, int16_t **cache)
+{
+    return (st->cacheAddr != NULL) ? cache : NULL;
+}
+
+// Scratch of one K-PKE.Encrypt: buf = polyVecY || polyVecE1 || polyE2 || polyVecU || polyC2.
+#define MLKEM_ENC_WORK_POLYS(k) ((k) * 3 + 2)
+typedef struct {
+    int16_t *polyVecY[MLKEM_K_MAX];
+    int16_t *polyVecE1[MLKEM_K_MAX + 1];  // e1 || e2
+    int16_t *polyVecU[MLKEM_K_MAX];
+    int16_t *polyC2;
+    int16_t buf[MLKEM_ENC_WORK_POLYS(MLKEM_K_MAX) * MLKEM_N];
+} MLKEM_EncWork;
+
+static void PkeEncWorkInit(uint8_t k, MLKEM_EncWork *w)
+{
+    (void)memset_s(w->buf, sizeof(w->buf), 0, MLKEM_ENC_WORK_POLYS(k) * MLKEM_N * sizeof(int16_t));
+    for (uint8_t i = 0; i < k; ++i) {
+        w->polyVecY[i] = w->buf + MLKEM_N * i;
+        w->polyVecE1[i] = w->buf + MLKEM_N * (k + i);
+        w->polyVecU[i] = w->buf + MLKEM_N * (2 * k + 1 + i);
+    }
+    w->polyVecE1[k] = w->buf + MLKEM_N * 2 * k;
+    w->polyC2 = w->buf + MLKEM_N * (3 * k + 1);
+}
+
+static void PkeEncWorkCleanse(uint8_t k, MLKEM_EncWork *w)
+{
+    BSL_SAL_CleanseData(w->buf, MLKEM_ENC_WORK_POLYS(k) * MLKEM_N * sizeof(int16_t));
+}
+
+// K-PKE.Encrypt Step 1 - 17: sample y, e1 and e2 from r.
+static int32_t PkeEncryptSample(const CRYPT_ML_KEM_Ctx *ctx, uint8_t *r, MLKEM_EncWork *w)
 {
-    uint8_t i;
-    uint32_t n;
     uint8_t k = ctx->info->k;
     uint8_t nonce = 0; // Step 1
-    uint8_t seedE[MLKEM_SEED_LEN + 1];
-    uint8_t bufEncE[MLKEM_PRF_BLOCKSIZE * MLKEM_ETA1_MAX];
-    int16_t polyE2[MLKEM_N] = { 0 };
-    int16_t polyC2[MLKEM_N] = { 0 };
-    int16_t polyM[MLKEM_N] = { 0 };
-    int16_t *polyVecY[MLKEM_K_MAX] = { 0 };
-    int16_t *polyVecE1[MLKEM_K_MAX] = { 0 };
-    int16_t *polyVecU[MLKEM_K_MAX] = { 0 };
-    int16_t *tmpPolyVec = BSL_SAL_Calloc(MLKEM_N * k * 3, sizeof(int16_t));
-    if (tmpPolyVec == NULL) {
-        return BSL_MALLOC_FAIL;
-    }
-    // Reference the memory
-    for (i = 0; i < k; ++i) {
-        polyVecY[i] = tmpPolyVec + MLKEM_N * i;
-        polyVecE1[i] = polyVecY[i] + k * MLKEM_N;
-        polyVecU[i] = polyVecE1[i] + k * MLKEM_N;
-    }
-    int32_t ret = 0;
-    
-    GOTO_ERR_IF(SampleEta1(ctx, r, polyVecY, &nonce), ret);  // Step 9 - 12
-    GOTO_ERR_IF(SampleEta2(ctx, r, polyVecE1, &nonce), ret);  // Step 13 - 16
-
-    // Step 17
-    (void)memcpy_s(seedE, MLKEM_SEED_LEN, r, MLKEM_SEED_LEN);
-    seedE[MLKEM_SEED_LEN] = nonce;
-    GOTO_ERR_IF(PRF(ctx->libCtx, seedE, MLKEM_SEED_LEN + 1, bufEncE, MLKEM_PRF_BLOCKSIZE * ctx->info->eta2), ret);
-    MLKEM_SamplePolyCBD(polyE2, bufEncE, ctx->info->eta2);
-    // Step 18
-    MLKEM_TransposeMatrixMulAdd(k, (int16_t **)ctx->keyData.matrix, polyVecY, polyVecU, PRE_COMPUT_TABLE_NTT);
-    // Step 19
-    for (i = 0; i < k; i++) {
-        MLKEM_ComputINTT(polyVecU[i], PRE_COMPUT_TABLE_NTT_MONT);
-        for (n = 0; n < MLKEM_N; n++) {
-            polyVecU[i][n] = Compress(polyVecU[i][n] + polyVecE1[i][n], ctx->info->du);
+    int32_t ret = SampleEta1(ctx, r, w->polyVecY, k, &nonce);  // Step 9 - 12
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    return SampleEta2(ctx, r, w->polyVecE1, k + 1, &nonce);  // Step 13 - 17
+}
+
+// K-PKE.Encrypt Step 19 - 23, u = A^T * y (Step 18) has been accumulated in polyVecU.
+static void PkeEncryptFinish(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, const uint8_t *m, MLKEM_EncWork *w)
+{
+    uint8_t k = ctx->info->k;
+    uint8_t du = ctx->info->du;
+    int16_t *polyE2 = w->polyVecE1[k];
+    int16_t *polyC2 = w->polyC2;
+    // Step 19 and 22: c1 = ByteEncode_du(Compress_du(u)), u = INTT(A^T * y) + e1
+    for (uint8_t i = 0; i < k; i++) {
+        MLKEM_ComputINTT(w->polyVecU[i], PRE_COMPUT_TABLE_NTT_MONT);
+        uint8_t *c1 = ct + MLKEM_ENCODE_BLOCKSIZE * du * i;
+        if (du == 10) {  // From FIPS 203 Table 2, du = 10 or 11
+            CompressEncode10(c1, w->polyVecU[i], w->polyVecE1[i]);
+        } else {
+            CompressEncode11(c1, w->polyVecU[i], w->polyVecE1[i]);
         }
     }
     // Step 21
-    MLKEM_VectorInnerProductAdd(k, ctx->keyData.vectorT, polyVecY, polyC2, PRE_COMPUT_TABLE_NTT);
-    ByteDecode(polyM, m, 1);
+    MLKEM_VectorInnerProductAdd(k, ctx->keyData.vectorT, MulCacheOf(&ctx->keyData, ctx->keyData.vectorTCache),
+                                w->polyVecY, polyC2, PRE_COMPUT_TABLE_NTT_MONT);
     MLKEM_ComputINTT(polyC2, PRE_COMPUT_TABLE_NTT_MONT);
+    // Step 20, 21 and 23: c2 = ByteEncode_dv(Compress_dv(v)), v = INTT(t * y) + e2 + Decompress_1(ByteDecode_1(m))
+    uint8_t *c2 = ct + MLKEM_ENCODE_BLOCKSIZE * du * k;
+    if (ctx->info->dv == 4) {  // dv = 4 or 5
+        CompressEncode4(c2, polyC2, polyE2, m);
+    } else {
+        CompressEncode5(c2, polyC2, polyE2, m);
+    }
+}
 
-    for (n = 0; n < MLKEM_N; n++) {
-        polyM[n] = DeCompress(polyM[n], 1); // Step 20
-        // Step 22
-        polyC2[n] = Compress(polyC2[n] + polyE2[n] + polyM[n], ctx->info->dv);
+int32_t MLKEM_ExpandKey(CRYPT_ML_KEM_Ctx *ctx)
+{
+    uint32_t spins = 1;
+    for (;;) {
+        uint32_t state = __atomic_load_n(&ctx->expandState, __ATOMIC_ACQUIRE);
+        if (state == MLKEM_KEY_EXPANDED) {
+            return CRYPT_SUCCESS;
+        }
+        if (state == MLKEM_KEY_NOT_EXPANDED && __atomic_compare_exchange_n(&ctx->expandState, &state,
+            MLKEM_KEY_EXPANDING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            int32_t ret;
+            if (ctx->dk != NULL) {
+                ret = MLKEM_DecodeDk(ctx, ctx->dk, ctx->dkLen);
+            } else if (ctx->hasSeed) {
+                ret = MLKEM_ExpandSeed(ctx);
+            } else {
+                ret = MLKEM_DecodeEk(ctx, ctx->ek, ctx->ekLen);
+            }
+            // A failed expansion is retried by the next caller.
+            __atomic_store_n(&ctx->expandState, (ret == CRYPT_SUCCESS) ? MLKEM_KEY_EXPANDED : MLKEM_KEY_NOT_EXPANDED,
+                __ATOMIC_RELEASE);
+            return ret;
+        }
+        // Another thread is expanding the key, wait for it.
+        MLKEM_SpinPause(&spins);
     }
+}
 
-    // Step 22
-    for (i = 0; i < k; i++) {
-        ByteEncode(ct + MLKEM_ENCODE_BLOCKSIZE * ctx->info->du * i, polyVecU[i], ctx->info->du);
+/*
+ * Step 18 for num <= MLKEM_BATCH_MAX messages: polyVecU[b] += A^T * polyVecY[b]. Without a stored matrix, row i of
+ * A^T is generated just before the products of output i and is still in L1 when they run.
+ */
+static int32_t PkeTransposeMulAdd(const CRYPT_ML_KEM_Ctx *ctx, int16_t **polyVecY[], int16_t **polyVecU[],
+    uint32_t num)
+{
+    uint8_t k = ctx->info->k;
+    if (!ctx->keyData.noMatrix) {
+        MLKEM_TransposeMatrixMulAddBatch(k, (int16_t **)ctx->keyData.matrix,
+                                         MulCacheOf(&ctx->keyData, (int16_t **)ctx->keyData.matrixCache), polyVecY,
+                                         polyVecU, num, PRE_COMPUT_TABLE_NTT_MONT);
+        return CRYPT_SUCCESS;
+    }
+    int16_t rowBuf[MLKEM_K_MAX * MLKEM_N];
+    int16_t *row[MLKEM_K_MAX];
+    for (uint8_t j = 0; j < k; j++) {
+        row[j] = rowBuf + j * MLKEM_N;
+    }
+    CRYPT_EAL_MdCTX *xofCtx = NULL;
+    int32_t ret = MatrixRowXofNew(ctx->libCtx, &xofCtx);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    for (uint8_t i = 0; i < k; i++) {
+        GOTO_ERR_IF(GenMatrixRow(xofCtx, k, ctx->keyData.rho, i, row, true), ret);
+        for (uint32_t b = 0; b < num; b++) {
+            MLKEM_VectorInnerProductAdd(k, row, NULL, polyVecY[b], polyVecU[b][i], PRE_COMPUT_TABLE_NTT_MONT);
+        }
     }
-    // Step 23
-    ByteEncode(ct + MLKEM_ENCODE_BLOCKSIZE * ctx->info->du * k, polyC2, ctx->info->dv);
 ERR:
-    BSL_SAL_Free(tmpPolyVec);
+    CRYPT_EAL_MdFreeCtx(xofCtx);
     return ret;
 }
 
+// NIST.FIPS.203 Algorithm 14 K-PKE.Encrypt(ekPKE, m, r)
+static int32_t PkeEncrypt(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint8_t *m, uint8_t *r)
+{
+    uint8_t k = ctx->info->k;
+    MLKEM_EncWork w;  // On the stack so that encryption does not allocate.
+    PkeEncWorkInit(k, &w);
+    int32_t ret = PkeEncryptSample(ctx, r, &w);
+    if (ret == CRYPT_SUCCESS) {
+        int16_t **polyVecY = w.polyVecY;
+        int16_t **polyVecU = w.polyVecU;
+        ret = PkeTransposeMulAdd(ctx, &polyVecY, &polyVecU, 1);  // Step 18
+    }
+    if (ret == CRYPT_SUCCESS) {
+        PkeEncryptFinish(ctx, ct, m, &w);
+    }
+    PkeEncWorkCleanse(k, &w);
+    return ret;
+}
+
+/*
+ * K-PKE.Encrypt of num <= MLKEM_BATCH_MAX messages with one scratch per message. Step 18 runs for the whole batch
+ * so that every entry of A is loaded once.
+ */
+static int32_t PkeEncryptBatch(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint8_t *ct[], const uint8_t *m[], uint8_t *r[],
+    MLKEM_EncWork *w)
+{
+    uint8_t k = ctx->info->k;
+    int16_t **polyVecY[MLKEM_BATCH_MAX];
+    int16_t **polyVecU[MLKEM_BATCH_MAX];
+    for (uint32_t b = 0; b < num; b++) {
+        PkeEncWorkInit(k, &w[b]);
+        int32_t ret = PkeEncryptSample(ctx, r[b], &w[b]);
+        RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+        polyVecY[b] = w[b].polyVecY;
+        polyVecU[b] = w[b].polyVecU;
+    }
+    int32_t ret = PkeTransposeMulAdd(ctx, polyVecY, polyVecU, num);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    for (uint32_t b = 0; b < num; b++) {
+        PkeEncryptFinish(ctx, ct[b], m[b], &w[b]);
+    }
+    return CRYPT_SUCCESS;
+}
 
 // NIST.FIPS.203 Algorithm 15 K-PKE.Decrypt(dkPKE, 𝑐)
 static int32_t PkeDecrypt(CRYPT_ML_KEM_Ctx *ctx, uint8_t *result, const uint8_t *ciphertext)
 {
-    uint8_t i;
     uint8_t k = ctx->info->k;
-    uint32_t n;
-    // tmpPolyVec = polyM || polyC2 || polyVecC1
-    int16_t *tmpPolyVec = BSL_SAL_Calloc((k * 2 + 1) * MLKEM_N, sizeof(int16_t));
-    if (tmpPolyVec == NULL) {
-        return BSL_MALLOC_FAIL;
-    }
-    int16_t *polyVecC1[MLKEM_K_MAX];
-    int16_t *polyC2;
-    int16_t *polyM;
-    // Reference the stack memory
-    polyM = tmpPolyVec;
-    polyC2 = tmpPolyVec + MLKEM_N;
-    for (i = 0; i < k; ++i) {
-        polyVecC1[i] = tmpPolyVec + MLKEM_N * (i + 2);
-    }
-    for (i = 0; i < k; i++) {
-        ByteDecode(polyVecC1[i], ciphertext + MLKEM_ENCODE_BLOCKSIZE * ctx->info->du * i, ctx->info->du);  // Step 3
-    }
-    ByteDecode(polyC2, ciphertext + MLKEM_ENCODE_BLOCKSIZE * ctx->info->du * k, ctx->info->dv);   // Step 4
-    for (i = 0; i < k; i++) {
-        for (n = 0; n < MLKEM_N; n++) {
-            polyVecC1[i][n] = DeCompress(polyVecC1[i][n], ctx->info->du);  // Step 3
-            if (i == 0) {
-                polyC2[n] = DeCompress(polyC2[n], ctx->info->dv);  // Step 4
-            }
+    uint8_t du = ctx->info->du;
+    // tmpPolyVec = polyW || polyVecU, on the stack so that decryption does not allocate.
+    int16_t tmpPolyVec[(MLKEM_K_MAX + 1) * MLKEM_N];
+    uint32_t tmpLen = (k + 1) * MLKEM_N * sizeof(int16_t);
+    int16_t *polyW = tmpPolyVec;
+    int16_t *polyVecU[MLKEM_K_MAX];
+    (void)memset_s(polyW, MLKEM_N * sizeof(int16_t), 0, MLKEM_N * sizeof(int16_t));  // Accumulated into
+    for (uint8_t i = 0; i < k; i++) {
+        polyVecU[i] = tmpPolyVec + MLKEM_N * (i + 1);
+        const uint8_t *c1 = ciphertext + MLKEM_ENCODE_BLOCKSIZE * du * i;
+        if (du == 10) {  // From FIPS 203 Table 2, du = 10 or 11
+            DecodeDecompress10(polyVecU[i], c1);  // Step 3
+        } else {
+            DecodeDecompress11(polyVecU[i], c1);
         }
-        MLKEM_ComputNTT(polyVecC1[i], PRE_COMPUT_TABLE_NTT_MONT);
+        MLKEM_ComputNTT(polyVecU[i], PRE_COMPUT_TABLE_NTT_MONT);
     }
-    MLKEM_VectorInnerProductAdd(k, ctx->keyData.vectorS, polyVecC1, polyM, PRE_COMPUT_TABLE_NTT);
-    MLKEM_ComputINTT(polyM, PRE_COMPUT_TABLE_NTT_MONT);
-    // c2 - polyM
-    for (n = 0; n < MLKEM_N; n++) {
-        polyM[n] = Compress(polyC2[n] - polyM[n], 1);
+    // Step 6: w = INTT(s^T * NTT(u'))
+    MLKEM_VectorInnerProductAdd(k, ctx->keyData.vectorS, MulCacheOf(&ctx->keyData, ctx->keyData.vectorSCache),
+                                polyVecU, polyW, PRE_COMPUT_TABLE_NTT_MONT);
+    MLKEM_ComputINTT(polyW, PRE_COMPUT_TABLE_NTT_MONT);
+    // Step 4, 6 and 7
+    const uint8_t *c2 = ciphertext + MLKEM_ENCODE_BLOCKSIZE * du * k;
+    if (ctx->info->dv == 4) {  // dv = 4 or 5
+        DecodeDecryptEncode4(result, c2, polyW);
+    } else {
+        DecodeDecryptEncode5(result, c2, polyW);
     }
-
-    ByteEncode(result, polyM, 1);  // Step 7
-    BSL_SAL_Free(tmpPolyVec);
+    BSL_SAL_CleanseData(tmpPolyVec, tmpLen);
     return CRYPT_SUCCESS;
 }
 
@@ -722,9 +1254,13 @@ int32_t MLKEM_KeyGenInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *d, uint8_t *z)
     uint32_t dkPkeLen = MLKEM_CIPHER_LEN * algInfo->k;
     int32_t ret = MLKEM_CreateMatrixBuf(algInfo->k, &ctx->keyData);
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    ret = MLKEM_CreateSecretBuf(algInfo->k, &ctx->keyData);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
     // (ekPKE,dkPKE) ← K-PKE.KeyGen(𝑑)
     ret = PkeKeyGen(ctx, ctx->ek, ctx->dk, d);
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    ret = MLKEM_BuildMulCache(algInfo->k, &ctx->keyData);
+    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
 
     // dk ← (dkPKE‖ek‖H(ek)‖𝑧)
     if (memcpy_s(ctx->dk + dkPkeLen, ctx->dkLen - dkPkeLen, ctx->ek, ctx->ekLen) != EOK) {
@@ -732,8 +1268,11 @@ int32_t MLKEM_KeyGenInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *d, uint8_t *z)
         return CRYPT_SECUREC_FAIL;
     }
 
-    ret = HashFuncH(ctx->libCtx, ctx->ek, ctx->ekLen, ctx->dk + dkPkeLen + ctx->ekLen, CRYPT_SHA3_256_DIGESTSIZE);
+    ret = HashFuncH(ctx->libCtx, ctx->ek, ctx->ekLen, ctx->ekHash, CRYPT_SHA3_256_DIGESTSIZE);
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    (void)memcpy_s(ctx->dk + dkPkeLen + ctx->ekLen, ctx->dkLen - (dkPkeLen + ctx->ekLen), ctx->ekHash,
+        CRYPT_SHA3_256_DIGESTSIZE);
+    ctx->dkVerified = true;
 
     if (memcpy_s(ctx->dk + dkPkeLen + ctx->ekLen + CRYPT_SHA3_256_DIGESTSIZE,
         ctx->dkLen - (dkPkeLen + ctx->ekLen + CRYPT_SHA3_256_DIGESTSIZE), z, MLKEM_SEED_LEN) != EOK) {
@@ -750,12 +1289,12 @@ int32_t MLKEM_EncapsInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t *ctLen
     uint8_t mhek[MLKEM_SEED_LEN + CRYPT_SHA3_256_DIGESTSIZE];  // m and H(ek)
     uint8_t kr[CRYPT_SHA3_512_DIGESTSIZE];    // K and r
 
-    //  (K,r) = G(m || H(ek))
+    //  (K,r) = G(m || H(ek)), H(ek) is cached in the context.
     (void)memcpy_s(mhek, MLKEM_SEED_LEN, m, MLKEM_SEED_LEN);
-    int32_t ret = HashFuncH(ctx->libCtx, ctx->ek, ctx->ekLen, mhek + MLKEM_SEED_LEN, CRYPT_SHA3_256_DIGESTSIZE);
-    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
+    (void)memcpy_s(mhek + MLKEM_SEED_LEN, CRYPT_SHA3_256_DIGESTSIZE, ctx->ekHash, CRYPT_SHA3_256_DIGESTSIZE);
 
-    ret = HashFuncG(ctx->libCtx, mhek, MLKEM_SEED_LEN + CRYPT_SHA3_256_DIGESTSIZE, kr, CRYPT_SHA3_512_DIGESTSIZE);
+    int32_t ret = HashFuncG(ctx->libCtx, mhek, MLKEM_SEED_LEN + CRYPT_SHA3_256_DIGESTSIZE, kr,
+        CRYPT_SHA3_512_DIGESTSIZE);
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
 
     (void)memcpy_s(sk, *skLen, kr, MLKEM_SHARED_KEY_LEN);
@@ -770,6 +1309,59 @@ int32_t MLKEM_EncapsInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t *ctLen
     return CRYPT_SUCCESS;
 }
 
+// ML-KEM.Encaps_internal for up to MLKEM_BATCH_MAX messages, G and Step 18 of K-PKE.Encrypt are shared.
+static int32_t EncapsBatchGroup(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint8_t *ct, uint8_t *sk, const uint8_t *m,
+    MLKEM_EncWork *w)
+{
+    uint8_t mhek[MLKEM_BATCH_MAX][MLKEM_SEED_LEN + CRYPT_SHA3_256_DIGESTSIZE];  // m and H(ek)
+    uint8_t kr[MLKEM_BATCH_MAX][CRYPT_SHA3_512_DIGESTSIZE];    // K and r
+    const uint8_t *in[MLKEM_BATCH_MAX];
+    uint8_t *out[MLKEM_BATCH_MAX];
+    uint8_t *cts[MLKEM_BATCH_MAX];
+    const uint8_t *ms[MLKEM_BATCH_MAX];
+    uint8_t *rs[MLKEM_BATCH_MAX];
+    for (uint32_t b = 0; b < num; b++) {
+        (void)memcpy_s(mhek[b], MLKEM_SEED_LEN, m + MLKEM_SEED_LEN * b, MLKEM_SEED_LEN);
+        (void)memcpy_s(mhek[b] + MLKEM_SEED_LEN, CRYPT_SHA3_256_DIGESTSIZE, ctx->ekHash, CRYPT_SHA3_256_DIGESTSIZE);
+        in[b] = mhek[b];
+        out[b] = kr[b];
+        cts[b] = ct + ctx->info->cipherLen * b;
+        ms[b] = m + MLKEM_SEED_LEN * b;
+        rs[b] = kr[b] + MLKEM_SHARED_KEY_LEN;
+    }
+    //  (K,r) = G(m || H(ek))
+    int32_t ret;
+    GOTO_ERR_IF(HashFuncGBatch(ctx->libCtx, num, in, sizeof(mhek[0]), out), ret);
+    // 𝑐 ← K-PKE.Encrypt(ek,𝑚,𝑟)
+    GOTO_ERR_IF(PkeEncryptBatch(ctx, num, cts, ms, rs, w), ret);
+    for (uint32_t b = 0; b < num; b++) {
+        (void)memcpy_s(sk + MLKEM_SHARED_KEY_LEN * b, MLKEM_SHARED_KEY_LEN, kr[b], MLKEM_SHARED_KEY_LEN);
+    }
+ERR:
+    BSL_SAL_CleanseData(mhek, sizeof(mhek));
+    BSL_SAL_CleanseData(kr, sizeof(kr));
+    return ret;
+}
+
+int32_t MLKEM_EncapsBatchInternal(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint8_t *ct, uint8_t *sk, const uint8_t *m)
+{
+    uint8_t k = ctx->info->k;
+    MLKEM_EncWork *w = BSL_SAL_Malloc(sizeof(MLKEM_EncWork) * MLKEM_BATCH_MAX);
+    RETURN_RET_IF(w == NULL, BSL_MALLOC_FAIL);
+    int32_t ret = CRYPT_SUCCESS;
+    for (uint32_t base = 0; base < num; base += MLKEM_BATCH_MAX) {
+        uint32_t cnt = (num - base < MLKEM_BATCH_MAX) ? (num - base) : MLKEM_BATCH_MAX;
+        GOTO_ERR_IF(EncapsBatchGroup(ctx, cnt, ct + ctx->info->cipherLen * base, sk + MLKEM_SHARED_KEY_LEN * base,
+            m + MLKEM_SEED_LEN * base, w), ret);
+    }
+ERR:
+    for (uint32_t b = 0; b < MLKEM_BATCH_MAX; b++) {
+        PkeEncWorkCleanse(k, &w[b]);
+    }
+    BSL_SAL_Free(w);
+    return ret;
+}
+
 // NIST.FIPS.203 Algorithm 18 ML-KEM.Decaps_internal(dk, 𝑐)
 int32_t MLKEM_DecapsInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t ctLen, uint8_t *sk, uint32_t *skLen)
 {
@@ -782,15 +1374,13 @@ int32_t MLKEM_DecapsInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t ctLen,
     uint8_t mh[MLKEM_SEED_LEN + CRYPT_SHA3_256_DIGESTSIZE];    // m′ and h
     uint8_t kr[CRYPT_SHA3_512_DIGESTSIZE];    // K' and r'
 
-    // NIST.FIPS.203: test = H(dk[384k : 768k + 32]) and check test == h
-    int32_t ret = HashFuncH(ctx->libCtx, ek, 384 * ctx->info->k + 32, mh, CRYPT_SHA3_256_DIGESTSIZE);
-    RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
-    if (memcmp(h, mh, CRYPT_SHA3_256_DIGESTSIZE) != 0) {
+    // NIST.FIPS.203: test = H(dk[384k : 768k + 32]) and check test == h, done once when dk is set.
+    if (!ctx->dkVerified) {
         BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_INVALID_PRVKEY);
         return CRYPT_MLKEM_INVALID_PRVKEY;
     }
 
-    ret = PkeDecrypt(ctx, mh, ct);  // Step 5: 𝑚′ ← K-PKE.Decrypt(dkPKE, 𝑐)
+    int32_t ret = PkeDecrypt(ctx, mh, ct);  // Step 5: 𝑚′ ← K-PKE.Decrypt(dkPKE, 𝑐)
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
     // Step 6: (K′,r′) ← G(m′ || h)
     (void)memcpy_s(mh + MLKEM_SEED_LEN, CRYPT_SHA3_256_DIGESTSIZE, h, CRYPT_SHA3_256_DIGESTSIZE);
@@ -798,8 +1388,7 @@ int32_t MLKEM_DecapsInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t ctLen,
     RETURN_RET_IF(ret != CRYPT_SUCCESS, ret);
     // Step 8: 𝑐′ ← K-PKE.Encrypt(ekPKE,𝑚′,𝑟′)
     uint8_t *r = kr + MLKEM_SHARED_KEY_LEN;
-    uint8_t *newCt = BSL_SAL_Malloc(ctLen + MLKEM_SEED_LEN);
-    RETURN_RET_IF(newCt == NULL, BSL_MALLOC_FAIL);
+    uint8_t newCt[MLKEM_CIPHERTEXT_MAX_LEN + MLKEM_SEED_LEN];  // c' and later z || c
     GOTO_ERR_IF(PkeEncrypt(ctx, newCt, mh, r), ret);
 
     // Step 9: if c != c′
@@ -814,8 +1403,87 @@ int32_t MLKEM_DecapsInternal(CRYPT_ML_KEM_Ctx *ctx, uint8_t *ct, uint32_t ctLen,
     *skLen = MLKEM_SHARED_KEY_LEN;
 ERR:
     BSL_SAL_CleanseData(kr, CRYPT_SHA3_512_DIGESTSIZE);
-    BSL_SAL_Free(newCt);
+    BSL_SAL_CleanseData(newCt, ctLen + MLKEM_SEED_LEN);
+    return ret;
+}
+
+// Scratch of one group of DecapsBatchGroup.
+typedef struct {
+    MLKEM_EncWork enc[MLKEM_BATCH_MAX];
+    uint8_t newCt[MLKEM_BATCH_MAX][MLKEM_CIPHERTEXT_MAX_LEN];
+    uint8_t zc[MLKEM_BATCH_MAX][MLKEM_SEED_LEN + MLKEM_CIPHERTEXT_MAX_LEN];  // z || c
+} MLKEM_DecBatchWork;
+
+/*
+ * ML-KEM.Decaps_internal for up to MLKEM_BATCH_MAX ciphertexts. G, J and Step 18 of the re-encryption are shared
+ * by the group. J is computed for every ciphertext and the shared key is selected afterwards.
+ */
+static int32_t DecapsBatchGroup(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, const uint8_t *ct, uint8_t *sk,
+    MLKEM_DecBatchWork *w)
+{
+    uint32_t ctLen = ctx->info->cipherLen;
+    const uint8_t *h = ctx->dk + MLKEM_CIPHER_LEN * ctx->info->k + ctx->info->encapsKeyLen;
+    const uint8_t *z = h + MLKEM_SEED_LEN;
+    uint8_t mh[MLKEM_BATCH_MAX][MLKEM_SEED_LEN + CRYPT_SHA3_256_DIGESTSIZE];  // m′ and h
+    uint8_t kr[MLKEM_BATCH_MAX][CRYPT_SHA3_512_DIGESTSIZE];  // K' and r'
+    uint8_t kBar[MLKEM_BATCH_MAX][MLKEM_SHARED_KEY_LEN];  // J(z || c)
+    const uint8_t *mhIn[MLKEM_BATCH_MAX];
+    const uint8_t *zcIn[MLKEM_BATCH_MAX];
+    uint8_t *krOut[MLKEM_BATCH_MAX];
+    uint8_t *kBarOut[MLKEM_BATCH_MAX];
+    uint8_t *newCts[MLKEM_BATCH_MAX];
+    uint8_t *rs[MLKEM_BATCH_MAX];
+    int32_t ret;
+
+    for (uint32_t b = 0; b < num; b++) {
+        const uint8_t *c = ct + ctLen * b;
+        GOTO_ERR_IF(PkeDecrypt(ctx, mh[b], c), ret);  // Step 5: 𝑚′ ← K-PKE.Decrypt(dkPKE, 𝑐)
+        (void)memcpy_s(mh[b] + MLKEM_SEED_LEN, CRYPT_SHA3_256_DIGESTSIZE, h, CRYPT_SHA3_256_DIGESTSIZE);
+        (void)memcpy_s(w->zc[b], sizeof(w->zc[b]), z, MLKEM_SEED_LEN);
+        (void)memcpy_s(w->zc[b] + MLKEM_SEED_LEN, sizeof(w->zc[b]) - MLKEM_SEED_LEN, c, ctLen);
+        mhIn[b] = mh[b];
+        zcIn[b] = w->zc[b];
+        krOut[b] = kr[b];
+        kBarOut[b] = kBar[b];
+        newCts[b] = w->newCt[b];
+        rs[b] = kr[b] + MLKEM_SHARED_KEY_LEN;
+    }
+    // Step 6: (K′,r′) ← G(m′ || h)
+    GOTO_ERR_IF(HashFuncGBatch(ctx->libCtx, num, mhIn, sizeof(mh[0]), krOut), ret);
+    // Step 7: K = J(z || c)
+    GOTO_ERR_IF(HashFuncJBatch(ctx->libCtx, num, zcIn, MLKEM_SEED_LEN + ctLen, kBarOut), ret);
+    // Step 8: 𝑐′ ← K-PKE.Encrypt(ekPKE,𝑚′,𝑟′)
+    GOTO_ERR_IF(PkeEncryptBatch(ctx, num, newCts, (const uint8_t **)mhIn, rs, w->enc), ret);
+    // Step 9: if c != c′
+    for (uint32_t b = 0; b < num; b++) {
+        const uint8_t *key = (memcmp(ct + ctLen * b, w->newCt[b], ctLen) == 0) ? kr[b] : kBar[b];
+        (void)memcpy_s(sk + MLKEM_SHARED_KEY_LEN * b, MLKEM_SHARED_KEY_LEN, key, MLKEM_SHARED_KEY_LEN);
+    }
+ERR:
+    BSL_SAL_CleanseData(mh, sizeof(mh));
+    BSL_SAL_CleanseData(kr, sizeof(kr));
+    BSL_SAL_CleanseData(kBar, sizeof(kBar));
+    return ret;
+}
+
+int32_t MLKEM_DecapsBatchInternal(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, const uint8_t *ct, uint8_t *sk)
+{
+    // NIST.FIPS.203: test = H(dk[384k : 768k + 32]) and check test == h, done once when dk is set.
+    if (!ctx->dkVerified) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MLKEM_INVALID_PRVKEY);
+        return CRYPT_MLKEM_INVALID_PRVKEY;
+    }
+    MLKEM_DecBatchWork *w = BSL_SAL_Malloc(sizeof(MLKEM_DecBatchWork));
+    RETURN_RET_IF(w == NULL, BSL_MALLOC_FAIL);
+    int32_t ret = CRYPT_SUCCESS;
+    for (uint32_t base = 0; base < num; base += MLKEM_BATCH_MAX) {
+        uint32_t cnt = (num - base < MLKEM_BATCH_MAX) ? (num - base) : MLKEM_BATCH_MAX;
+        GOTO_ERR_IF(DecapsBatchGroup(ctx, cnt, ct + ctx->info->cipherLen * base, sk + MLKEM_SHARED_KEY_LEN * base,
+            w), ret);
+    }
+ERR:
+    BSL_SAL_ClearFree(w, sizeof(MLKEM_DecBatchWork));
     return ret;
 }
 
-#endif
\ No newline at end of file
+#endif
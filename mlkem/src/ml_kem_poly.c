@@ -17,22 +17,77 @@
 // #ifdef HITLS_CRYPTO_MLKEM
 #include "ml_kem_local.h"
 
+/*
+ * Lazy-reduction base multiplication. The k products of a row are accumulated in 32-bit and reduced once
+ * per output coefficient.
+ * Bounds: the operands of src1 are in the Montgomery domain and all inputs satisfy |f|, |g|, |factor| < MLKEM_Q.
+ * For k <= MLKEM_K_MAX = 4 every accumulator stays below 4 * 2 * MLKEM_Q^2 < 2^15 * MLKEM_Q, which is the
+ * input range of MontgomeryReduction, so each added value is below MLKEM_Q and comes out in the normal domain.
+ */
+typedef struct {
+    int32_t f0g0;
+    int32_t f1g1;
+    int32_t cross;  // f0 * g1 + f1 * g0
+} MLKEM_BaseMulAcc;
+
+static inline void BaseMulAcc(MLKEM_BaseMulAcc *acc, const int16_t *f, const int16_t *g)
+{
+    acc->f0g0 += (int32_t)f[0] * g[0];
+    acc->f1g1 += (int32_t)f[1] * g[1];
+    acc->cross += (int32_t)f[0] * g[1] + (int32_t)f[1] * g[0];
+}
+
 // basecase multiplication: add to polyH but not override it
-static void BaseMulAdd(int16_t polyH[2], const int16_t f0, const int16_t f1, const int16_t g0, const int16_t g1,
-                       const int16_t factor)
+static inline void BaseMulReduceAdd(int16_t polyH[2], const MLKEM_BaseMulAcc *acc, const int16_t factor)
+{
+    int16_t t = MontgomeryReduction(acc->f1g1);
+    polyH[0] += MontgomeryReduction(acc->f0g0 + (int32_t)t * factor);
+    polyH[1] += MontgomeryReduction(acc->cross);
+}
+
+/*
+ * With the mulcache of src1, cache[i] = src1[2 * i + 1] * zeta_i, reduced, where zeta_i is the factor of pair i
+ * (factor[i / 2], negated for odd i). f1 * g1 * zeta then accumulates with f0 * g0, so every output coefficient is
+ * one plain sum of products reduced once, and the loops run over coefficients instead of over pairs.
+ * Both sums stay below 2 * k * MLKEM_Q^2, the bound above.
+ */
+static void PolyVecMulAddCached(int16_t dest[MLKEM_N], const int16_t *src1[MLKEM_K_MAX],
+                                const int16_t *cache1[MLKEM_K_MAX], int16_t **src2, uint8_t k)
 {
-    polyH[0] += (int16_t)((f0 * g0 + f1 * g1 % MLKEM_Q * factor) % MLKEM_Q);
-    polyH[1] += (int16_t)((f0 * g1 + f1 * g0) % MLKEM_Q);
+    int32_t acc[MLKEM_N] = { 0 };
+    for (uint8_t j = 0; j < k; j++) {
+        const int16_t *f = src1[j];
+        const int16_t *c = cache1[j];
+        const int16_t *g = src2[j];
+        for (uint32_t i = 0; i < MLKEM_N_HALF; i++) {
+            acc[2 * i] += (int32_t)f[2 * i] * g[2 * i] + (int32_t)c[i] * g[2 * i + 1];
+            acc[2 * i + 1] += (int32_t)f[2 * i] * g[2 * i + 1] + (int32_t)f[2 * i + 1] * g[2 * i];
+        }
+    }
+    for (uint32_t n = 0; n < MLKEM_N; n++) {
+        dest[n] += MontgomeryReduction(acc[n]);
+    }
+    BSL_SAL_CleanseData(acc, sizeof(acc));
 }
 
-static void CircMulAdd(int16_t dest[MLKEM_N], const int16_t src1[MLKEM_N], const int16_t src2[MLKEM_N],
-                       const int16_t *factor)
+// dest += sum(src1[j] * src2[j]), j < k. cache1 is the mulcache of src1, or NULL.
+static void PolyVecMulAdd(int16_t dest[MLKEM_N], const int16_t *src1[MLKEM_K_MAX],
+                          const int16_t *cache1[MLKEM_K_MAX], int16_t **src2, uint8_t k, const int16_t *factor)
 {
+    if (cache1 != NULL) {
+        PolyVecMulAddCached(dest, src1, cache1, src2, k);
+        return;
+    }
     for (uint32_t i = 0; i < MLKEM_N / 4; i++) {
-        // 4-byte data is calculated in each round.
-        BaseMulAdd(&dest[4 * i], src1[4 * i], src1[4 * i + 1], src2[4 * i], src2[4 * i + 1], factor[i]);
-        BaseMulAdd(&dest[4 * i + 2], src1[4 * i + 2], src1[4 * i + 3], src2[4 * i + 2], src2[4 * i + 3],
-                   -1 * factor[i]);
+        // 4 coefficients are calculated in each round, the second pair uses -factor[i].
+        MLKEM_BaseMulAcc acc0 = { 0 };
+        MLKEM_BaseMulAcc acc1 = { 0 };
+        for (uint8_t j = 0; j < k; j++) {
+            BaseMulAcc(&acc0, &src1[j][4 * i], &src2[j][4 * i]);
+            BaseMulAcc(&acc1, &src1[j][4 * i + 2], &src2[j][4 * i + 2]);
+        }
+        BaseMulReduceAdd(&dest[4 * i], &acc0, factor[i]);
+        BaseMulReduceAdd(&dest[4 * i + 2], &acc1, -1 * factor[i]);
     }
 }
 
@@ -42,45 +97,73 @@ static void PolyReduce(int16_t *poly)
         poly[i] = BarrettReduction(poly[i]);
     }
 }
+
+void MLKEM_PolyToMont(int16_t *poly)
+{
+    for (int i = 0; i < MLKEM_N; ++i) {
+        poly[i] = MontgomeryReduction((int32_t)poly[i] * MLKEM_MONT_R2);
+    }
+}
+// polyOut += (row * polyVec), then reduced: one row of MLKEM_MatrixMulAdd
+void MLKEM_MatrixRowMulAdd(uint8_t k, int16_t **row, int16_t **polyVec, int16_t *polyOut, const int16_t *factor)
+{
+    const int16_t *vec[MLKEM_K_MAX];
+    for (int j = 0; j < k; ++j) {
+        vec[j] = row[j];
+    }
+    PolyVecMulAdd(polyOut, vec, NULL, polyVec, k, factor + MLKEM_N_HALF / 2);
+    PolyReduce(polyOut);
+}
+
 // polyVecOut += (matrix * polyVec): add to polyVecOut but not override it
 void MLKEM_MatrixMulAdd(uint8_t k, int16_t **matrix, int16_t **polyVec, int16_t **polyVecOut, const int16_t *factor)
 {
-    int16_t **currOutPoly = polyVecOut;
     for (int i = 0; i < k; ++i) {
-        int16_t **currMatrixPoly = matrix + i * MLKEM_K_MAX;
-        int16_t **currVecPoly = polyVec;
-        for (int j = 0; j < k; ++j) {
-            CircMulAdd(*currOutPoly, *currMatrixPoly, *currVecPoly, factor + MLKEM_N_HALF / 2);
-            ++currMatrixPoly;
-            ++currVecPoly;
-        }
-        PolyReduce(*currOutPoly);
-        ++currOutPoly;
+        MLKEM_MatrixRowMulAdd(k, matrix + i * MLKEM_K_MAX, polyVec, polyVecOut[i], factor);
     }
 }
 
-// polyVecOut += (matrix^T * polyVec): add to polyVecOut but not override it
-void MLKEM_TransposeMatrixMulAdd(uint8_t k, int16_t **matrix, int16_t **polyVec, int16_t **polyVecOut,
-                                 const int16_t *factor)
+/*
+ * polyVecOut[b] += (matrix^T * polyVec[b]) for b < num, each column of the matrix is loaded once for the whole batch.
+ * matrixCache is the mulcache of the matrix, laid out as the matrix, or NULL.
+ */
+void MLKEM_TransposeMatrixMulAddBatch(uint8_t k, int16_t **matrix, int16_t **matrixCache, int16_t **polyVec[],
+                                      int16_t **polyVecOut[], uint32_t num, const int16_t *factor)
 {
-    int16_t **currOutPoly = polyVecOut;
+    const int16_t *column[MLKEM_K_MAX];
+    const int16_t *columnCache[MLKEM_K_MAX];
     for (int i = 0; i < k; ++i) {
-        int16_t **currMatrixPoly = matrix + i;
-        int16_t **currVecPoly = polyVec;
         for (int j = 0; j < k; ++j) {
-            CircMulAdd(*currOutPoly, *currMatrixPoly, *currVecPoly, factor + MLKEM_N_HALF / 2);
-            currMatrixPoly += MLKEM_K_MAX;
-            ++currVecPoly;
+            column[j] = matrix[j * MLKEM_K_MAX + i];
+            columnCache[j] = (matrixCache != NULL) ? matrixCache[j * MLKEM_K_MAX + i] : NULL;
+        }
+        for (uint32_t b = 0; b < num; b++) {
+            PolyVecMulAdd(polyVecOut[b][i], column, (matrixCache != NULL) ? columnCache : NULL, polyVec[b], k,
+                          factor + MLKEM_N_HALF / 2);
         }
-        ++currOutPoly;
     }
 }
 
-void MLKEM_VectorInnerProductAdd(uint8_t k, int16_t **polyVec1, int16_t **polyVec2, int16_t *polyOut,
-                                 const int16_t *factor)
+// polyOut += polyVec1 * polyVec2, cache1 is the mulcache of polyVec1 or NULL.
+void MLKEM_VectorInnerProductAdd(uint8_t k, int16_t **polyVec1, int16_t **cache1, int16_t **polyVec2,
+                                 int16_t *polyOut, const int16_t *factor)
 {
+    const int16_t *vec[MLKEM_K_MAX];
+    const int16_t *vecCache[MLKEM_K_MAX];
     for (int i = 0; i < k; ++i) {
-        CircMulAdd(polyOut, polyVec1[i], polyVec2[i], factor + MLKEM_N_HALF / 2);
+        vec[i] = polyVec1[i];
+        vecCache[i] = (cache1 != NULL) ? cache1[i] : NULL;
+    }
+    PolyVecMulAdd(polyOut, vec, (cache1 != NULL) ? vecCache : NULL, polyVec2, k, factor + MLKEM_N_HALF / 2);
+}
+
+// The mulcache of poly: its odd coefficients multiplied by the zeta of their pair, see PolyVecMulAddCached.
+void MLKEM_PolyMulCache(int16_t cache[MLKEM_N_HALF], const int16_t *poly, const int16_t *factor)
+{
+    factor += MLKEM_N_HALF / 2;
+    for (uint32_t i = 0; i < MLKEM_N / 4; i++) {
+        cache[2 * i] = MontgomeryReduction((int32_t)poly[4 * i + 1] * factor[i]);
+        cache[2 * i + 1] = MontgomeryReduction((int32_t)poly[4 * i + 3] * -factor[i]);
     }
 }
 
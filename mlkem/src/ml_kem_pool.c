@@ -0,0 +1,225 @@
+/*
+ * This file is part of the openHiTLS project.
+ *
+ * openHiTLS is licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *     http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "hitls_build.h"
+#if defined(HITLS_CRYPTO_MLKEM) && defined(HITLS_CRYPTO_MLKEM_POOL)
+#include "securec.h"
+#include "crypt_errno.h"
+#include "bsl_sal.h"
+#include "bsl_errno.h"
+#include "bsl_err_internal.h"
+#include "crypt_utils.h"
+#include "ml_kem_local.h"
+
+/*
+ * Pool of pre-generated ML-KEM keypairs for one parameter set.
+ * Worker threads refill a bounded lock-free MPMC ring (one sequence number per cell) up to highWater and go to
+ * sleep until a pop takes the pool below lowWater. CRYPT_ML_KEM_PoolPop is a single dequeue; when the ring is empty
+ * the keypair is generated by the caller instead.
+ * count is the number of queued keypairs plus the ones being generated, so the ring never overflows.
+ */
+#define MLKEM_POOL_MAX_KEYS (1U << 16)
+#define MLKEM_POOL_MAX_WORKERS 64
+#define MLKEM_POOL_WAIT_MS 100
+
+struct CryptMlKemPool {
+    void *libCtx;
+    int32_t keyType;
+    uint32_t lowWater;
+    uint32_t highWater;
+    MLKEM_Ring ring;
+    uint32_t count;
+    uint32_t stop;
+    CRYPT_ML_KEM_PoolStat stat;
+    BSL_SAL_ThreadLockHandle lock;
+    BSL_SAL_CondVar cond;
+    uint32_t workerNum;
+    BSL_SAL_ThreadId *workers;
+};
+
+#define POOL_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define POOL_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define POOL_ADD(p, v) __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define POOL_SUB(p, v) __atomic_sub_fetch((p), (v), __ATOMIC_ACQ_REL)
+
+static CRYPT_ML_KEM_Ctx *PoolGenKey(const CRYPT_ML_KEM_Pool *pool)
+{
+    CRYPT_ML_KEM_Ctx *ctx = CRYPT_ML_KEM_NewCtxEx(pool->libCtx);
+    if (ctx == NULL) {
+        return NULL;
+    }
+    int32_t keyType = pool->keyType;
+    if (CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_SET_PARA_BY_ID, &keyType, sizeof(keyType)) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_GenKey(ctx) != CRYPT_SUCCESS) {
+        CRYPT_ML_KEM_FreeCtx(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static void PoolWait(CRYPT_ML_KEM_Pool *pool)
+{
+    (void)BSL_SAL_ThreadWriteLock(pool->lock);
+    if (POOL_LOAD(&pool->stop) == 0) {
+        (void)BSL_SAL_CondTimedwaitMs(pool->lock, pool->cond, MLKEM_POOL_WAIT_MS);
+    }
+    (void)BSL_SAL_ThreadUnlock(pool->lock);
+}
+
+static void *PoolWorker(void *arg)
+{
+    CRYPT_ML_KEM_Pool *pool = (CRYPT_ML_KEM_Pool *)arg;
+    bool filling = true;
+    while (POOL_LOAD(&pool->stop) == 0) {
+        uint32_t count = POOL_LOAD(&pool->count);
+        if (count >= pool->highWater) {
+            filling = false;
+        } else if (count < pool->lowWater) {
+            filling = true;
+        }
+        if (!filling) {
+            PoolWait(pool);
+            continue;
+        }
+        // Reserve a slot before generating so that several workers never exceed highWater together.
+        if (POOL_ADD(&pool->count, 1) > pool->highWater) {
+            (void)POOL_SUB(&pool->count, 1);
+            continue;
+        }
+        CRYPT_ML_KEM_Ctx *ctx = PoolGenKey(pool);
+        if (ctx == NULL) {
+            (void)POOL_SUB(&pool->count, 1);
+            (void)POOL_ADD(&pool->stat.genFail, 1);
+            PoolWait(pool);
+            continue;
+        }
+        (void)MLKEM_RingPush(&pool->ring, ctx);  // Cannot fail, count never exceeds the capacity.
+        (void)POOL_ADD(&pool->stat.generated, 1);
+    }
+    return NULL;
+}
+
+static int32_t PoolCheckPara(int32_t keyType, const CRYPT_ML_KEM_PoolPara *para)
+{
+    if (para == NULL) {
+        return CRYPT_NULL_INPUT;
+    }
+    if (keyType != CRYPT_KEM_TYPE_MLKEM_512 && keyType != CRYPT_KEM_TYPE_MLKEM_768 &&
+        keyType != CRYPT_KEM_TYPE_MLKEM_1024) {
+        return CRYPT_NOT_SUPPORT;
+    }
+    if (para->lowWater == 0 || para->lowWater > para->highWater || para->highWater > MLKEM_POOL_MAX_KEYS ||
+        para->workers == 0 || para->workers > MLKEM_POOL_MAX_WORKERS) {
+        return CRYPT_INVALID_ARG;
+    }
+    return CRYPT_SUCCESS;
+}
+
+CRYPT_ML_KEM_Pool *CRYPT_ML_KEM_PoolNew(void *libCtx, int32_t keyType, const CRYPT_ML_KEM_PoolPara *para)
+{
+    int32_t ret = PoolCheckPara(keyType, para);
+    if (ret != CRYPT_SUCCESS) {
+        BSL_ERR_PUSH_ERROR(ret);
+        return NULL;
+    }
+    CRYPT_ML_KEM_Pool *pool = BSL_SAL_Calloc(1, sizeof(CRYPT_ML_KEM_Pool));
+    if (pool == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        return NULL;
+    }
+    pool->libCtx = libCtx;
+    pool->keyType = keyType;
+    pool->lowWater = para->lowWater;
+    pool->highWater = para->highWater;
+    pool->workers = BSL_SAL_Calloc(para->workers, sizeof(BSL_SAL_ThreadId));
+    if (pool->workers == NULL || MLKEM_RingInit(&pool->ring, pool->highWater) != CRYPT_SUCCESS ||
+        BSL_SAL_ThreadLockNew(&pool->lock) != BSL_SUCCESS || BSL_SAL_CreateCondVar(&pool->cond) != BSL_SUCCESS) {
+        BSL_ERR_PUSH_ERROR(CRYPT_MEM_ALLOC_FAIL);
+        CRYPT_ML_KEM_PoolFree(pool);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < para->workers; i++) {
+        ret = BSL_SAL_ThreadCreate(&pool->workers[i], PoolWorker, pool);
+        if (ret != BSL_SUCCESS) {
+            BSL_ERR_PUSH_ERROR(ret);
+            CRYPT_ML_KEM_PoolFree(pool);
+            return NULL;
+        }
+        pool->workerNum++;
+    }
+    return pool;
+}
+
+CRYPT_ML_KEM_Ctx *CRYPT_ML_KEM_PoolPop(CRYPT_ML_KEM_Pool *pool)
+{
+    if (pool == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return NULL;
+    }
+    CRYPT_ML_KEM_Ctx *ctx = MLKEM_RingPop(&pool->ring);
+    if (ctx == NULL) {
+        (void)POOL_ADD(&pool->stat.empty, 1);
+        (void)BSL_SAL_CondSignal(pool->cond);
+        return PoolGenKey(pool);
+    }
+    (void)POOL_ADD(&pool->stat.popped, 1);
+    if (POOL_SUB(&pool->count, 1) < pool->lowWater) {
+        (void)BSL_SAL_CondSignal(pool->cond);
+    }
+    return ctx;
+}
+
+int32_t CRYPT_ML_KEM_PoolGetStat(const CRYPT_ML_KEM_Pool *pool, CRYPT_ML_KEM_PoolStat *stat)
+{
+    if (pool == NULL || stat == NULL) {
+        BSL_ERR_PUSH_ERROR(CRYPT_NULL_INPUT);
+        return CRYPT_NULL_INPUT;
+    }
+    stat->generated = POOL_LOAD(&pool->stat.generated);
+    stat->popped = POOL_LOAD(&pool->stat.popped);
+    stat->empty = POOL_LOAD(&pool->stat.empty);
+    stat->genFail = POOL_LOAD(&pool->stat.genFail);
+    stat->discarded = POOL_LOAD(&pool->stat.discarded);
+    stat->available = POOL_LOAD(&pool->count);
+    return CRYPT_SUCCESS;
+}
+
+void CRYPT_ML_KEM_PoolFree(CRYPT_ML_KEM_Pool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    POOL_STORE(&pool->stop, 1);
+    for (uint32_t i = 0; i < pool->workerNum; i++) {
+        (void)BSL_SAL_CondSignal(pool->cond);
+    }
+    for (uint32_t i = 0; i < pool->workerNum; i++) {
+        BSL_SAL_ThreadClose(pool->workers[i]);
+    }
+    if (pool->ring.cells != NULL) {
+        // Keys that were never handed out are cleansed by CRYPT_ML_KEM_FreeCtx.
+        CRYPT_ML_KEM_Ctx *ctx;
+        while ((ctx = MLKEM_RingPop(&pool->ring)) != NULL) {
+            CRYPT_ML_KEM_FreeCtx(ctx);
+            pool->stat.discarded++;
+        }
+    }
+    (void)BSL_SAL_DeleteCondVar(pool->cond);
+    BSL_SAL_ThreadLockFree(pool->lock);
+    MLKEM_RingDeinit(&pool->ring);
+    BSL_SAL_FREE(pool->workers);
+    BSL_SAL_FREE(pool);
+}
+#endif
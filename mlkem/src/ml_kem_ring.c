@@ -0,0 +1,94 @@
+/*
+ * This file is part of the openHiTLS project.
+ *
+ * openHiTLS is licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *
+ *     http://license.coscl.org.cn/MulanPSL2
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "hitls_build.h"
+#if defined(HITLS_CRYPTO_MLKEM) && (defined(HITLS_CRYPTO_MLKEM_POOL) || defined(HITLS_CRYPTO_MLKEM_KEYRING))
+#include "crypt_errno.h"
+#include "bsl_sal.h"
+#include "ml_kem_local.h"
+
+/*
+ * Bounded lock-free MPMC ring with one sequence number per cell, shared by the pools and the keyring.
+ * A cell whose seq equals the enqueue position is free, one whose seq is one past the dequeue position is full.
+ */
+#define RING_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define RING_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define RING_CAS(p, e, v) __atomic_compare_exchange_n((p), (e), (v), true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+
+int32_t MLKEM_RingInit(MLKEM_Ring *ring, uint32_t minCapacity)
+{
+    uint32_t capacity = 2;  // With one cell a full cell could not be told apart from the next free one.
+    while (capacity < minCapacity) {
+        capacity <<= 1;
+    }
+    ring->cells = BSL_SAL_Calloc(capacity, sizeof(MLKEM_RingCell));
+    if (ring->cells == NULL) {
+        return CRYPT_MEM_ALLOC_FAIL;
+    }
+    for (uint32_t i = 0; i < capacity; i++) {
+        ring->cells[i].seq = i;
+    }
+    ring->mask = capacity - 1;
+    ring->enqPos = 0;
+    ring->deqPos = 0;
+    return CRYPT_SUCCESS;
+}
+
+void MLKEM_RingDeinit(MLKEM_Ring *ring)
+{
+    BSL_SAL_FREE(ring->cells);
+}
+
+bool MLKEM_RingPush(MLKEM_Ring *ring, void *item)
+{
+    uint64_t pos = __atomic_load_n(&ring->enqPos, __ATOMIC_RELAXED);
+    for (;;) {
+        MLKEM_RingCell *cell = &ring->cells[pos & ring->mask];
+        int64_t diff = (int64_t)(RING_LOAD(&cell->seq) - pos);
+        if (diff == 0) {
+            if (RING_CAS(&ring->enqPos, &pos, pos + 1)) {
+                cell->item = item;
+                RING_STORE(&cell->seq, pos + 1);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // full
+        } else {
+            pos = __atomic_load_n(&ring->enqPos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void *MLKEM_RingPop(MLKEM_Ring *ring)
+{
+    uint64_t pos = __atomic_load_n(&ring->deqPos, __ATOMIC_RELAXED);
+    for (;;) {
+        MLKEM_RingCell *cell = &ring->cells[pos & ring->mask];
+        int64_t diff = (int64_t)(RING_LOAD(&cell->seq) - (pos + 1));
+        if (diff == 0) {
+            if (RING_CAS(&ring->deqPos, &pos, pos + 1)) {
+                void *item = cell->item;
+                cell->item = NULL;
+                RING_STORE(&cell->seq, pos + ring->mask + 1);
+                return item;
+            }
+        } else if (diff < 0) {
+            return NULL;  // empty
+        } else {
+            pos = __atomic_load_n(&ring->deqPos, __ATOMIC_RELAXED);
+        }
+    }
+}
+#endif
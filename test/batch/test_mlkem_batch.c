@@ -0,0 +1,147 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hitls_build.h"
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_eal_rand.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+// ===============================
+// Batch APIs: CRYPT_ML_KEM_EncapsBatch and CRYPT_ML_KEM_DecapsBatch are bit-identical to as many calls of
+// CRYPT_ML_KEM_Encaps and CRYPT_ML_KEM_Decaps, for batches shorter and longer than the ones processed together, and
+// every invalid ciphertext of a batch is rejected implicitly on its own. Invalid arguments of the batch decapsulation
+// give the errors of CRYPT_ML_KEM_Decaps. The random bytes come from a stream that is rewound before each side, so
+// that both get the same messages.
+// ===============================
+
+#define NUM_MAX    9
+
+static uint64_t g_randState;
+
+// splitmix64, a byte stream that only depends on the seed and the bytes already taken.
+static int32_t StreamRand(uint8_t *out, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        uint64_t z = (g_randState += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        out[i] = (uint8_t)(z ^ (z >> 31));
+    }
+    return CRYPT_SUCCESS;
+}
+
+static uint8_t g_batchCt[NUM_MAX * CIPHER_MAX];
+static uint8_t g_singleCt[NUM_MAX * CIPHER_MAX];
+static uint8_t g_batchShare[NUM_MAX * SHARE_LEN];
+static uint8_t g_singleShare[NUM_MAX * SHARE_LEN];
+static uint8_t g_batchDec[NUM_MAX * SHARE_LEN];
+static uint8_t g_singleDec[NUM_MAX * SHARE_LEN];
+
+// The batch encapsulation gives the ciphertexts and shared secrets of num single ones with the same messages.
+static int TestEncaps(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint32_t ctLen, uint64_t seed)
+{
+    uint32_t cipherLen = sizeof(g_batchCt);
+    uint32_t shareLen = sizeof(g_batchShare);
+    g_randState = seed;
+    if (CRYPT_ML_KEM_EncapsBatch(ctx, num, g_batchCt, &cipherLen, g_batchShare, &shareLen) != CRYPT_SUCCESS ||
+        cipherLen != num * ctLen || shareLen != num * SHARE_LEN) {
+        return 1;
+    }
+    g_randState = seed;
+    for (uint32_t i = 0; i < num; i++) {
+        cipherLen = ctLen;
+        shareLen = SHARE_LEN;
+        if (CRYPT_ML_KEM_Encaps(ctx, g_singleCt + i * ctLen, &cipherLen, g_singleShare + i * SHARE_LEN,
+            &shareLen) != CRYPT_SUCCESS) {
+            return 1;
+        }
+    }
+    return memcmp(g_batchCt, g_singleCt, num * ctLen) != 0 ||
+        memcmp(g_batchShare, g_singleShare, num * SHARE_LEN) != 0;
+}
+
+/*
+ * Every third ciphertext is corrupted. The batch decapsulation gives the shared secrets of num single ones: the
+ * encapsulated secret for the valid ciphertexts and another one, the implicit rejection, for the corrupted ones.
+ */
+static int TestDecaps(CRYPT_ML_KEM_Ctx *ctx, uint32_t num, uint32_t ctLen)
+{
+    for (uint32_t i = 0; i < num; i += 3) {
+        g_batchCt[i * ctLen + (i * 131) % ctLen] ^= 0x01;
+    }
+    uint32_t shareLen = sizeof(g_batchDec);
+    if (CRYPT_ML_KEM_DecapsBatch(ctx, num, g_batchCt, num * ctLen, g_batchDec, &shareLen) != CRYPT_SUCCESS ||
+        shareLen != num * SHARE_LEN) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < num; i++) {
+        uint8_t *dec = g_singleDec + i * SHARE_LEN;
+        shareLen = SHARE_LEN;
+        if (CRYPT_ML_KEM_Decaps(ctx, g_batchCt + i * ctLen, ctLen, dec, &shareLen) != CRYPT_SUCCESS) {
+            return 1;
+        }
+        bool accepted = memcmp(dec, g_batchShare + i * SHARE_LEN, SHARE_LEN) == 0;
+        if (accepted != (i % 3 != 0)) {
+            return 1;
+        }
+    }
+    return memcmp(g_batchDec, g_singleDec, num * SHARE_LEN) != 0;
+}
+
+// num = 0, a NULL argument and lengths that do not hold num items are rejected before anything is written.
+static int TestDecapsArgs(CRYPT_ML_KEM_Ctx *ctx, uint32_t ctLen)
+{
+    uint32_t num = 3;
+    uint32_t shareLen = num * SHARE_LEN;
+    uint32_t shortLen = num * SHARE_LEN - 1;
+    int fail = 0;
+    fail |= CRYPT_ML_KEM_DecapsBatch(ctx, 0, g_batchCt, 0, g_batchDec, &shareLen) != CRYPT_INVALID_ARG;
+    fail |= CRYPT_ML_KEM_DecapsBatch(NULL, num, g_batchCt, num * ctLen, g_batchDec, &shareLen) != CRYPT_NULL_INPUT;
+    fail |= CRYPT_ML_KEM_DecapsBatch(ctx, num, NULL, num * ctLen, g_batchDec, &shareLen) != CRYPT_NULL_INPUT;
+    fail |= CRYPT_ML_KEM_DecapsBatch(ctx, num, g_batchCt, num * ctLen, g_batchDec, NULL) != CRYPT_NULL_INPUT;
+    fail |= CRYPT_ML_KEM_DecapsBatch(ctx, num, g_batchCt, num * ctLen + 1, g_batchDec, &shareLen) !=
+        CRYPT_MLKEM_LEN_NOT_ENOUGH;
+    fail |= CRYPT_ML_KEM_DecapsBatch(ctx, num, g_batchCt, num * ctLen - 1, g_batchDec, &shareLen) !=
+        CRYPT_MLKEM_LEN_NOT_ENOUGH;
+    fail |= CRYPT_ML_KEM_DecapsBatch(ctx, num, g_batchCt, num * ctLen, g_batchDec, &shortLen) !=
+        CRYPT_MLKEM_LEN_NOT_ENOUGH;
+    return fail | (shareLen != num * SHARE_LEN) | (shortLen != num * SHARE_LEN - 1);
+}
+
+int main(void)
+{
+    // Registered in place of the DRBG, every random byte of the program comes from StreamRand.
+    CRYPT_EAL_SetRandCallBack(StreamRand);
+    int fail = 0;
+    const int32_t types[] = { CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768, CRYPT_KEM_TYPE_MLKEM_1024 };
+    const uint32_t nums[] = { 1, 2, 4, 5, NUM_MAX };
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        for (uint32_t noMatrix = 0; noMatrix <= 1; noMatrix++) {
+            g_randState = t * 2 + noMatrix;
+            CRYPT_ML_KEM_Ctx *ctx = NewKey(types[t], noMatrix);
+            uint32_t ctLen = 0;
+            if (ctx == NULL ||
+                CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_GET_CIPHERTEXT_LEN, &ctLen, sizeof(ctLen)) != CRYPT_SUCCESS) {
+                printf("keygen failed\n");
+                return 1;
+            }
+            for (uint32_t n = 0; n < sizeof(nums) / sizeof(nums[0]); n++) {
+                int encaps = TestEncaps(ctx, nums[n], ctLen, 0x5EED0000U + nums[n]);
+                int decaps = encaps | TestDecaps(ctx, nums[n], ctLen);
+                printf("type=%d noMatrix=%u num=%u encaps=%s decaps=%s\n", types[t], noMatrix, nums[n],
+                    encaps ? "FAIL" : "ok", decaps ? "FAIL" : "ok");
+                fail |= encaps | decaps;
+            }
+            int args = TestDecapsArgs(ctx, ctLen);
+            printf("type=%d noMatrix=%u args=%s\n", types[t], noMatrix, args ? "FAIL" : "ok");
+            fail |= args;
+            CRYPT_ML_KEM_FreeCtx(ctx);
+        }
+    }
+    printf(fail ? "FAIL\n" : "PASS\n");
+    return fail;
+}
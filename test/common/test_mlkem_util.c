@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <string.h>
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+CRYPT_ML_KEM_Ctx *NewCtx(int32_t type, uint32_t noMatrix)
+{
+    CRYPT_ML_KEM_Ctx *ctx = CRYPT_ML_KEM_NewCtx();
+    if (ctx == NULL || CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_SET_PARA_BY_ID, &type, sizeof(type)) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_ML_KEM_SET_NO_MATRIX, &noMatrix, sizeof(noMatrix)) != CRYPT_SUCCESS) {
+        CRYPT_ML_KEM_FreeCtx(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+CRYPT_ML_KEM_Ctx *NewKey(int32_t type, uint32_t noMatrix)
+{
+    CRYPT_ML_KEM_Ctx *ctx = NewCtx(type, noMatrix);
+    if (ctx != NULL && CRYPT_ML_KEM_GenKey(ctx) != CRYPT_SUCCESS) {
+        CRYPT_ML_KEM_FreeCtx(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+int Roundtrip(CRYPT_ML_KEM_Ctx *encCtx, CRYPT_ML_KEM_Ctx *decCtx)
+{
+    uint8_t ct[CIPHER_MAX];
+    uint8_t s1[SHARE_LEN];
+    uint8_t s2[SHARE_LEN];
+    uint32_t ctLen = sizeof(ct);
+    uint32_t s1Len = sizeof(s1);
+    uint32_t s2Len = sizeof(s2);
+    if (CRYPT_ML_KEM_Encaps(encCtx, ct, &ctLen, s1, &s1Len) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_Decaps(decCtx, ct, ctLen, s2, &s2Len) != CRYPT_SUCCESS) {
+        return 1;
+    }
+    return memcmp(s1, s2, SHARE_LEN) != 0;
+}
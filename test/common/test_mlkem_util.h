@@ -0,0 +1,25 @@
+#ifndef TEST_MLKEM_UTIL_H
+#define TEST_MLKEM_UTIL_H
+#include <stdint.h>
+#include "crypt_mlkem.h"
+
+// ===============================
+// Fixtures shared by the API tests, compiled and linked with each of them: test_mlkem_util.c.
+// ===============================
+
+// The largest ciphertext, ek and dk, those of ML-KEM-1024.
+#define CIPHER_MAX 1568
+#define EK_MAX     1568
+#define DK_MAX     3168
+#define SHARE_LEN  32
+
+// A context of the parameter set type in the CRYPT_CTRL_ML_KEM_SET_NO_MATRIX mode noMatrix, NULL on failure.
+CRYPT_ML_KEM_Ctx *NewCtx(int32_t type, uint32_t noMatrix);
+
+// The context of NewCtx with a generated key, NULL on failure.
+CRYPT_ML_KEM_Ctx *NewKey(int32_t type, uint32_t noMatrix);
+
+// Encapsulates with encCtx and decapsulates with decCtx, 0 if the shared secrets match.
+int Roundtrip(CRYPT_ML_KEM_Ctx *encCtx, CRYPT_ML_KEM_Ctx *decCtx);
+
+#endif // TEST_MLKEM_UTIL_H
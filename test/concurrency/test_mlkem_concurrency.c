@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_eal_rand.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+// ===============================
+// N threads share one key: every thread encapsulates to it and decapsulates with it, the shared secrets must
+// match. Except for the generated key, each case starts from contexts whose key has not been expanded yet, so the
+// threads also race on the lazy expansion. Run under ThreadSanitizer to check that no thread writes what another reads.
+// ===============================
+
+#define THREAD_MAX      64
+#define DEFAULT_THREADS 8
+#define DEFAULT_ROUNDS  200
+
+typedef struct {
+    CRYPT_ML_KEM_Ctx *encCtx;
+    CRYPT_ML_KEM_Ctx *decCtx;
+    uint32_t rounds;
+    uint32_t failed;
+} WorkerArg;
+
+static void *Worker(void *arg)
+{
+    WorkerArg *w = (WorkerArg *)arg;
+    for (uint32_t i = 0; i < w->rounds; i++) {
+        uint8_t ct[CIPHER_MAX];
+        uint8_t s1[SHARE_LEN];
+        uint8_t s2[SHARE_LEN];
+        uint32_t ctLen = sizeof(ct);
+        uint32_t s1Len = sizeof(s1);
+        uint32_t s2Len = sizeof(s2);
+        if (CRYPT_ML_KEM_Encaps(w->encCtx, ct, &ctLen, s1, &s1Len) != CRYPT_SUCCESS ||
+            CRYPT_ML_KEM_Decaps(w->decCtx, ct, ctLen, s2, &s2Len) != CRYPT_SUCCESS ||
+            memcmp(s1, s2, SHARE_LEN) != 0) {
+            w->failed++;
+        }
+    }
+    return NULL;
+}
+
+static int RunThreads(const char *name, CRYPT_ML_KEM_Ctx *encCtx, CRYPT_ML_KEM_Ctx *decCtx, uint32_t threads,
+    uint32_t rounds)
+{
+    pthread_t tid[THREAD_MAX];
+    WorkerArg arg[THREAD_MAX];
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < threads; i++) {
+        arg[i].encCtx = encCtx;
+        arg[i].decCtx = decCtx;
+        arg[i].rounds = rounds;
+        arg[i].failed = 0;
+        if (pthread_create(&tid[i], NULL, Worker, &arg[i]) != 0) {
+            printf("%s: pthread_create failed\n", name);
+            return 1;
+        }
+    }
+    for (uint32_t i = 0; i < threads; i++) {
+        pthread_join(tid[i], NULL);
+        failed += arg[i].failed;
+    }
+    printf("%-10s threads=%u rounds=%u failed=%u\n", name, threads, rounds, failed);
+    return failed != 0;
+}
+
+// Copies of the key of src, imported as ek and as dk and not expanded yet.
+static int ImportedCopy(CRYPT_ML_KEM_Ctx *src, int32_t type, uint32_t noMatrix, CRYPT_ML_KEM_Ctx **pubCtx,
+    CRYPT_ML_KEM_Ctx **prvCtx)
+{
+    uint8_t ek[CIPHER_MAX];
+    uint8_t dk[DK_MAX];
+    CRYPT_KemEncapsKey pub = { ek, sizeof(ek) };
+    CRYPT_KemDecapsKey prv = { dk, sizeof(dk) };
+    *pubCtx = NewCtx(type, noMatrix);
+    *prvCtx = NewCtx(type, noMatrix);
+    if (*pubCtx == NULL || *prvCtx == NULL || CRYPT_ML_KEM_GetEncapsKey(src, &pub) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_GetDecapsKey(src, &prv) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_SetEncapsKey(*pubCtx, &pub) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_SetDecapsKey(*prvCtx, &prv) != CRYPT_SUCCESS) {
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t threads = (argc > 1) ? (uint32_t)atoi(argv[1]) : DEFAULT_THREADS;
+    uint32_t rounds = (argc > 2) ? (uint32_t)atoi(argv[2]) : DEFAULT_ROUNDS;
+    if (threads == 0 || threads > THREAD_MAX || rounds == 0) {
+        printf("usage: %s [threads 1..%d] [rounds]\n", argv[0], THREAD_MAX);
+        return 1;
+    }
+    if (CRYPT_EAL_RandInit(CRYPT_RAND_SHA256, NULL, NULL, NULL, 0) != CRYPT_SUCCESS) {
+        printf("rand init failed\n");
+        return 1;
+    }
+    int fail = 0;
+    const int32_t types[] = { CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768, CRYPT_KEM_TYPE_MLKEM_1024 };
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        for (uint32_t noMatrix = 0; noMatrix <= 1; noMatrix++) {
+            CRYPT_ML_KEM_Ctx *gen = NewKey(types[t], noMatrix);
+            if (gen == NULL) {
+                printf("keygen failed\n");
+                return 1;
+            }
+            // The expanded key of the generating context.
+            fail |= RunThreads("generated", gen, gen, threads, rounds);
+            // Expanded from ek and from dk by the first thread that uses each context.
+            CRYPT_ML_KEM_Ctx *pubCtx = NULL;
+            CRYPT_ML_KEM_Ctx *prvCtx = NULL;
+            fail |= ImportedCopy(gen, types[t], noMatrix, &pubCtx, &prvCtx) != 0 ? 1 :
+                RunThreads("imported", pubCtx, prvCtx, threads, rounds);
+            // dk and the expanded key are rebuilt from the seed by the first thread.
+            fail |= (CRYPT_ML_KEM_KeepSeedOnly(gen) != CRYPT_SUCCESS) ? 1 :
+                RunThreads("seed", gen, gen, threads, rounds);
+            CRYPT_ML_KEM_FreeCtx(pubCtx);
+            CRYPT_ML_KEM_FreeCtx(prvCtx);
+            CRYPT_ML_KEM_FreeCtx(gen);
+        }
+    }
+    CRYPT_EAL_RandDeinit();
+    printf(fail ? "FAIL\n" : "PASS\n");
+    return fail;
+}
@@ -0,0 +1,291 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "hitls_build.h"
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_eal_rand.h"
+#include "bsl_errno.h"
+#include "bsl_sal.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+// ===============================
+// Single-allocation contexts and the context pool: a block context, in its own allocation or in memory of the
+// caller, works like any other and leaves no secret in its memory once freed or released. A released context is
+// handed out again without allocating, and the pool never keeps more than maxCached contexts, also when threads
+// acquire and release at the same time. The allocations are counted through BSL_SAL_CallBack_Ctrl. Build with
+// HITLS_CRYPTO_MLKEM_POOL.
+// ===============================
+
+#define THREADS      4
+#define ROUNDS       16
+#define SEED_LEN     64
+#define POLY_BYTES   512
+#define BLOCK_ALIGN  64
+
+static int64_t g_mallocs;
+static int64_t g_frees;
+
+static void *CountMalloc(uint32_t size)
+{
+    (void)__atomic_add_fetch(&g_mallocs, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+static void CountFree(void *addr)
+{
+    (void)__atomic_add_fetch(&g_frees, 1, __ATOMIC_RELAXED);
+    free(addr);
+}
+
+static int64_t Live(void)
+{
+    return __atomic_load_n(&g_mallocs, __ATOMIC_RELAXED) - __atomic_load_n(&g_frees, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+    uint8_t dk[DK_MAX];
+    uint8_t seed[SEED_LEN];
+    uint32_t ekLen;
+    uint32_t dkLen;
+} Secret;
+
+// Generates a key in ctx and keeps its dk and its seed d || z.
+static int GenSecret(CRYPT_ML_KEM_Ctx *ctx, Secret *sec)
+{
+    uint32_t format = CRYPT_ML_KEM_DK_FORMAT_SEED;
+    CRYPT_KemDecapsKey seed = { sec->seed, sizeof(sec->seed) };
+    CRYPT_KemDecapsKey prv = { sec->dk, sizeof(sec->dk) };
+    if (CRYPT_ML_KEM_GenKey(ctx) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_ML_KEM_SET_DK_FORMAT, &format, sizeof(format)) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_GetDecapsKey(ctx, &seed) != CRYPT_SUCCESS) {
+        return 1;
+    }
+    format = CRYPT_ML_KEM_DK_FORMAT_EXPANDED;
+    if (CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_ML_KEM_SET_DK_FORMAT, &format, sizeof(format)) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_GetDecapsKey(ctx, &prv) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_GET_PUBKEY_LEN, &sec->ekLen, sizeof(sec->ekLen)) != CRYPT_SUCCESS) {
+        return 1;
+    }
+    sec->dkLen = prv.len;
+    return 0;
+}
+
+static int Contains(const uint8_t *mem, uint32_t memLen, const uint8_t *pattern, uint32_t len)
+{
+    for (uint32_t i = 0; i + len <= memLen; i++) {
+        if (memcmp(mem + i, pattern, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int AllZero(const uint8_t *mem, uint32_t len)
+{
+    uint8_t acc = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        acc |= mem[i];
+    }
+    return acc == 0;
+}
+
+/*
+ * 1 if the block of a freed or released context still holds a secret of sec. A block ends with the expanded s,
+ * ek padded to 64 bytes and dk, see ml_kem.c: s and dk must be zero, and neither the seed nor the encoded s
+ * nor z may be found anywhere in the block.
+ */
+static int SecretLeft(const uint8_t *block, uint32_t blockLen, const Secret *sec)
+{
+    uint32_t k = (sec->ekLen - 32) / 384;
+    uint32_t ekRegion = (sec->ekLen + BLOCK_ALIGN - 1) & ~(uint32_t)(BLOCK_ALIGN - 1);
+    uint32_t dkOff = blockLen - sec->dkLen;
+    uint32_t sOff = dkOff - ekRegion - k * POLY_BYTES;
+    return !AllZero(block + sOff, k * POLY_BYTES) || !AllZero(block + dkOff, sec->dkLen) ||
+        Contains(block, blockLen, sec->seed, SEED_LEN / 2) || Contains(block, blockLen, sec->seed + SEED_LEN / 2,
+        SEED_LEN / 2) || Contains(block, blockLen, sec->dk, 32);
+}
+
+/*
+ * CRYPT_ML_KEM_InitCtxBlock checks its memory and builds the context in place, CRYPT_ML_KEM_NewCtxBlock takes one
+ * allocation. Both interoperate, cannot be given another parameter set and cleanse their keys when freed.
+ */
+static int TestCtxBlock(int32_t type, CRYPT_ML_KEM_CtxPool *pool)
+{
+    static Secret sec;
+    uint32_t size = CRYPT_ML_KEM_GetCtxBlockSize(type);
+    uint8_t *mem = aligned_alloc(BLOCK_ALIGN, (size + BLOCK_ALIGN - 1) & ~(uint32_t)(BLOCK_ALIGN - 1));
+    CRYPT_ML_KEM_Ctx *ctx = NULL;
+    CRYPT_ML_KEM_Ctx *blockCtx = NULL;
+    int fail = 1;
+    if (mem == NULL || size == 0 || CRYPT_ML_KEM_GetCtxBlockSize(0) != 0 ||
+        CRYPT_ML_KEM_InitCtxBlock(NULL, size, NULL, type) != NULL ||
+        CRYPT_ML_KEM_InitCtxBlock(mem + 1, size, NULL, type) != NULL ||
+        CRYPT_ML_KEM_InitCtxBlock(mem, size - 1, NULL, type) != NULL ||
+        CRYPT_ML_KEM_InitCtxBlock(mem, size, NULL, 0) != NULL) {
+        goto EXIT;
+    }
+    ctx = CRYPT_ML_KEM_InitCtxBlock(mem, size, NULL, type);
+    int64_t live = Live();
+    blockCtx = CRYPT_ML_KEM_NewCtxBlock(NULL, type);
+    if ((uint8_t *)ctx != mem || blockCtx == NULL || Live() != live + 1 ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_SET_PARA_BY_ID, &type, sizeof(type)) != CRYPT_MLKEM_CTRL_INIT_REPEATED ||
+        GenSecret(ctx, &sec) != 0 || GenSecret(blockCtx, &sec) != 0 ||
+        Roundtrip(ctx, ctx) != 0 || Roundtrip(blockCtx, blockCtx) != 0 || Roundtrip(blockCtx, ctx) == 0) {
+        goto EXIT;
+    }
+    // Memory of the caller cannot go to a pool.
+    fail = CRYPT_ML_KEM_CtxPoolRelease(pool, ctx) != CRYPT_INVALID_ARG;
+    (void)GenSecret(ctx, &sec);
+    CRYPT_ML_KEM_FreeCtx(ctx);
+    ctx = NULL;
+    fail |= SecretLeft(mem, size, &sec);
+EXIT:
+    CRYPT_ML_KEM_FreeCtx(ctx);
+    CRYPT_ML_KEM_FreeCtx(blockCtx);
+    free(mem);
+    return fail;
+}
+
+/*
+ * A released context is cleansed and is the next one acquired, without an allocation: it has no key and takes a
+ * new one. Contexts of another parameter set or library context are refused.
+ */
+static int TestReuse(int32_t type, int32_t otherType)
+{
+    static Secret sec;
+    uint32_t size = CRYPT_ML_KEM_GetCtxBlockSize(type);
+    int dummy = 0;
+    CRYPT_ML_KEM_CtxPool *pool = CRYPT_ML_KEM_CtxPoolNew(NULL, type, 2);
+    CRYPT_ML_KEM_Ctx *other = CRYPT_ML_KEM_NewCtxBlock(NULL, otherType);
+    CRYPT_ML_KEM_Ctx *foreign = CRYPT_ML_KEM_NewCtxBlock(&dummy, type);
+    CRYPT_ML_KEM_Ctx *ctx = (pool == NULL) ? NULL : CRYPT_ML_KEM_CtxPoolAcquire(pool);
+    int fail = ctx == NULL || other == NULL || foreign == NULL || GenSecret(ctx, &sec) != 0 ||
+        Roundtrip(ctx, ctx) != 0 || CRYPT_ML_KEM_CtxPoolRelease(pool, ctx) != CRYPT_SUCCESS ||
+        SecretLeft((const uint8_t *)ctx, size, &sec) != 0;
+    if (fail == 0) {
+        uint8_t ek[EK_MAX];
+        CRYPT_KemEncapsKey pub = { ek, sizeof(ek) };
+        int64_t live = Live();
+        CRYPT_ML_KEM_Ctx *again = CRYPT_ML_KEM_CtxPoolAcquire(pool);
+        fail = again != ctx || Live() != live || CRYPT_ML_KEM_GetEncapsKey(again, &pub) != CRYPT_MLKEM_KEY_NOT_SET ||
+            GenSecret(again, &sec) != 0 || Roundtrip(again, again) != 0;
+        fail |= CRYPT_ML_KEM_CtxPoolRelease(pool, again) != CRYPT_SUCCESS;
+    }
+    fail |= CRYPT_ML_KEM_CtxPoolRelease(pool, other) != CRYPT_INVALID_ARG ||
+        CRYPT_ML_KEM_CtxPoolRelease(pool, foreign) != CRYPT_INVALID_ARG ||
+        CRYPT_ML_KEM_CtxPoolRelease(pool, NULL) != CRYPT_NULL_INPUT || CRYPT_ML_KEM_CtxPoolAcquire(NULL) != NULL;
+    CRYPT_ML_KEM_FreeCtx(other);
+    CRYPT_ML_KEM_FreeCtx(foreign);
+    CRYPT_ML_KEM_CtxPoolFree(pool);
+    return fail;
+}
+
+/*
+ * maxCached + 5 contexts are acquired and released: maxCached of them stay allocated, the next maxCached acquires
+ * allocate nothing, and freeing the pool frees everything it allocated.
+ */
+static int TestCap(int32_t type, uint32_t maxCached)
+{
+    CRYPT_ML_KEM_Ctx *ctx[64];
+    uint32_t num = maxCached + 5;
+    int64_t live0 = Live();
+    CRYPT_ML_KEM_CtxPool *pool = CRYPT_ML_KEM_CtxPoolNew(NULL, type, maxCached);
+    int fail = pool == NULL || num > sizeof(ctx) / sizeof(ctx[0]);
+    int64_t live = Live();
+    for (uint32_t round = 0; round < 2 && fail == 0; round++) {
+        for (uint32_t i = 0; i < num; i++) {
+            ctx[i] = CRYPT_ML_KEM_CtxPoolAcquire(pool);
+            fail |= ctx[i] == NULL;
+            // The cached contexts come first, then one allocation per context.
+            int64_t allocated = (round == 1 && i < maxCached) ? maxCached : i + 1;
+            fail |= Live() != live + allocated;
+        }
+        for (uint32_t i = 0; i < num; i++) {
+            fail |= CRYPT_ML_KEM_CtxPoolRelease(pool, ctx[i]) != CRYPT_SUCCESS;
+        }
+        fail |= Live() != live + (int64_t)maxCached;
+    }
+    CRYPT_ML_KEM_CtxPoolFree(pool);
+    return fail || Live() != live0;
+}
+
+typedef struct {
+    CRYPT_ML_KEM_CtxPool *pool;
+    int fail;
+} CycleArg;
+
+static void *Cycler(void *arg)
+{
+    CycleArg *w = (CycleArg *)arg;
+    for (uint32_t i = 0; i < ROUNDS; i++) {
+        CRYPT_ML_KEM_Ctx *a = CRYPT_ML_KEM_CtxPoolAcquire(w->pool);
+        CRYPT_ML_KEM_Ctx *b = CRYPT_ML_KEM_CtxPoolAcquire(w->pool);
+        if (a == NULL || b == NULL || a == b || CRYPT_ML_KEM_GenKey(a) != CRYPT_SUCCESS ||
+            CRYPT_ML_KEM_GenKey(b) != CRYPT_SUCCESS || Roundtrip(a, a) != 0 || Roundtrip(b, b) != 0 ||
+            Roundtrip(a, b) == 0) {
+            w->fail = 1;
+        }
+        if (CRYPT_ML_KEM_CtxPoolRelease(w->pool, a) != CRYPT_SUCCESS ||
+            CRYPT_ML_KEM_CtxPoolRelease(w->pool, b) != CRYPT_SUCCESS) {
+            w->fail = 1;
+        }
+    }
+    return NULL;
+}
+
+// Threads acquire two contexts at a time and release them: no context is handed out twice, and at most
+// maxCached stay allocated once all are released.
+static int TestConcurrent(int32_t type)
+{
+    const uint32_t maxCached = 3;
+    static CycleArg arg[THREADS];
+    pthread_t tid[THREADS];
+    uint32_t started = 0;
+    CRYPT_ML_KEM_CtxPool *pool = CRYPT_ML_KEM_CtxPoolNew(NULL, type, maxCached);
+    int64_t live = Live();
+    int fail = pool == NULL;
+    for (uint32_t i = 0; i < THREADS && fail == 0; i++) {
+        arg[i].pool = pool;
+        arg[i].fail = 0;
+        fail = pthread_create(&tid[i], NULL, Cycler, &arg[i]) != 0;
+        started += (fail == 0);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(tid[i], NULL);
+        fail |= arg[i].fail;
+    }
+    fail |= Live() > live + (int64_t)maxCached;
+    CRYPT_ML_KEM_CtxPoolFree(pool);
+    return fail;
+}
+
+int main(void)
+{
+    // Before any allocation, so that every free is of a counted allocation.
+    if (BSL_SAL_CallBack_Ctrl(BSL_SAL_MEM_MALLOC, (void *)CountMalloc) != BSL_SUCCESS ||
+        BSL_SAL_CallBack_Ctrl(BSL_SAL_MEM_FREE, (void *)CountFree) != BSL_SUCCESS ||
+        CRYPT_EAL_RandInit(CRYPT_RAND_SHA256, NULL, NULL, NULL, 0) != CRYPT_SUCCESS) {
+        printf("init failed\n");
+        return 1;
+    }
+    int fail = 0;
+    const int32_t types[] = { CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768, CRYPT_KEM_TYPE_MLKEM_1024 };
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        CRYPT_ML_KEM_CtxPool *pool = CRYPT_ML_KEM_CtxPoolNew(NULL, types[t], 1);
+        int block = pool == NULL || TestCtxBlock(types[t], pool);
+        CRYPT_ML_KEM_CtxPoolFree(pool);
+        int reuse = TestReuse(types[t], types[(t + 1) % 3]);
+        int cap = TestCap(types[t], 1) | TestCap(types[t], 10);
+        int concurrent = TestConcurrent(types[t]);
+        printf("type=%d block=%s reuse=%s cap=%s concurrent=%s\n", types[t], block ? "FAIL" : "ok",
+            reuse ? "FAIL" : "ok", cap ? "FAIL" : "ok", concurrent ? "FAIL" : "ok");
+        fail |= block | reuse | cap | concurrent;
+    }
+    CRYPT_EAL_RandDeinit();
+    printf(fail ? "FAIL\n" : "PASS\n");
+    return fail;
+}
@@ -0,0 +1,148 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hitls_build.h"
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_eal_rand.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+// ===============================
+// Encapsulation key cache: the least recently used key is evicted to stay under the memory cap, the statistics
+// count every hit, miss and eviction, and a context handed out stays usable after its key is evicted and after the
+// cache is freed. Build with HITLS_CRYPTO_MLKEM_EKCACHE.
+// ===============================
+
+#define KEYS       5
+#define CAPACITY   3  // Keys that fit under the cap of TestLru
+
+static CRYPT_ML_KEM_Ctx *g_owner[KEYS];
+static uint8_t g_ek[KEYS][EK_MAX];
+static CRYPT_KemEncapsKey g_pub[KEYS];
+
+static int NewKeys(int32_t type)
+{
+    for (uint32_t i = 0; i < KEYS; i++) {
+        g_owner[i] = NewKey(type, 0);
+        g_pub[i].data = g_ek[i];
+        g_pub[i].len = EK_MAX;
+        if (g_owner[i] == NULL || CRYPT_ML_KEM_GetEncapsKey(g_owner[i], &g_pub[i]) != CRYPT_SUCCESS) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void FreeKeys(void)
+{
+    for (uint32_t i = 0; i < KEYS; i++) {
+        CRYPT_ML_KEM_FreeCtx(g_owner[i]);
+        g_owner[i] = NULL;
+    }
+}
+
+// Gets key i from the cache, checks that it encapsulates to its owner and releases it. 0 on success.
+static int Use(CRYPT_ML_KEM_EkCache *cache, uint32_t i)
+{
+    CRYPT_ML_KEM_Ctx *ctx = CRYPT_ML_KEM_EkCacheGet(cache, &g_pub[i]);
+    int fail = ctx == NULL || Roundtrip(ctx, g_owner[i]) != 0;
+    CRYPT_ML_KEM_FreeCtx(ctx);
+    return fail;
+}
+
+static int StatIs(const CRYPT_ML_KEM_EkCache *cache, uint64_t hits, uint64_t misses, uint64_t evictions,
+    uint32_t entries)
+{
+    CRYPT_ML_KEM_EkCacheStat stat;
+    return CRYPT_ML_KEM_EkCacheGetStat(cache, &stat) == CRYPT_SUCCESS && stat.hits == hits &&
+        stat.misses == misses && stat.evictions == evictions && stat.entries == entries;
+}
+
+// The memory one key takes in a cache, from the statistics of a cache holding one key. 0 on failure.
+static uint64_t EntryBytes(int32_t type)
+{
+    CRYPT_ML_KEM_EkCache *cache = CRYPT_ML_KEM_EkCacheNew(NULL, type, UINT64_MAX);
+    CRYPT_ML_KEM_EkCacheStat stat = { 0 };
+    if (cache == NULL || Use(cache, 0) != 0 || CRYPT_ML_KEM_EkCacheGetStat(cache, &stat) != CRYPT_SUCCESS) {
+        stat.bytes = 0;
+    }
+    CRYPT_ML_KEM_EkCacheFree(cache);
+    return stat.bytes;
+}
+
+// Keys 0 to 2 fill the cache. Key 0 is used again, so key 3 evicts key 1, the least recently used one.
+static int TestLru(int32_t type, uint64_t entryBytes)
+{
+    CRYPT_ML_KEM_EkCache *cache = CRYPT_ML_KEM_EkCacheNew(NULL, type, CAPACITY * entryBytes);
+    CRYPT_ML_KEM_EkCacheStat stat;
+    int fail = cache == NULL || Use(cache, 0) != 0 || Use(cache, 1) != 0 || Use(cache, 2) != 0 ||
+        !StatIs(cache, 0, 3, 0, 3) || Use(cache, 0) != 0 || !StatIs(cache, 1, 3, 0, 3) ||
+        Use(cache, 3) != 0 || !StatIs(cache, 1, 4, 1, 3) ||
+        Use(cache, 0) != 0 || Use(cache, 2) != 0 || Use(cache, 3) != 0 || !StatIs(cache, 4, 4, 1, 3) ||
+        Use(cache, 1) != 0 || !StatIs(cache, 4, 5, 2, 3) ||  // Key 1 is expanded again and evicts key 0.
+        Use(cache, 0) != 0 || !StatIs(cache, 4, 6, 3, 3) ||
+        CRYPT_ML_KEM_EkCacheGetStat(cache, &stat) != CRYPT_SUCCESS || stat.bytes != CAPACITY * entryBytes;
+    CRYPT_ML_KEM_EkCacheFree(cache);
+    return fail;
+}
+
+/*
+ * A context of key 0 is held while the cache holding one key moves on to the other keys: it keeps working through
+ * its reference after its eviction and after the cache is freed. A hit hands out the cached context itself.
+ */
+static int TestHeldCtx(int32_t type, uint64_t entryBytes)
+{
+    CRYPT_ML_KEM_EkCache *cache = CRYPT_ML_KEM_EkCacheNew(NULL, type, entryBytes);
+    CRYPT_ML_KEM_Ctx *held = (cache == NULL) ? NULL : CRYPT_ML_KEM_EkCacheGet(cache, &g_pub[0]);
+    CRYPT_ML_KEM_Ctx *again = (held == NULL) ? NULL : CRYPT_ML_KEM_EkCacheGet(cache, &g_pub[0]);
+    int fail = again == NULL || again != held;
+    CRYPT_ML_KEM_FreeCtx(again);
+    for (uint32_t i = 1; i < KEYS && fail == 0; i++) {
+        fail = Use(cache, i) != 0 || Roundtrip(held, g_owner[0]) != 0;
+    }
+    fail = fail || !StatIs(cache, 1, KEYS, KEYS - 1, 1);
+    CRYPT_ML_KEM_EkCacheFree(cache);
+    fail = fail || Roundtrip(held, g_owner[0]) != 0;
+    CRYPT_ML_KEM_FreeCtx(held);
+    return fail;
+}
+
+static int TestPara(int32_t type, uint64_t entryBytes)
+{
+    CRYPT_ML_KEM_EkCache *cache = CRYPT_ML_KEM_EkCacheNew(NULL, type, entryBytes);
+    CRYPT_KemEncapsKey shortEk = { g_ek[0], g_pub[0].len - 1 };
+    int fail = cache == NULL || CRYPT_ML_KEM_EkCacheNew(NULL, type, entryBytes - 1) != NULL ||
+        CRYPT_ML_KEM_EkCacheNew(NULL, 0, entryBytes) != NULL || CRYPT_ML_KEM_EkCacheGet(cache, &shortEk) != NULL ||
+        CRYPT_ML_KEM_EkCacheGet(cache, NULL) != NULL || !StatIs(cache, 0, 0, 0, 0);
+    CRYPT_ML_KEM_EkCacheFree(cache);
+    return fail;
+}
+
+int main(void)
+{
+    if (CRYPT_EAL_RandInit(CRYPT_RAND_SHA256, NULL, NULL, NULL, 0) != CRYPT_SUCCESS) {
+        printf("rand init failed\n");
+        return 1;
+    }
+    int fail = 0;
+    const int32_t types[] = { CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768, CRYPT_KEM_TYPE_MLKEM_1024 };
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        uint64_t entryBytes = 0;
+        if (NewKeys(types[t]) != 0 || (entryBytes = EntryBytes(types[t])) == 0) {
+            printf("keygen failed\n");
+            return 1;
+        }
+        int para = TestPara(types[t], entryBytes);
+        int lru = TestLru(types[t], entryBytes);
+        int held = TestHeldCtx(types[t], entryBytes);
+        printf("type=%d para=%s lru=%s heldCtx=%s\n", types[t], para ? "FAIL" : "ok", lru ? "FAIL" : "ok",
+            held ? "FAIL" : "ok");
+        fail |= para | lru | held;
+        FreeKeys();
+    }
+    CRYPT_EAL_RandDeinit();
+    printf(fail ? "FAIL\n" : "PASS\n");
+    return fail;
+}
@@ -0,0 +1,286 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "hitls_build.h"
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_eal_rand.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+// ===============================
+// Expanded key images: a context loaded from an image must interoperate with the context that exported it, and the
+// image is mapped read-only so that any write to it by the library faults. Build with
+// HITLS_CRYPTO_MLKEM_EXPANDED_KEY.
+// ===============================
+
+
+typedef struct {
+    uint8_t *addr;
+    uint32_t len;
+    uint32_t mapLen;
+} Image;
+
+// Exports the expanded key of ctx into a page-aligned mapping that is then made read-only.
+static int ExportImage(CRYPT_ML_KEM_Ctx *ctx, Image *img)
+{
+    if (CRYPT_ML_KEM_GetExpandedKeyLen(ctx, &img->len) != CRYPT_SUCCESS) {
+        return 1;
+    }
+    img->mapLen = img->len;
+    img->addr = mmap(NULL, img->mapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (img->addr == MAP_FAILED) {
+        return 1;
+    }
+    uint32_t len = img->len;
+    if (CRYPT_ML_KEM_ExportExpandedKey(ctx, img->addr, &len) != CRYPT_SUCCESS || len != img->len) {
+        return 1;
+    }
+    return mprotect(img->addr, img->mapLen, PROT_READ) != 0;
+}
+
+static void FreeImage(Image *img)
+{
+    if (img->addr != NULL && img->addr != MAP_FAILED) {
+        (void)munmap(img->addr, img->mapLen);
+    }
+}
+
+// Private and public images of gen, loaded in place, interoperate with gen in both directions.
+static int TestMapped(int32_t type, uint32_t noMatrix, CRYPT_ML_KEM_Ctx *gen)
+{
+    uint8_t ek[EK_MAX];
+    CRYPT_KemEncapsKey pub = { ek, sizeof(ek) };
+    CRYPT_ML_KEM_Ctx *pubCtx = NewCtx(type, noMatrix);
+    Image prvImg = { 0 };
+    Image pubImg = { 0 };
+    CRYPT_ML_KEM_Ctx *prvMapped = NULL;
+    CRYPT_ML_KEM_Ctx *pubMapped = NULL;
+    int fail = 1;
+    if (pubCtx == NULL || CRYPT_ML_KEM_GetEncapsKey(gen, &pub) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_SetEncapsKey(pubCtx, &pub) != CRYPT_SUCCESS ||
+        ExportImage(gen, &prvImg) != 0 || ExportImage(pubCtx, &pubImg) != 0) {
+        goto EXIT;
+    }
+    prvMapped = CRYPT_ML_KEM_NewCtxFromExpandedKey(NULL, prvImg.addr, prvImg.len);
+    pubMapped = CRYPT_ML_KEM_NewCtxFromExpandedKey(NULL, pubImg.addr, pubImg.len);
+    if (prvMapped == NULL || pubMapped == NULL) {
+        goto EXIT;
+    }
+    fail = Roundtrip(gen, prvMapped) | Roundtrip(prvMapped, gen) | Roundtrip(pubMapped, gen) |
+        Roundtrip(pubMapped, prvMapped);
+EXIT:
+    CRYPT_ML_KEM_FreeCtx(prvMapped);
+    CRYPT_ML_KEM_FreeCtx(pubMapped);
+    CRYPT_ML_KEM_FreeCtx(pubCtx);
+    FreeImage(&prvImg);
+    FreeImage(&pubImg);
+    return fail;
+}
+
+/*
+ * CRYPT_CTRL_CLEAN_PUB_KEY detaches a mapped context from its read-only image: a private context keeps decapsulating
+ * with a copy of dk, a public context takes the key of other.
+ */
+static int TestDetach(int32_t type, uint32_t noMatrix, CRYPT_ML_KEM_Ctx *gen, CRYPT_ML_KEM_Ctx *other)
+{
+    uint8_t ek[EK_MAX];
+    CRYPT_KemEncapsKey pub = { ek, sizeof(ek) };
+    CRYPT_ML_KEM_Ctx *pubCtx = NewCtx(type, noMatrix);
+    Image prvImg = { 0 };
+    Image pubImg = { 0 };
+    CRYPT_ML_KEM_Ctx *prvMapped = NULL;
+    CRYPT_ML_KEM_Ctx *pubMapped = NULL;
+    int fail = 1;
+    if (pubCtx == NULL || CRYPT_ML_KEM_GetEncapsKey(gen, &pub) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_SetEncapsKey(pubCtx, &pub) != CRYPT_SUCCESS ||
+        ExportImage(gen, &prvImg) != 0 || ExportImage(pubCtx, &pubImg) != 0) {
+        goto EXIT;
+    }
+    prvMapped = CRYPT_ML_KEM_NewCtxFromExpandedKey(NULL, prvImg.addr, prvImg.len);
+    pubMapped = CRYPT_ML_KEM_NewCtxFromExpandedKey(NULL, pubImg.addr, pubImg.len);
+    if (prvMapped == NULL || pubMapped == NULL ||
+        CRYPT_ML_KEM_Ctrl(prvMapped, CRYPT_CTRL_CLEAN_PUB_KEY, NULL, 0) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_Ctrl(pubMapped, CRYPT_CTRL_CLEAN_PUB_KEY, NULL, 0) != CRYPT_SUCCESS) {
+        goto EXIT;
+    }
+    pub.len = sizeof(ek);
+    if (Roundtrip(gen, prvMapped) != 0 || CRYPT_ML_KEM_GetEncapsKey(other, &pub) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_SetEncapsKey(pubMapped, &pub) != CRYPT_SUCCESS) {
+        goto EXIT;
+    }
+    fail = Roundtrip(pubMapped, other) | (Roundtrip(pubMapped, gen) == 0);
+    // A new key generated in a mapped context does not go to the image either.
+    CRYPT_ML_KEM_FreeCtx(pubMapped);
+    pubMapped = CRYPT_ML_KEM_NewCtxFromExpandedKey(NULL, pubImg.addr, pubImg.len);
+    fail |= pubMapped == NULL || CRYPT_ML_KEM_GenKey(pubMapped) != CRYPT_SUCCESS ||
+        Roundtrip(pubMapped, pubMapped) != 0;
+EXIT:
+    CRYPT_ML_KEM_FreeCtx(prvMapped);
+    CRYPT_ML_KEM_FreeCtx(pubMapped);
+    CRYPT_ML_KEM_FreeCtx(pubCtx);
+    FreeImage(&prvImg);
+    FreeImage(&pubImg);
+    return fail;
+}
+
+/*
+ * The Fletcher-64 checksum of the image, see ml_kem_expanded.c: it covers the header up to the checksum field at
+ * offset 64 and everything after the 128-byte header. The tamper test fixes it up so that only the H(ek) check can
+ * reject the image.
+ */
+#define IMAGE_HDR_LEN 128
+#define IMAGE_CHECKSUM_OFF 64
+#define IMAGE_EKHASH_OFF 32
+#define Q 3329
+
+static void ChecksumUpdate(uint64_t sum[2], const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i += sizeof(uint32_t)) {
+        uint32_t w;
+        memcpy(&w, data + i, sizeof(w));
+        sum[0] = (sum[0] + w) % 0xffffffffULL;
+        sum[1] = (sum[1] + sum[0]) % 0xffffffffULL;
+    }
+}
+
+static void FixChecksum(uint8_t *image, uint32_t len)
+{
+    uint64_t sum[2] = { 0, 0 };
+    ChecksumUpdate(sum, image, IMAGE_CHECKSUM_OFF);
+    ChecksumUpdate(sum, image + IMAGE_HDR_LEN, len - IMAGE_HDR_LEN);
+    uint64_t checksum = (sum[1] << 32) | sum[0];
+    memcpy(image + IMAGE_CHECKSUM_OFF, &checksum, sizeof(checksum));
+}
+
+// XORs mask into the bytes at off of a writable copy of img, fixes the checksum up and returns 1 if the copy loads.
+static int LoadXor(const Image *img, uint32_t off, const uint8_t *mask, uint32_t maskLen)
+{
+    uint8_t *copy = aligned_alloc(64, (img->len + 63) & ~63U);
+    if (copy == NULL) {
+        return 0;
+    }
+    memcpy(copy, img->addr, img->len);
+    for (uint32_t i = 0; i < maskLen; i++) {
+        copy[off + i] ^= mask[i];
+    }
+    FixChecksum(copy, img->len);
+    CRYPT_ML_KEM_Ctx *ctx = CRYPT_ML_KEM_NewCtxFromExpandedKey(NULL, copy, img->len);
+    CRYPT_ML_KEM_FreeCtx(ctx);
+    free(copy);
+    return ctx != NULL;
+}
+
+static int LoadModified(const Image *img, uint32_t off, uint8_t mask)
+{
+    return LoadXor(img, off, &mask, 1);
+}
+
+// Sets the polynomial coefficient at off of a copy of img to value, returns 1 if the copy loads.
+static int LoadCoeff(const Image *img, uint32_t off, int16_t value)
+{
+    int16_t mask;
+    memcpy(&mask, img->addr + off, sizeof(mask));
+    mask ^= value;
+    return LoadXor(img, off, (const uint8_t *)&mask, sizeof(mask));
+}
+
+/*
+ * H(ek) is recomputed at load time: an image whose ek, header H(ek) or dk H(ek) was changed is rejected even with a
+ * valid checksum, while the unchanged image with a recomputed checksum still loads.
+ */
+static int TestTamper(int32_t type, uint32_t noMatrix, CRYPT_ML_KEM_Ctx *gen)
+{
+    uint8_t ek[EK_MAX];
+    CRYPT_KemEncapsKey pub = { ek, sizeof(ek) };
+    CRYPT_ML_KEM_Ctx *pubCtx = NewCtx(type, noMatrix);
+    Image prvImg = { 0 };
+    Image pubImg = { 0 };
+    int fail = 1;
+    if (pubCtx == NULL || CRYPT_ML_KEM_GetEncapsKey(gen, &pub) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_SetEncapsKey(pubCtx, &pub) != CRYPT_SUCCESS ||
+        ExportImage(gen, &prvImg) != 0 || ExportImage(pubCtx, &pubImg) != 0) {
+        goto EXIT;
+    }
+    uint32_t ekLen = pub.len;
+    // dk ends with ek || H(ek) || z, a public image with ek.
+    uint32_t prvEkOff = prvImg.len - 64 - ekLen;
+    fail = !LoadModified(&pubImg, 0, 0) | !LoadModified(&prvImg, 0, 0) |
+        LoadModified(&pubImg, IMAGE_EKHASH_OFF, 1) | LoadModified(&pubImg, pubImg.len - 1, 1) |
+        LoadModified(&prvImg, IMAGE_EKHASH_OFF, 1) | LoadModified(&prvImg, prvEkOff, 1) |
+        LoadModified(&prvImg, prvEkOff + ekLen, 1);
+EXIT:
+    CRYPT_ML_KEM_FreeCtx(pubCtx);
+    FreeImage(&prvImg);
+    FreeImage(&pubImg);
+    return fail;
+}
+
+/*
+ * The polynomials run from the header to ek in a public image, to dk in a private one. A coefficient q - 1 is taken,
+ * q or -q in the first polynomial (A or t) or the last one (t or s) is rejected, with a valid checksum.
+ */
+static int TestCoeffRange(int32_t type, uint32_t noMatrix, CRYPT_ML_KEM_Ctx *gen)
+{
+    uint8_t ek[EK_MAX];
+    CRYPT_KemEncapsKey pub = { ek, sizeof(ek) };
+    CRYPT_ML_KEM_Ctx *pubCtx = NewCtx(type, noMatrix);
+    Image prvImg = { 0 };
+    Image pubImg = { 0 };
+    int fail = 1;
+    if (pubCtx == NULL || CRYPT_ML_KEM_GetEncapsKey(gen, &pub) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_SetEncapsKey(pubCtx, &pub) != CRYPT_SUCCESS ||
+        ExportImage(gen, &prvImg) != 0 || ExportImage(pubCtx, &pubImg) != 0) {
+        goto EXIT;
+    }
+    // dk is 2 * ekLen + 32 bytes: s, ek, H(ek) and z.
+    const Image *imgs[] = { &pubImg, &prvImg };
+    const uint32_t keyLen[] = { pub.len, 2 * pub.len + 32 };
+    fail = 0;
+    for (uint32_t i = 0; i < 2; i++) {
+        const uint32_t offs[] = { IMAGE_HDR_LEN, imgs[i]->len - keyLen[i] - sizeof(int16_t) };
+        for (uint32_t j = 0; j < 2; j++) {
+            fail |= (LoadCoeff(imgs[i], offs[j], Q - 1) == 0) | LoadCoeff(imgs[i], offs[j], Q) |
+                LoadCoeff(imgs[i], offs[j], -Q) | LoadCoeff(imgs[i], offs[j], INT16_MIN);
+        }
+    }
+EXIT:
+    CRYPT_ML_KEM_FreeCtx(pubCtx);
+    FreeImage(&prvImg);
+    FreeImage(&pubImg);
+    return fail;
+}
+
+int main(void)
+{
+    if (CRYPT_EAL_RandInit(CRYPT_RAND_SHA256, NULL, NULL, NULL, 0) != CRYPT_SUCCESS) {
+        printf("rand init failed\n");
+        return 1;
+    }
+    int fail = 0;
+    const int32_t types[] = { CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768, CRYPT_KEM_TYPE_MLKEM_1024 };
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        for (uint32_t noMatrix = 0; noMatrix <= 1; noMatrix++) {
+            CRYPT_ML_KEM_Ctx *gen = NewKey(types[t], noMatrix);
+            CRYPT_ML_KEM_Ctx *other = NewKey(types[t], noMatrix);
+            if (gen == NULL || other == NULL) {
+                printf("keygen failed\n");
+                return 1;
+            }
+            int mapped = TestMapped(types[t], noMatrix, gen);
+            int detach = TestDetach(types[t], noMatrix, gen, other);
+            int tamper = TestTamper(types[t], noMatrix, gen);
+            int coeff = TestCoeffRange(types[t], noMatrix, gen);
+            printf("type=%d noMatrix=%u mapped=%s detach=%s tamper=%s coeff=%s\n", types[t], noMatrix,
+                mapped ? "FAIL" : "ok", detach ? "FAIL" : "ok", tamper ? "FAIL" : "ok", coeff ? "FAIL" : "ok");
+            fail |= mapped | detach | tamper | coeff;
+            CRYPT_ML_KEM_FreeCtx(gen);
+            CRYPT_ML_KEM_FreeCtx(other);
+        }
+    }
+    CRYPT_EAL_RandDeinit();
+    printf(fail ? "FAIL\n" : "PASS\n");
+    return fail;
+}
@@ -0,0 +1,198 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "hitls_build.h"
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_eal_rand.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+// ===============================
+// Keyring: keys inserted under an ID or under H(ek) decapsulate like their own context, and of N threads that insert
+// different keys under the same ID at the same time exactly one succeeds, every round. Build with
+// HITLS_CRYPTO_MLKEM_KEYRING.
+// ===============================
+
+#define THREAD_MAX      16
+#define DEFAULT_THREADS 4
+#define DEFAULT_ROUNDS  500
+
+// A generated key and its dk, written to dk.
+static CRYPT_ML_KEM_Ctx *NewKeyDk(int32_t type, uint8_t *dk, CRYPT_KemDecapsKey *prv)
+{
+    CRYPT_ML_KEM_Ctx *ctx = NewKey(type, 0);
+    prv->data = dk;
+    prv->len = DK_MAX;
+    if (ctx == NULL || CRYPT_ML_KEM_GetDecapsKey(ctx, prv) != CRYPT_SUCCESS) {
+        CRYPT_ML_KEM_FreeCtx(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+// Encapsulates to encCtx and decapsulates with the key of the keyring, 0 if the shared secrets match.
+static int RingRoundtrip(CRYPT_ML_KEM_Ctx *encCtx, CRYPT_ML_KEM_Keyring *ring, const uint8_t *id, uint32_t idLen)
+{
+    uint8_t ct[CIPHER_MAX];
+    uint8_t s1[SHARE_LEN];
+    uint8_t s2[SHARE_LEN];
+    uint32_t ctLen = sizeof(ct);
+    uint32_t s1Len = sizeof(s1);
+    uint32_t s2Len = sizeof(s2);
+    if (CRYPT_ML_KEM_Encaps(encCtx, ct, &ctLen, s1, &s1Len) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_KeyringDecaps(ring, id, idLen, ct, ctLen, s2, &s2Len) != CRYPT_SUCCESS) {
+        return 1;
+    }
+    return memcmp(s1, s2, SHARE_LEN) != 0;
+}
+
+// Insertion under an ID and under H(ek), duplicates, capacity and removal.
+static int TestBasic(int32_t type)
+{
+    static const uint8_t id[] = "tenant-0";
+    uint8_t dk[3][DK_MAX];
+    uint8_t ekHash[CRYPT_ML_KEM_KEY_ID_MAX_LEN];
+    CRYPT_KemDecapsKey prv[3];
+    CRYPT_ML_KEM_Ctx *key[3] = { NULL, NULL, NULL };
+    CRYPT_ML_KEM_Keyring *ring = CRYPT_ML_KEM_KeyringNew(NULL, type, 2);
+    int fail = 1;
+    for (int i = 0; i < 3; i++) {
+        key[i] = NewKeyDk(type, dk[i], &prv[i]);
+        if (key[i] == NULL) {
+            goto EXIT;
+        }
+    }
+    if (ring == NULL || CRYPT_ML_KEM_KeyringInsert(ring, id, sizeof(id) - 1, &prv[0]) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_KeyringInsert(ring, id, sizeof(id) - 1, &prv[1]) != CRYPT_MLKEM_KEY_REPEATED_SET ||
+        CRYPT_ML_KEM_KeyringInsert(ring, NULL, 0, &prv[1]) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_KeyringInsert(ring, (const uint8_t *)"x", 1, &prv[2]) != CRYPT_MLKEM_LEN_NOT_ENOUGH ||
+        RingRoundtrip(key[0], ring, id, sizeof(id) - 1) != 0 || RingRoundtrip(key[1], ring, id, sizeof(id) - 1) == 0) {
+        goto EXIT;
+    }
+    // dk holds H(ek) 64 bytes before its end.
+    memcpy(ekHash, dk[1] + prv[1].len - 2 * CRYPT_ML_KEM_KEY_ID_MAX_LEN, sizeof(ekHash));
+    if (RingRoundtrip(key[1], ring, ekHash, sizeof(ekHash)) != 0 ||
+        CRYPT_ML_KEM_KeyringRemove(ring, id, sizeof(id) - 1) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_KeyringRemove(ring, id, sizeof(id) - 1) != CRYPT_MLKEM_KEY_NOT_SET ||
+        RingRoundtrip(key[0], ring, id, sizeof(id) - 1) == 0 ||
+        CRYPT_ML_KEM_KeyringInsert(ring, id, sizeof(id) - 1, &prv[2]) != CRYPT_SUCCESS) {
+        goto EXIT;
+    }
+    fail = RingRoundtrip(key[2], ring, id, sizeof(id) - 1);
+EXIT:
+    CRYPT_ML_KEM_KeyringFree(ring);
+    for (int i = 0; i < 3; i++) {
+        CRYPT_ML_KEM_FreeCtx(key[i]);
+    }
+    memset(dk, 0, sizeof(dk));
+    return fail;
+}
+
+typedef struct {
+    CRYPT_ML_KEM_Keyring *ring;
+    pthread_barrier_t *barrier;
+    CRYPT_KemDecapsKey prv;
+    uint32_t rounds;
+    int32_t ret;  // Of the insertion of the current round
+} InsertArg;
+
+static const uint8_t RACE_ID[] = "shared-id";
+
+// Every round, inserts its key under RACE_ID between the two barriers that the main thread also waits on.
+static void *Inserter(void *arg)
+{
+    InsertArg *w = (InsertArg *)arg;
+    for (uint32_t i = 0; i < w->rounds; i++) {
+        pthread_barrier_wait(w->barrier);
+        w->ret = CRYPT_ML_KEM_KeyringInsert(w->ring, RACE_ID, sizeof(RACE_ID) - 1, &w->prv);
+        pthread_barrier_wait(w->barrier);
+        pthread_barrier_wait(w->barrier);  // The main thread checks and removes the key.
+    }
+    return NULL;
+}
+
+// The threads insert different keys under one ID: exactly one succeeds and the keyring decapsulates with its key.
+static int TestRace(int32_t type, uint32_t threads, uint32_t rounds)
+{
+    static uint8_t dk[THREAD_MAX][DK_MAX];
+    CRYPT_ML_KEM_Ctx *key[THREAD_MAX] = { NULL };
+    InsertArg arg[THREAD_MAX];
+    pthread_t tid[THREAD_MAX];
+    pthread_barrier_t barrier;
+    CRYPT_ML_KEM_Keyring *ring = CRYPT_ML_KEM_KeyringNew(NULL, type, threads);
+    uint32_t failed = 0;
+    uint32_t started = 0;
+    if (ring == NULL || pthread_barrier_init(&barrier, NULL, threads + 1) != 0) {
+        CRYPT_ML_KEM_KeyringFree(ring);
+        return 1;
+    }
+    for (uint32_t i = 0; i < threads; i++) {
+        key[i] = NewKeyDk(type, dk[i], &arg[i].prv);
+        arg[i].ring = ring;
+        arg[i].barrier = &barrier;
+        arg[i].rounds = rounds;
+        if (key[i] == NULL || pthread_create(&tid[i], NULL, Inserter, &arg[i]) != 0) {
+            printf("setup failed\n");
+            exit(1);  // Threads already started wait on the barrier forever.
+        }
+        started++;
+    }
+    for (uint32_t r = 0; r < rounds; r++) {
+        pthread_barrier_wait(&barrier);
+        pthread_barrier_wait(&barrier);
+        uint32_t winners = 0;
+        uint32_t winner = 0;
+        for (uint32_t i = 0; i < threads; i++) {
+            if (arg[i].ret == CRYPT_SUCCESS) {
+                winners++;
+                winner = i;
+            } else if (arg[i].ret != CRYPT_MLKEM_KEY_REPEATED_SET) {
+                failed++;
+            }
+        }
+        if (winners != 1 || RingRoundtrip(key[winner], ring, RACE_ID, sizeof(RACE_ID) - 1) != 0) {
+            failed++;
+        }
+        // Removes every copy, so that a duplicate does not hide the next round.
+        while (CRYPT_ML_KEM_KeyringRemove(ring, RACE_ID, sizeof(RACE_ID) - 1) == CRYPT_SUCCESS) {
+        }
+        pthread_barrier_wait(&barrier);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    pthread_barrier_destroy(&barrier);
+    for (uint32_t i = 0; i < threads; i++) {
+        CRYPT_ML_KEM_FreeCtx(key[i]);
+    }
+    CRYPT_ML_KEM_KeyringFree(ring);
+    printf("race threads=%u rounds=%u failed=%u\n", threads, rounds, failed);
+    return failed != 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t threads = (argc > 1) ? (uint32_t)atoi(argv[1]) : DEFAULT_THREADS;
+    uint32_t rounds = (argc > 2) ? (uint32_t)atoi(argv[2]) : DEFAULT_ROUNDS;
+    if (threads < 2 || threads > THREAD_MAX || rounds == 0) {
+        printf("usage: %s [threads 2..%d] [rounds]\n", argv[0], THREAD_MAX);
+        return 1;
+    }
+    if (CRYPT_EAL_RandInit(CRYPT_RAND_SHA256, NULL, NULL, NULL, 0) != CRYPT_SUCCESS) {
+        printf("rand init failed\n");
+        return 1;
+    }
+    int fail = 0;
+    const int32_t types[] = { CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768, CRYPT_KEM_TYPE_MLKEM_1024 };
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        int basic = TestBasic(types[t]);
+        printf("type=%d basic=%s\n", types[t], basic ? "FAIL" : "ok");
+        fail |= basic | TestRace(types[t], threads, rounds);
+    }
+    CRYPT_EAL_RandDeinit();
+    printf(fail ? "FAIL\n" : "PASS\n");
+    return fail;
+}
@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hitls_build.h"
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_eal_rand.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+// ===============================
+// Key life cycle of one context: the key that is set, generated or kept is the one that is used, whatever was
+// expanded for the previous key. The CRYPT_ML_KEM_Cmp and CRYPT_ML_KEM_Check cases need HITLS_CRYPTO_MLKEM_CMP and
+// HITLS_CRYPTO_MLKEM_CHECK.
+// ===============================
+
+#define SEED_LEN   64
+
+static int SetEk(CRYPT_ML_KEM_Ctx *ctx, CRYPT_ML_KEM_Ctx *src)
+{
+    uint8_t ek[EK_MAX];
+    CRYPT_KemEncapsKey pub = { ek, sizeof(ek) };
+    return CRYPT_ML_KEM_GetEncapsKey(src, &pub) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_SetEncapsKey(ctx, &pub) != CRYPT_SUCCESS;
+}
+
+static int SetDk(CRYPT_ML_KEM_Ctx *ctx, CRYPT_ML_KEM_Ctx *src)
+{
+    uint8_t dk[DK_MAX];
+    CRYPT_KemDecapsKey prv = { dk, sizeof(dk) };
+    int ret = CRYPT_ML_KEM_GetDecapsKey(src, &prv) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_SetDecapsKey(ctx, &prv) != CRYPT_SUCCESS;
+    memset(dk, 0, sizeof(dk));
+    return ret;
+}
+
+/*
+ * One context is used with the key of a, its ek is cleaned and the ek of b is set: it must encapsulate to b.
+ * Then the ek of b is cleaned and the dk of a is set: it must decapsulate with a.
+ */
+static int TestSwap(int32_t type, uint32_t noMatrix, CRYPT_ML_KEM_Ctx *a, CRYPT_ML_KEM_Ctx *b)
+{
+    CRYPT_ML_KEM_Ctx *ctx = NewCtx(type, noMatrix);
+    int fail = ctx == NULL || SetEk(ctx, a) != 0 || Roundtrip(ctx, a) != 0 ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_CLEAN_PUB_KEY, NULL, 0) != CRYPT_SUCCESS ||
+        SetEk(ctx, b) != 0 || Roundtrip(ctx, b) != 0 || Roundtrip(ctx, a) == 0 ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_CLEAN_PUB_KEY, NULL, 0) != CRYPT_SUCCESS ||
+        SetDk(ctx, a) != 0 || Roundtrip(a, ctx) != 0 || Roundtrip(b, ctx) == 0;
+    CRYPT_ML_KEM_FreeCtx(ctx);
+    return fail;
+}
+
+static int SetDkFormat(CRYPT_ML_KEM_Ctx *ctx, uint32_t format)
+{
+    return CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_ML_KEM_SET_DK_FORMAT, &format, sizeof(format)) != CRYPT_SUCCESS;
+}
+
+/*
+ * A key kept as its seed only is still the same key: it equals its copy, passes the private key check, exports the
+ * expanded dk of its copy or its seed as asked by CRYPT_CTRL_ML_KEM_SET_DK_FORMAT, and decapsulates.
+ */
+static int TestSeedOnly(int32_t type, uint32_t noMatrix)
+{
+    uint8_t dk[DK_MAX];
+    uint8_t dupDk[DK_MAX];
+    CRYPT_KemDecapsKey prv = { dk, sizeof(dk) };
+    CRYPT_KemDecapsKey dupPrv = { dupDk, sizeof(dupDk) };
+    CRYPT_ML_KEM_Ctx *ctx = NewCtx(type, noMatrix);
+    CRYPT_ML_KEM_Ctx *dup = NULL;
+    CRYPT_ML_KEM_Ctx *fromSeed = NewCtx(type, noMatrix);
+    CRYPT_ML_KEM_Ctx *noSeed = NewCtx(type, noMatrix);
+    int fail = 1;
+    if (ctx == NULL || fromSeed == NULL || noSeed == NULL || CRYPT_ML_KEM_GenKey(ctx) != CRYPT_SUCCESS ||
+        (dup = CRYPT_ML_KEM_DupCtx(ctx)) == NULL || CRYPT_ML_KEM_GetDecapsKey(dup, &dupPrv) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_KeepSeedOnly(ctx) != CRYPT_SUCCESS) {
+        goto EXIT;
+    }
+#ifdef HITLS_CRYPTO_MLKEM_CMP
+    if (CRYPT_ML_KEM_Cmp(ctx, dup) != CRYPT_SUCCESS) {
+        goto EXIT;
+    }
+#endif
+#ifdef HITLS_CRYPTO_MLKEM_CHECK
+    if (CRYPT_ML_KEM_Check(CRYPT_PKEY_CHECK_PRVKEY, ctx, NULL) != CRYPT_SUCCESS) {
+        goto EXIT;
+    }
+#endif
+    // The expanded dk is rebuilt, the seed form only on request.
+    if (CRYPT_ML_KEM_GetDecapsKey(ctx, &prv) != CRYPT_SUCCESS || prv.len != dupPrv.len ||
+        memcmp(dk, dupDk, prv.len) != 0 || SetDkFormat(ctx, CRYPT_ML_KEM_DK_FORMAT_SEED) != 0) {
+        goto EXIT;
+    }
+    prv.len = sizeof(dk);
+    if (CRYPT_ML_KEM_GetDecapsKey(ctx, &prv) != CRYPT_SUCCESS || prv.len != SEED_LEN ||
+        CRYPT_ML_KEM_SetDecapsKey(fromSeed, &prv) != CRYPT_SUCCESS) {
+        goto EXIT;
+    }
+    /*
+     * A key set as its expanded dk has no seed form. Without ek it equals the key kept as its seed whose ek is
+     * cleaned, through the dk derived from the seed.
+     */
+    prv.len = sizeof(dk);
+    if (CRYPT_ML_KEM_SetDecapsKey(noSeed, &dupPrv) != CRYPT_SUCCESS ||
+        SetDkFormat(noSeed, CRYPT_ML_KEM_DK_FORMAT_SEED) != 0 ||
+        CRYPT_ML_KEM_GetDecapsKey(noSeed, &prv) == CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_KeepSeedOnly(fromSeed) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_CLEAN_PUB_KEY, NULL, 0) != CRYPT_SUCCESS) {
+        goto EXIT;
+    }
+#ifdef HITLS_CRYPTO_MLKEM_CMP
+    if (CRYPT_ML_KEM_Cmp(noSeed, ctx) != CRYPT_SUCCESS || CRYPT_ML_KEM_Cmp(fromSeed, dup) != CRYPT_SUCCESS) {
+        goto EXIT;
+    }
+#endif
+    fail = Roundtrip(dup, ctx) | Roundtrip(dup, fromSeed) | Roundtrip(fromSeed, noSeed);
+EXIT:
+    memset(dk, 0, sizeof(dk));
+    memset(dupDk, 0, sizeof(dupDk));
+    CRYPT_ML_KEM_FreeCtx(ctx);
+    CRYPT_ML_KEM_FreeCtx(dup);
+    CRYPT_ML_KEM_FreeCtx(fromSeed);
+    CRYPT_ML_KEM_FreeCtx(noSeed);
+    return fail;
+}
+
+int main(void)
+{
+    if (CRYPT_EAL_RandInit(CRYPT_RAND_SHA256, NULL, NULL, NULL, 0) != CRYPT_SUCCESS) {
+        printf("rand init failed\n");
+        return 1;
+    }
+    int fail = 0;
+    const int32_t types[] = { CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768, CRYPT_KEM_TYPE_MLKEM_1024 };
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        for (uint32_t noMatrix = 0; noMatrix <= 1; noMatrix++) {
+            CRYPT_ML_KEM_Ctx *a = NewKey(types[t], noMatrix);
+            CRYPT_ML_KEM_Ctx *b = NewKey(types[t], noMatrix);
+            if (a == NULL || b == NULL) {
+                printf("keygen failed\n");
+                return 1;
+            }
+            int swap = TestSwap(types[t], noMatrix, a, b);
+            int seedOnly = TestSeedOnly(types[t], noMatrix);
+            printf("type=%d noMatrix=%u swap=%s seedOnly=%s\n", types[t], noMatrix, swap ? "FAIL" : "ok",
+                seedOnly ? "FAIL" : "ok");
+            fail |= swap | seedOnly;
+            CRYPT_ML_KEM_FreeCtx(a);
+            CRYPT_ML_KEM_FreeCtx(b);
+        }
+    }
+    CRYPT_EAL_RandDeinit();
+    printf(fail ? "FAIL\n" : "PASS\n");
+    return fail;
+}
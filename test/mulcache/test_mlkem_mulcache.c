@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hitls_build.h"
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_eal_rand.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+// ===============================
+// Multiplication cache: a context with CRYPT_CTRL_ML_KEM_SET_MULCACHE generates the same key and gives the same
+// ciphertexts and shared secrets as one without, single and batched, valid or not, with and without a stored
+// matrix. The random bytes come from a stream that is rewound before each side.
+// ===============================
+
+#define NUM        5
+
+static uint64_t g_randState;
+
+// splitmix64, a byte stream that only depends on the seed and the bytes already taken.
+static int32_t StreamRand(uint8_t *out, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        uint64_t z = (g_randState += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        out[i] = (uint8_t)(z ^ (z >> 31));
+    }
+    return CRYPT_SUCCESS;
+}
+
+static CRYPT_ML_KEM_Ctx *NewCacheCtx(int32_t type, uint32_t noMatrix, uint32_t mulCache)
+{
+    CRYPT_ML_KEM_Ctx *ctx = NewCtx(type, noMatrix);
+    if (ctx == NULL ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_ML_KEM_SET_MULCACHE, &mulCache, sizeof(mulCache)) != CRYPT_SUCCESS) {
+        CRYPT_ML_KEM_FreeCtx(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+typedef struct {
+    uint8_t ek[EK_MAX];
+    uint8_t dk[DK_MAX];
+    uint8_t ct[NUM * CIPHER_MAX];
+    uint8_t share[NUM * SHARE_LEN];
+    uint8_t dec[NUM * SHARE_LEN];
+    uint8_t batchCt[NUM * CIPHER_MAX];
+    uint8_t batchShare[NUM * SHARE_LEN];
+    uint8_t batchDec[NUM * SHARE_LEN];
+    uint32_t ekLen;
+    uint32_t dkLen;
+    uint32_t ctLen;
+} Transcript;
+
+/*
+ * Generates a key from seed and records what the context outputs: the key, NUM single and NUM batched
+ * encapsulations, and the decapsulation of these ciphertexts with every third one corrupted.
+ */
+static int Record(CRYPT_ML_KEM_Ctx *ctx, uint64_t seed, Transcript *out)
+{
+    CRYPT_KemEncapsKey pub = { out->ek, sizeof(out->ek) };
+    CRYPT_KemDecapsKey prv = { out->dk, sizeof(out->dk) };
+    g_randState = seed;
+    if (CRYPT_ML_KEM_GenKey(ctx) != CRYPT_SUCCESS || CRYPT_ML_KEM_GetEncapsKey(ctx, &pub) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_GetDecapsKey(ctx, &prv) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_GET_CIPHERTEXT_LEN, &out->ctLen, sizeof(out->ctLen)) != CRYPT_SUCCESS) {
+        return 1;
+    }
+    out->ekLen = pub.len;
+    out->dkLen = prv.len;
+    uint32_t ctLen = out->ctLen;
+    for (uint32_t i = 0; i < NUM; i++) {
+        uint32_t cipherLen = ctLen;
+        uint32_t shareLen = SHARE_LEN;
+        if (CRYPT_ML_KEM_Encaps(ctx, out->ct + i * ctLen, &cipherLen, out->share + i * SHARE_LEN,
+            &shareLen) != CRYPT_SUCCESS) {
+            return 1;
+        }
+        if (i % 3 == 0) {
+            out->ct[i * ctLen + i] ^= 1;
+        }
+        shareLen = SHARE_LEN;
+        if (CRYPT_ML_KEM_Decaps(ctx, out->ct + i * ctLen, ctLen, out->dec + i * SHARE_LEN,
+            &shareLen) != CRYPT_SUCCESS) {
+            return 1;
+        }
+    }
+    uint32_t cipherLen = sizeof(out->batchCt);
+    uint32_t shareLen = sizeof(out->batchShare);
+    if (CRYPT_ML_KEM_EncapsBatch(ctx, NUM, out->batchCt, &cipherLen, out->batchShare, &shareLen) != CRYPT_SUCCESS) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < NUM; i += 3) {
+        out->batchCt[i * ctLen + i] ^= 1;
+    }
+    shareLen = sizeof(out->batchDec);
+    return CRYPT_ML_KEM_DecapsBatch(ctx, NUM, out->batchCt, NUM * ctLen, out->batchDec, &shareLen) != CRYPT_SUCCESS;
+}
+
+static Transcript g_plain;
+static Transcript g_cached;
+
+static int TestSame(int32_t type, uint32_t noMatrix, uint64_t seed)
+{
+    CRYPT_ML_KEM_Ctx *plain = NewCacheCtx(type, noMatrix, 0);
+    CRYPT_ML_KEM_Ctx *cached = NewCacheCtx(type, noMatrix, 1);
+    int fail = plain == NULL || cached == NULL || Record(plain, seed, &g_plain) != 0 ||
+        Record(cached, seed, &g_cached) != 0 || memcmp(&g_plain, &g_cached, sizeof(Transcript)) != 0;
+    CRYPT_ML_KEM_FreeCtx(plain);
+    CRYPT_ML_KEM_FreeCtx(cached);
+    return fail;
+}
+
+/*
+ * A context given the key of TestSame with the cache on decapsulates the recorded ciphertexts to the recorded
+ * secrets. The cache cannot be switched once the key is set.
+ */
+static int TestSetKey(int32_t type, uint32_t noMatrix)
+{
+    CRYPT_ML_KEM_Ctx *ctx = NewCacheCtx(type, noMatrix, 1);
+    CRYPT_KemDecapsKey prv = { g_plain.dk, g_plain.dkLen };
+    uint32_t off = 0;
+    uint8_t dec[NUM * SHARE_LEN];
+    uint32_t shareLen = sizeof(dec);
+    int fail = ctx == NULL || CRYPT_ML_KEM_SetDecapsKey(ctx, &prv) != CRYPT_SUCCESS ||
+        CRYPT_ML_KEM_DecapsBatch(ctx, NUM, g_plain.ct, NUM * g_plain.ctLen, dec, &shareLen) != CRYPT_SUCCESS ||
+        memcmp(dec, g_plain.dec, sizeof(dec)) != 0 ||
+        CRYPT_ML_KEM_Ctrl(ctx, CRYPT_CTRL_ML_KEM_SET_MULCACHE, &off, sizeof(off)) != CRYPT_MLKEM_KEY_REPEATED_SET;
+    CRYPT_ML_KEM_FreeCtx(ctx);
+    return fail;
+}
+
+int main(void)
+{
+    // Registered in place of the DRBG, every random byte of the program comes from StreamRand.
+    CRYPT_EAL_SetRandCallBack(StreamRand);
+    int fail = 0;
+    const int32_t types[] = { CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768, CRYPT_KEM_TYPE_MLKEM_1024 };
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        for (uint32_t noMatrix = 0; noMatrix <= 1; noMatrix++) {
+            int same = TestSame(types[t], noMatrix, 0xCAC4E000U + t * 2 + noMatrix);
+            int setKey = same | TestSetKey(types[t], noMatrix);
+            printf("type=%d noMatrix=%u same=%s setKey=%s\n", types[t], noMatrix, same ? "FAIL" : "ok",
+                setKey ? "FAIL" : "ok");
+            fail |= same | setKey;
+        }
+    }
+    printf(fail ? "FAIL\n" : "PASS\n");
+    return fail;
+}
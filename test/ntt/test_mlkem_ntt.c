@@ -57,6 +57,106 @@ void MLKEM_ComputNTT(int16_t *a, const int16_t *psi)
     }
 }
 
+// ===============================
+// AVX2 后端（与 mlkem/src/ml_kem_ntt_avx2.c 相同）
+// ===============================
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MLKEM_AVX2_FUNC __attribute__((target("avx2")))
+#define MLKEM_AVX2_LANES 16
+#define MLKEM_AVX2_REGS (MLKEM_N / MLKEM_AVX2_LANES)
+#define MLKEM_BARRETT_V 20159
+#define MLKEM_INTT_F 512
+
+static inline MLKEM_AVX2_FUNC __m256i MontMulAvx2(__m256i a, __m256i b)
+{
+    __m256i lo = _mm256_mullo_epi16(a, b);
+    __m256i hi = _mm256_mulhi_epi16(a, b);
+    lo = _mm256_mullo_epi16(lo, _mm256_set1_epi16(MLKEM_Q_INV_BETA));
+    lo = _mm256_mulhi_epi16(lo, _mm256_set1_epi16(MLKEM_Q));
+    return _mm256_sub_epi16(hi, lo);
+}
+
+static inline MLKEM_AVX2_FUNC __m256i BarrettAvx2(__m256i a)
+{
+    __m256i t = _mm256_mulhi_epi16(a, _mm256_set1_epi16(MLKEM_BARRETT_V));
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(1 << 9));
+    t = _mm256_srai_epi16(t, 10);
+    t = _mm256_mullo_epi16(t, _mm256_set1_epi16(MLKEM_Q));
+    return _mm256_sub_epi16(a, t);
+}
+
+static inline MLKEM_AVX2_FUNC void ButterflyCT(__m256i *x, __m256i *y, __m256i zeta)
+{
+    __m256i t = MontMulAvx2(*y, zeta);
+    *y = _mm256_sub_epi16(*x, t);
+    *x = _mm256_add_epi16(*x, t);
+}
+
+static inline MLKEM_AVX2_FUNC __m256i ExpandZeta8(int16_t zeta0, int16_t zeta1)
+{
+    __m256i v = _mm256_castsi128_si256(_mm_set1_epi16(zeta0));
+    return _mm256_inserti128_si256(v, _mm_set1_epi16(zeta1), 1);
+}
+
+static inline MLKEM_AVX2_FUNC __m256i ExpandZeta4(__m128i zeta)
+{
+    __m256i v = _mm256_cvtepu16_epi64(zeta);
+    v = _mm256_shufflelo_epi16(v, 0);
+    return _mm256_shufflehi_epi16(v, 0);
+}
+
+static inline MLKEM_AVX2_FUNC __m256i ExpandZeta2(__m128i zeta)
+{
+    __m256i v = _mm256_cvtepu16_epi32(zeta);
+    return _mm256_or_si256(v, _mm256_slli_epi32(v, 16));
+}
+
+static void MLKEM_AVX2_FUNC NttLowLayers(__m256i *a, __m256i *b, const int16_t *psi, uint32_t block)
+{
+    __m256i x = _mm256_permute2x128_si256(*a, *b, 0x20);
+    __m256i y = _mm256_permute2x128_si256(*a, *b, 0x31);
+    ButterflyCT(&x, &y, ExpandZeta8(psi[16 + 2 * block], psi[16 + 2 * block + 1]));
+    __m256i p = _mm256_unpacklo_epi64(x, y);
+    __m256i q = _mm256_unpackhi_epi64(x, y);
+    ButterflyCT(&p, &q, ExpandZeta4(_mm_loadl_epi64((const __m128i *)(psi + 32 + 4 * block))));
+    x = _mm256_blend_epi32(p, _mm256_slli_epi64(q, 32), 0xAA);
+    y = _mm256_blend_epi32(_mm256_srli_epi64(p, 32), q, 0xAA);
+    ButterflyCT(&x, &y, ExpandZeta2(_mm_loadu_si128((const __m128i *)(psi + 64 + 8 * block))));
+    x = BarrettAvx2(x);
+    y = BarrettAvx2(y);
+    p = _mm256_blend_epi32(x, _mm256_slli_epi64(y, 32), 0xAA);
+    q = _mm256_blend_epi32(_mm256_srli_epi64(x, 32), y, 0xAA);
+    x = _mm256_unpacklo_epi64(p, q);
+    y = _mm256_unpackhi_epi64(p, q);
+    *a = _mm256_permute2x128_si256(x, y, 0x20);
+    *b = _mm256_permute2x128_si256(x, y, 0x31);
+}
+
+void MLKEM_AVX2_FUNC MLKEM_ComputNTTAvx2(int16_t *a, const int16_t *psi)
+{
+    __m256i r[MLKEM_AVX2_REGS];
+    uint32_t k = 1;
+    for (uint32_t i = 0; i < MLKEM_AVX2_REGS; i++) {
+        r[i] = _mm256_loadu_si256((const __m256i *)(a + MLKEM_AVX2_LANES * i));
+    }
+    for (uint32_t len = MLKEM_AVX2_REGS / 2; len >= 1; len >>= 1) {
+        for (uint32_t start = 0; start < MLKEM_AVX2_REGS; start += 2 * len) {
+            __m256i zeta = _mm256_set1_epi16(psi[k++]);
+            for (uint32_t j = start; j < start + len; j++) {
+                ButterflyCT(&r[j], &r[j + len], zeta);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < MLKEM_AVX2_REGS; i += 2) {
+        NttLowLayers(&r[i], &r[i + 1], psi, i / 2);
+    }
+    for (uint32_t i = 0; i < MLKEM_AVX2_REGS; i++) {
+        _mm256_storeu_si256((__m256i *)(a + MLKEM_AVX2_LANES * i), r[i]);
+    }
+}
+#endif
+
 // Cryptol-friendly output
 static void print_as_cryptol_vector(const char *name, const int16_t *a, size_t n)
 {
@@ -68,6 +168,48 @@ static void print_as_cryptol_vector(const char *name, const int16_t *a, size_t n
     printf("];\n");
 }
 
+// 固定的伪随机输入，取值范围 [0, MLKEM_Q)
+static void fill_vector(int16_t *a, uint32_t seed)
+{
+    for (int i = 0; i < MLKEM_N; i++) {
+        seed = seed * 1103515245u + 12345u;
+        a[i] = (int16_t)((seed >> 16) % MLKEM_Q);
+    }
+}
+
+// 标量与 AVX2 后端对同一组向量的结果必须逐位相同
+static int cross_check(void)
+{
+    int mismatches = 0;
+#if defined(__x86_64__)
+    if (!__builtin_cpu_supports("avx2")) {
+        printf("// avx2 not supported, skip cross check\n");
+        return 0;
+    }
+    int16_t a[MLKEM_N];
+    int16_t b[MLKEM_N];
+    for (uint32_t v = 0; v < 1000; v++) {
+        if (v == 0) {
+            for (int i = 0; i < MLKEM_N; i++) {
+                a[i] = (int16_t)i;
+            }
+        } else {
+            fill_vector(a, v);
+        }
+        for (int i = 0; i < MLKEM_N; i++) {
+            b[i] = a[i];
+        }
+        MLKEM_ComputNTT(a, PRE_COMPUT_TABLE_NTT);
+        MLKEM_ComputNTTAvx2(b, PRE_COMPUT_TABLE_NTT);
+        for (int i = 0; i < MLKEM_N; i++) {
+            mismatches += (a[i] != b[i]);
+        }
+    }
+#endif
+    printf("// mismatches (scalar vs avx2): %d\n", mismatches);
+    return mismatches;
+}
+
 int main(void)
 {
     int16_t a[MLKEM_N];
@@ -85,5 +227,5 @@ int main(void)
     // 输出结果
     print_as_cryptol_vector("a_output", a, MLKEM_N);
 
-    return 0;
+    return cross_check() == 0 ? 0 : 1;
 }
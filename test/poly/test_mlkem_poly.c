@@ -0,0 +1,220 @@
+#include <stdint.h>
+#include <stdio.h>
+#include "ml_kem_poly.c"
+
+// ===============================
+// The NTT-domain products of ml_kem_poly.c against NIST.FIPS.203 Algorithm 11 MultiplyNTTs computed exactly mod
+// MLKEM_Q: the lazy accumulation of a row, the mulcache variant and the batched transposed product, for k = 2..4
+// and operands up to the bounds the lazy reduction relies on (|f|, |g| < MLKEM_Q).
+// ===============================
+
+#define ROUNDS 300
+#define BATCH  2
+
+// 17^{BitRev7(i)} * 2^{16} mod MLKEM_Q, centered, as in mlkem/src/ml_kem_pke.c
+static const int16_t PRE_COMPUT_TABLE_NTT_MONT[MLKEM_N_HALF] = {
+    -1044, -758,  -359,  -1517, 1493,  1422,  287,   202,   -171,  622,  1577,  182,   962,   -1202, -1474, 1468,
+    573,   -1325, 264,   383,   -829,  1458,  -1602, -130,  -681,  1017, 732,   608,   -1542, 411,   -205,  -1571,
+    1223,  652,   -552,  1015,  -1293, 1491,  -282,  -1544, 516,   -8,   -320,  -666,  -1618, -1162, 126,   1469,
+    -853,  -90,   -271,  830,   107,   -1421, -247,  -951,  -398,  961,  -1508, -725,  448,   -1065, 677,   -1275,
+    -1103, 430,   555,   843,   -1251, 871,   1550,  105,   422,   587,  177,   -235,  -291,  -460,  1574,  1653,
+    -246,  778,   1159,  -147,  -777,  1483,  -602,  1119,  -1590, 644,  -872,  349,   418,   329,   -156,  -75,
+    817,   1097,  603,   610,   1322,  -1285, -1465, 384,   -1215, -136, 1218,  -1335, -874,  220,   -1187, -1659,
+    -1185, -1530, -1278, 794,   -1510, -854,  -870,  478,   -108,  -308, 996,   991,   958,   -1460, 1522,  1628};
+
+static int32_t mod_q(int64_t a)
+{
+    a %= MLKEM_Q;
+    return (int32_t)(a < 0 ? a + MLKEM_Q : a);
+}
+
+static int32_t pow_mod_q(int32_t b, uint32_t e)
+{
+    int64_t r = 1;
+    for (; e != 0; e >>= 1) {
+        if (e & 1) {
+            r = r * b % MLKEM_Q;
+        }
+        b = (int32_t)((int64_t)b * b % MLKEM_Q);
+    }
+    return (int32_t)r;
+}
+
+static uint32_t bit_rev7(uint32_t i)
+{
+    uint32_t r = 0;
+    for (uint32_t b = 0; b < 7; b++) {
+        r |= ((i >> b) & 1) << (6 - b);
+    }
+    return r;
+}
+
+static int32_t g_gamma[MLKEM_N_HALF];  // 17^{2 * BitRev7(i) + 1} mod MLKEM_Q, NIST.FIPS.203 Algorithm 11
+static int32_t g_rInv;                 // 2^{-16} mod MLKEM_Q, takes an operand out of the Montgomery domain
+
+// h += f * g, NIST.FIPS.203 Algorithms 11 and 12, everything mod MLKEM_Q. fMont is in the Montgomery domain.
+static void ref_multiply_ntts_add(int32_t h[MLKEM_N], const int16_t *fMont, const int16_t *g)
+{
+    for (uint32_t i = 0; i < MLKEM_N_HALF; i++) {
+        int64_t f0 = mod_q((int64_t)fMont[2 * i] * g_rInv);
+        int64_t f1 = mod_q((int64_t)fMont[2 * i + 1] * g_rInv);
+        int64_t g0 = mod_q(g[2 * i]);
+        int64_t g1 = mod_q(g[2 * i + 1]);
+        h[2 * i] = mod_q(h[2 * i] + f0 * g0 + mod_q(f1 * g1) * g_gamma[i]);
+        h[2 * i + 1] = mod_q(h[2 * i + 1] + f0 * g1 + f1 * g0);
+    }
+}
+
+static uint32_t g_seed = 1;
+
+/*
+ * Values in (-MLKEM_Q, MLKEM_Q). mode 0 is pseudo-random, modes 1 and 2 are all -(MLKEM_Q - 1) and all
+ * MLKEM_Q - 1, the largest accumulators the lazy reduction has to take.
+ */
+static void fill_vector(int16_t *a, uint32_t n, uint32_t mode)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        g_seed = g_seed * 1103515245u + 12345u;
+        if (mode == 0) {
+            a[i] = (int16_t)((int32_t)((g_seed >> 8) % (2 * MLKEM_Q - 1)) - (MLKEM_Q - 1));
+        } else {
+            a[i] = (int16_t)((mode == 1) ? -(MLKEM_Q - 1) : (MLKEM_Q - 1));
+        }
+    }
+}
+
+// Counts the coefficients of out that differ from the reference mod MLKEM_Q, or leave (-bound, bound).
+static int count_mismatches(const int16_t *out, const int32_t *ref, int32_t bound)
+{
+    int mismatches = 0;
+    for (uint32_t n = 0; n < MLKEM_N; n++) {
+        mismatches += (mod_q(out[n]) != ref[n]) || (out[n] <= -bound) || (out[n] >= bound);
+    }
+    return mismatches;
+}
+
+static int16_t g_matrix[MLKEM_K_MAX * MLKEM_K_MAX][MLKEM_N];
+static int16_t g_matrixCache[MLKEM_K_MAX * MLKEM_K_MAX][MLKEM_N_HALF];
+static int16_t g_vec[BATCH][MLKEM_K_MAX][MLKEM_N];
+static int16_t g_out[BATCH][MLKEM_K_MAX][MLKEM_N];
+
+// The matrix, its mulcache, BATCH vectors and outputs with a start value.
+static void fill_operands(uint8_t k, uint32_t mode)
+{
+    for (uint32_t i = 0; i < (uint32_t)k * MLKEM_K_MAX; i++) {
+        fill_vector(g_matrix[i], MLKEM_N, mode);
+        MLKEM_PolyMulCache(g_matrixCache[i], g_matrix[i], PRE_COMPUT_TABLE_NTT_MONT);
+    }
+    for (uint32_t b = 0; b < BATCH; b++) {
+        for (uint8_t j = 0; j < k; j++) {
+            fill_vector(g_vec[b][j], MLKEM_N, (mode == 0) ? 0 : 3 - mode);
+            fill_vector(g_out[b][j], MLKEM_N, 0);
+        }
+    }
+}
+
+// Row i of matrix * g_vec[0] with MLKEM_MatrixRowMulAdd, which reduces its output.
+static int check_row(uint8_t k, uint8_t i)
+{
+    int16_t *row[MLKEM_K_MAX];
+    int16_t *vec[MLKEM_K_MAX];
+    int32_t ref[MLKEM_N];
+    for (uint32_t n = 0; n < MLKEM_N; n++) {
+        ref[n] = mod_q(g_out[0][i][n]);
+    }
+    for (uint8_t j = 0; j < k; j++) {
+        row[j] = g_matrix[i * MLKEM_K_MAX + j];
+        vec[j] = g_vec[0][j];
+        ref_multiply_ntts_add(ref, row[j], vec[j]);
+    }
+    MLKEM_MatrixRowMulAdd(k, row, vec, g_out[0][i], PRE_COMPUT_TABLE_NTT_MONT);
+    return count_mismatches(g_out[0][i], ref, MLKEM_Q / 2 + 1);
+}
+
+// Column i of the matrix dotted with g_vec[0], with or without the mulcache of the column.
+static int check_inner_product(uint8_t k, uint8_t i, int cached)
+{
+    int16_t *column[MLKEM_K_MAX];
+    int16_t *cache[MLKEM_K_MAX];
+    int16_t *vec[MLKEM_K_MAX];
+    int16_t out[MLKEM_N];
+    int32_t ref[MLKEM_N];
+    for (uint32_t n = 0; n < MLKEM_N; n++) {
+        out[n] = g_out[0][i][n];
+        ref[n] = mod_q(out[n]);
+    }
+    for (uint8_t j = 0; j < k; j++) {
+        column[j] = g_matrix[j * MLKEM_K_MAX + i];
+        cache[j] = g_matrixCache[j * MLKEM_K_MAX + i];
+        vec[j] = g_vec[0][j];
+        ref_multiply_ntts_add(ref, column[j], vec[j]);
+    }
+    MLKEM_VectorInnerProductAdd(k, column, cached ? cache : NULL, vec, out, PRE_COMPUT_TABLE_NTT_MONT);
+    return count_mismatches(out, ref, 2 * MLKEM_Q);
+}
+
+// matrix^T * g_vec[b] for the whole batch with MLKEM_TransposeMatrixMulAddBatch.
+static int check_transpose_batch(uint8_t k, int cached)
+{
+    int16_t *matrix[MLKEM_K_MAX * MLKEM_K_MAX];
+    int16_t *matrixCache[MLKEM_K_MAX * MLKEM_K_MAX];
+    int16_t *vecRows[BATCH][MLKEM_K_MAX];
+    int16_t *outRows[BATCH][MLKEM_K_MAX];
+    int16_t **vec[BATCH];
+    int16_t **out[BATCH];
+    static int32_t ref[BATCH][MLKEM_K_MAX][MLKEM_N];
+    for (uint32_t i = 0; i < (uint32_t)k * MLKEM_K_MAX; i++) {
+        matrix[i] = g_matrix[i];
+        matrixCache[i] = g_matrixCache[i];
+    }
+    for (uint32_t b = 0; b < BATCH; b++) {
+        for (uint8_t i = 0; i < k; i++) {
+            vecRows[b][i] = g_vec[b][i];
+            outRows[b][i] = g_out[b][i];
+            for (uint32_t n = 0; n < MLKEM_N; n++) {
+                ref[b][i][n] = mod_q(g_out[b][i][n]);
+            }
+            for (uint8_t j = 0; j < k; j++) {
+                ref_multiply_ntts_add(ref[b][i], g_matrix[j * MLKEM_K_MAX + i], g_vec[b][j]);
+            }
+        }
+        vec[b] = vecRows[b];
+        out[b] = outRows[b];
+    }
+    MLKEM_TransposeMatrixMulAddBatch(k, matrix, cached ? matrixCache : NULL, vec, out, BATCH,
+                                     PRE_COMPUT_TABLE_NTT_MONT);
+    int mismatches = 0;
+    for (uint32_t b = 0; b < BATCH; b++) {
+        for (uint8_t i = 0; i < k; i++) {
+            mismatches += count_mismatches(g_out[b][i], ref[b][i], 2 * MLKEM_Q);
+        }
+    }
+    return mismatches;
+}
+
+int main(void)
+{
+    for (uint32_t i = 0; i < MLKEM_N_HALF; i++) {
+        g_gamma[i] = pow_mod_q(17, 2 * bit_rev7(i) + 1);
+    }
+    g_rInv = pow_mod_q((1 << 16) % MLKEM_Q, MLKEM_Q - 2);
+
+    int lazy = 0;
+    int cached = 0;
+    for (uint8_t k = 2; k <= MLKEM_K_MAX; k++) {
+        for (uint32_t r = 0; r < ROUNDS; r++) {
+            uint32_t mode = (r < 2) ? r + 1 : 0;  // The extreme operands first.
+            fill_operands(k, mode);
+            lazy += check_inner_product(k, r % k, 0);
+            cached += check_inner_product(k, r % k, 1);
+            lazy += check_transpose_batch(k, 0);
+            fill_operands(k, mode);
+            cached += check_transpose_batch(k, 1);
+            fill_operands(k, mode);
+            lazy += check_row(k, r % k);
+        }
+    }
+    printf("// mismatches (reference vs lazy): %d\n", lazy);
+    printf("// mismatches (reference vs mulcache): %d\n", cached);
+    return (lazy == 0 && cached == 0) ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "hitls_build.h"
+#include "crypt_errno.h"
+#include "crypt_types.h"
+#include "crypt_eal_rand.h"
+#include "crypt_mlkem.h"
+#include "test_mlkem_util.h"
+
+// ===============================
+// Keypair pool: the workers fill the pool up to highWater, every keypair popped from the queue or generated by the
+// caller of an empty pool is a working key of its own, and threads popping at the same time never get the same
+// keypair. Build with HITLS_CRYPTO_MLKEM_POOL.
+// ===============================
+
+#define THREADS        4
+#define POPS           24
+#define HIGH_WATER     6
+#define FILL_WAIT_MS   60000
+
+// Waits until the workers have queued want keypairs, 0 if they did in time.
+static int WaitFilled(CRYPT_ML_KEM_Pool *pool, uint32_t want)
+{
+    const struct timespec tick = { 0, 1000000 };
+    CRYPT_ML_KEM_PoolStat stat;
+    for (uint32_t ms = 0; ms < FILL_WAIT_MS; ms++) {
+        if (CRYPT_ML_KEM_PoolGetStat(pool, &stat) != CRYPT_SUCCESS) {
+            return 1;
+        }
+        if (stat.available == want && stat.generated == want) {
+            return 0;
+        }
+        nanosleep(&tick, NULL);
+    }
+    return 1;
+}
+
+static int TestPara(int32_t type)
+{
+    const CRYPT_ML_KEM_PoolPara bad[] = {
+        { 0, HIGH_WATER, 1 },  // lowWater 0
+        { HIGH_WATER + 1, HIGH_WATER, 1 },  // lowWater above highWater
+        { 1, (1U << 16) + 1, 1 },  // highWater above the maximum
+        { 1, HIGH_WATER, 0 },  // no worker
+        { 1, HIGH_WATER, 65 },  // too many workers
+    };
+    const CRYPT_ML_KEM_PoolPara good = { 1, HIGH_WATER, 1 };
+    for (uint32_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CRYPT_ML_KEM_Pool *pool = CRYPT_ML_KEM_PoolNew(NULL, type, &bad[i]);
+        if (pool != NULL) {
+            CRYPT_ML_KEM_PoolFree(pool);
+            return 1;
+        }
+    }
+    return CRYPT_ML_KEM_PoolNew(NULL, type, NULL) != NULL || CRYPT_ML_KEM_PoolNew(NULL, 0, &good) != NULL;
+}
+
+/*
+ * One worker fills the pool, then it is drained faster than it refills: the pops answered from the queue and the
+ * ones generated by the caller add up, and every key works.
+ */
+static int TestDrain(int32_t type)
+{
+    const CRYPT_ML_KEM_PoolPara para = { 2, HIGH_WATER, 1 };
+    CRYPT_ML_KEM_Pool *pool = CRYPT_ML_KEM_PoolNew(NULL, type, &para);
+    CRYPT_ML_KEM_PoolStat stat;
+    int fail = pool == NULL || WaitFilled(pool, HIGH_WATER) != 0;
+    for (uint32_t i = 0; i < 2 * HIGH_WATER && fail == 0; i++) {
+        CRYPT_ML_KEM_Ctx *ctx = CRYPT_ML_KEM_PoolPop(pool);
+        fail = ctx == NULL || Roundtrip(ctx, ctx) != 0;
+        CRYPT_ML_KEM_FreeCtx(ctx);
+    }
+    if (fail == 0) {
+        fail = CRYPT_ML_KEM_PoolGetStat(pool, &stat) != CRYPT_SUCCESS || stat.popped + stat.empty != 2 * HIGH_WATER ||
+            stat.popped < HIGH_WATER || stat.genFail != 0;
+    }
+    CRYPT_ML_KEM_PoolFree(pool);  // The keypairs refilled meanwhile are cleansed.
+    return fail;
+}
+
+typedef struct {
+    CRYPT_ML_KEM_Pool *pool;
+    uint8_t ek[POPS][EK_MAX];
+    uint32_t ekLen;
+    int fail;
+} PopArg;
+
+static void *Popper(void *arg)
+{
+    PopArg *w = (PopArg *)arg;
+    for (uint32_t i = 0; i < POPS; i++) {
+        CRYPT_ML_KEM_Ctx *ctx = CRYPT_ML_KEM_PoolPop(w->pool);
+        CRYPT_KemEncapsKey pub = { w->ek[i], EK_MAX };
+        if (ctx == NULL || CRYPT_ML_KEM_GetEncapsKey(ctx, &pub) != CRYPT_SUCCESS || Roundtrip(ctx, ctx) != 0) {
+            w->fail = 1;
+        }
+        w->ekLen = pub.len;
+        CRYPT_ML_KEM_FreeCtx(ctx);
+    }
+    return NULL;
+}
+
+// Threads pop while the workers refill: no keypair is handed out twice.
+static int TestConcurrentPop(int32_t type)
+{
+    static PopArg arg[THREADS];
+    const CRYPT_ML_KEM_PoolPara para = { 2, HIGH_WATER, 2 };
+    CRYPT_ML_KEM_Pool *pool = CRYPT_ML_KEM_PoolNew(NULL, type, &para);
+    pthread_t tid[THREADS];
+    uint32_t started = 0;
+    int fail = pool == NULL;
+    for (uint32_t i = 0; i < THREADS && fail == 0; i++) {
+        arg[i].pool = pool;
+        arg[i].fail = 0;
+        fail = pthread_create(&tid[i], NULL, Popper, &arg[i]) != 0;
+        started += (fail == 0);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(tid[i], NULL);
+        fail |= arg[i].fail;
+    }
+    CRYPT_ML_KEM_PoolFree(pool);
+    for (uint32_t a = 0; a < THREADS * POPS && fail == 0; a++) {
+        for (uint32_t b = a + 1; b < THREADS * POPS && fail == 0; b++) {
+            fail = memcmp(arg[a / POPS].ek[a % POPS], arg[b / POPS].ek[b % POPS], arg[0].ekLen) == 0;
+        }
+    }
+    return fail;
+}
+
+int main(void)
+{
+    if (CRYPT_EAL_RandInit(CRYPT_RAND_SHA256, NULL, NULL, NULL, 0) != CRYPT_SUCCESS) {
+        printf("rand init failed\n");
+        return 1;
+    }
+    int fail = 0;
+    const int32_t types[] = { CRYPT_KEM_TYPE_MLKEM_512, CRYPT_KEM_TYPE_MLKEM_768, CRYPT_KEM_TYPE_MLKEM_1024 };
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        int para = TestPara(types[t]);
+        int drain = TestDrain(types[t]);
+        int pop = TestConcurrentPop(types[t]);
+        printf("type=%d para=%s drain=%s concurrentPop=%s\n", types[t], para ? "FAIL" : "ok", drain ? "FAIL" : "ok",
+            pop ? "FAIL" : "ok");
+        fail |= para | drain | pop;
+    }
+    CRYPT_EAL_RandDeinit();
+    printf(fail ? "FAIL\n" : "PASS\n");
+    return fail;
+}